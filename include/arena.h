@@ -0,0 +1,32 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct Arena Arena;
+
+// Size of the huge pages asked to the kernel, regions are rounded up to it
+#define ARENA_HUGE_PAGE (2 << 20)
+
+// Node of the memory that isn't bound to a NUMA node
+#define ARENA_ANY_NODE -1
+
+//============================== REGION FUNCTIONS ==============================
+void *region_map(size_t bytes, int node, bool *huge);
+void region_unmap(void *base, size_t bytes);
+void region_bind(void *base, size_t bytes, int node);
+int region_current_node();
+//============================== REGION FUNCTIONS ==============================
+
+//============================== ARENA FUNCTIONS ==============================
+Arena *arena_create(size_t block, int node);
+void arena_destroy(Arena *a);
+void arena_set_node(Arena *a, int node);
+size_t arena_bytes(Arena *a);
+size_t arena_huge_bytes(Arena *a);
+void *arena_take(Arena *a);
+void arena_give(Arena *a, void *block);
+//============================== ARENA FUNCTIONS ==============================
+
+#endif
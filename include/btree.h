@@ -1,14 +1,112 @@
 #ifndef B_TREE_H
 #define B_TREE_H
 
+#include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct Node Node;
 typedef struct BTree BTree;
+typedef struct BTreeSnapshot BTreeSnapshot;
+
+// Visitor of the scans, returns false to stop the scan
+typedef bool (*BTreeVisitor)(int key, int record, void *ctx);
+
+// Modes of the tree, given to btree_create
+#define BTREE_CLASSIC 0x0 // Records live in every node
+#define BTREE_PLUS 0x1    // B+-tree: records only in the leaves, leaves linked to their right sibling
+#define BTREE_COMPRESS 0x2 // Leaf pages are compressed in the binary file
+#define BTREE_EYTZINGER 0x4 // Large nodes also keep their keys in Eytzinger order for searches
+#define BTREE_PIN_INTERNAL 0x8 // Internal nodes stay in memory, only leaves are read from the disk
+#define BTREE_COW 0x10 // Pages are copied on write, so snapshots of the tree can be read in parallel
+#define BTREE_BLOOM 0x20 // A counting Bloom filter answers searches of absent keys without reading the tree
+#define BTREE_DIRECT 0x40 // The binary file is opened with O_DIRECT, pages are only cached by the tree
+#define BTREE_RECORD_INDEX 0x80 // A second tree, keyed on (record, key), finds the keys of a record without a scan
+#define BTREE_DUPLICATES 0x100 // A key keeps every record inserted with it, records can't be negative
+#define BTREE_HUGE_PAGES 0x200 // Nodes and the cache live in huge pages, on the NUMA node of the thread that created the tree
+
+// Default amount of pages kept in the cache
+#define BTREE_CACHE_PAGES 64
+
+// Keys the filter is first sized for, it doubles when they are exceeded
+#define BTREE_BLOOM_KEYS 65536
+
+// Suffix of the file of the index of the records, and size of its entries
+#define BTREE_INDEX_SUFFIX ".records"
+#define BTREE_INDEX_ENTRY_SIZE 8
+
+// Suffix of the file of the lists of records of the keys with duplicates
+#define BTREE_POSTINGS_SUFFIX ".postings"
+
+// Default time between two write-backs of the dirty pages, in milliseconds
+#define BTREE_FLUSH_INTERVAL_MS 1000
+
+// Sizes used to lay out the nodes in memory and in the file
+#define BTREE_CACHE_LINE 64
+#define BTREE_PAGE_SIZE 4096
+#define BTREE_LINEAR_SEARCH_KEYS 16
+#define BTREE_EYTZINGER_MIN_ORDER 64
+
+// Formats of btree_export
+#define BTREE_EXPORT_TEXT 0   // Same text of btree_level_order_print
+#define BTREE_EXPORT_BINARY 1 // Levels of nodes with their keys and records
+
+// Tuning of the export: nodes formatted per batch, pages read at once, gap of
+// pages read between two needed ones and smallest part of a level given to a thread
+#define BTREE_EXPORT_BATCH 256
+#define BTREE_EXPORT_RUN_PAGES 64
+#define BTREE_EXPORT_RUN_GAP 4
+#define BTREE_EXPORT_MIN_PART 512
+
+// Tuning of the bulk load: smallest run of pairs sorted by a thread, leaves
+// filled before they are written, smallest part of them given to a thread and
+// runs merged together under the memory limit
+#define BTREE_BULK_MIN_PART 4096
+#define BTREE_BULK_WINDOW 4096
+#define BTREE_BULK_MIN_LEAVES 64
+#define BTREE_BULK_MERGE_WAYS 64
+
+// Pages asked ahead of the one being read by scans and walks of the levels, and
+// keys descending together in a batch of searches
+#define BTREE_PREFETCH_DISTANCE 8
+#define BTREE_SEARCH_BATCH 64
+
+// Calibration of the page size: candidates, keys inserted and searched on
+// each one, memory of the cache given to all of them and suffix of their file
+#define BTREE_CALIBRATE_MIN_PAGE 512
+#define BTREE_CALIBRATE_MAX_PAGE 65536
+#define BTREE_CALIBRATE_KEYS 32768
+#define BTREE_CALIBRATE_CACHE_BYTES (256 * 1024)
+#define BTREE_CALIBRATE_SUFFIX ".calib"
+
+// Suffix of the file where a tree is rebuilt before it replaces the old one
+#define BTREE_REBUILD_SUFFIX ".rebuild"
+
+// Under a memory limit, the Bloom filter and the pinned internal nodes take
+// 1 / BTREE_MEMORY_RESIDENT_SHARE of it
+#define BTREE_MEMORY_RESIDENT_SHARE 4
+
+// Under a memory limit, the cache takes 1 / BTREE_MEMORY_CACHE_SHARE of what they leave
+#define BTREE_MEMORY_CACHE_SHARE 2
+
+// Operations timed by the latency histograms and marked in the traces
+#define BTREE_OP_INSERT 0
+#define BTREE_OP_SEARCH 1
+#define BTREE_OP_DELETE 2
+#define BTREE_OP_DELETE_RANGE 3
+#define BTREE_OP_UPDATE 4
+#define BTREE_OP_SCAN 5
+#define BTREE_OP_GET_ALL 6
+#define BTREE_OPS 7
+
+// Events kept by the ring of a trace file when no amount is given
+#define BTREE_TRACE_EVENTS (1 << 20)
 
 //============================== NODE FUNCTIONS ==============================
 Node *node_create(BTree *bt, bool is_leaf, int pos);
 size_t node_size(BTree *bt);
+int node_max_keys(BTree *bt, Node *n);
+int btree_tuned_order(size_t page_size, int flags);
 void node_destroy(Node *n);
 //============================== NODE FUNCTIONS ==============================
 
@@ -18,22 +116,44 @@ Node *disk_read(BTree *btree, int pos);
 //============================== ACCESS FUNCTIONS ==============================
 
 //============================== B-TREE FUNCTIONS ==============================
-BTree *btree_create(char *path, int order);
+BTree *btree_create(char *path, int order, int flags);
+BTree *btree_create_paged(char *path, size_t page_size, int flags);
+size_t btree_calibrate_page_size(char *path, int flags);
 void btree_destroy(BTree *bt);
+void btree_set_cache_size(BTree *bt, int pages);
+void btree_set_numa_node(BTree *bt, int node);
+size_t btree_huge_page_bytes(BTree *bt, size_t *mapped);
+void btree_set_flush_interval(BTree *bt, long ms);
+void btree_set_memory_limit(BTree *bt, size_t bytes);
+void btree_sync(BTree *bt);
+long btree_file_size(BTree *bt);
 Node *btree_get_root(BTree *bt);
+int btree_order(BTree *bt);
+int btree_flags(BTree *bt);
+bool btree_rebuild(BTree *bt, int order, size_t page_size);
 
 //============================== INSERT FUNCTIONS ==============================
-void btree_insert(BTree *bt, int key, int record);
+bool btree_insert(BTree *bt, int key, int record);
+bool btree_update(BTree *bt, int key, int record);
 void split_child(BTree *bt, Node *x, Node *y, int index);
 void insert_non_full(BTree *bt, Node *node, int key, int record);
 
+//============================== BULK FUNCTIONS ==============================
+void btree_bulk_load(BTree *bt, const int *keys, const int *records, long n, int threads);
+void btree_bulk_load_file(BTree *bt, FILE *fp, int threads);
+
 //============================== SEARCH FUNCTIONS ==============================
 bool btree_search(BTree *bt, int key);
 bool search_node(BTree *bt, Node *n, int key);
+void btree_search_batch(BTree *bt, const int *keys, int n, bool *found, int *records);
+int btree_find_by_record(BTree *bt, int record, int *keys, int max);
+long btree_get_all(BTree *bt, int key, BTreeVisitor visit, void *ctx);
 
 //============================== DELETE FUNCTIONS ==============================
 void btree_delete(BTree *bt, int key);
-void remove_from_node(BTree *bt, Node *n, int key);
+void btree_delete_range(BTree *bt, int lo, int hi);
+void btree_truncate(BTree *bt);
+bool remove_from_node(BTree *bt, Node *n, int key, int *record);
 void remove_from_leaf(BTree *bt, Node *n, int i);
 void remove_from_non_leaf(BTree *bt, Node *n, int i);
 int get_predecessor(BTree *bt, Node *n, int i);
@@ -44,7 +164,38 @@ void borrow_from_next(BTree *bt, Node *n, int i);
 void fill_node(BTree *bt, Node *n, int i);
 int find_key_index(Node *node, int key);
 
+//============================== B+-TREE FUNCTIONS ==============================
+int bplus_child_index(Node *n, int key);
+bool bplus_search(BTree *bt, int key, int *record);
+void bplus_split_child(BTree *bt, Node *x, Node *y, int i);
+void bplus_insert_non_full(BTree *bt, Node *node, int key, int record);
+bool bplus_remove_from_node(BTree *bt, Node *n, int key, int *record);
+void bplus_fill_node(BTree *bt, Node *n, int index);
+
+//============================== SCAN FUNCTIONS ==============================
+void btree_scan(BTree *bt, int lo, int hi, BTreeVisitor visit, void *ctx);
+
+//============================== SNAPSHOT FUNCTIONS ==============================
+BTreeSnapshot *btree_snapshot_acquire(BTree *bt);
+void btree_snapshot_release(BTreeSnapshot *s);
+unsigned btree_snapshot_epoch(BTreeSnapshot *s);
+bool btree_snapshot_search(BTreeSnapshot *s, int key, int *record);
+void btree_snapshot_scan(BTreeSnapshot *s, int lo, int hi, BTreeVisitor visit, void *ctx);
+void btree_snapshot_level_order_print(BTreeSnapshot *s, FILE *fp);
+
 //============================== PRINT FUNCTION ==============================
 void btree_level_order_print(BTree *bt, FILE *fp);
+void btree_export(BTree *bt, FILE *fp, int format, int threads);
+
+//============================== CHECK FUNCTIONS ==============================
+bool btree_check(BTree *bt, FILE *fp);
+
+//============================== STATS FUNCTIONS ==============================
+const char *btree_op_name(int op);
+void btree_set_latency_stats(BTree *bt, bool enabled);
+uint64_t btree_latency_percentile(BTree *bt, int op, double q);
+void btree_latency_print(BTree *bt, FILE *fp);
+void btree_trace_open(BTree *bt, const char *path, int events);
+void btree_trace_close(BTree *bt);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Max amount of bytes that packing n ints may take
+#define PACK_MAX_SIZE(n) (sizeof(int32_t) + 1 + (size_t)(n) * sizeof(int32_t))
+
+//============================== BIT PACKING ==============================
+int bit_width(uint32_t v);
+size_t bit_pack(const uint32_t *v, int n, int width, unsigned char *out);
+size_t bit_unpack(const unsigned char *in, int n, int width, uint32_t *v);
+
+//============================== INTEGER CODECS ==============================
+size_t delta_pack(const int *v, int n, unsigned char *out);
+size_t delta_unpack(const unsigned char *in, int n, int *v);
+size_t for_pack(const int *v, int n, unsigned char *out);
+size_t for_unpack(const unsigned char *in, int n, int *v);
+
+#endif
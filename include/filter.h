@@ -0,0 +1,27 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Filter Filter;
+
+// Counters of the filter per key it is sized for, and counters checked per key
+#define FILTER_COUNTERS_PER_KEY 12
+#define FILTER_PROBES 6
+
+//============================== FILTER FUNCTIONS ==============================
+Filter *filter_create(long capacity);
+void filter_destroy(Filter *f);
+long filter_count(Filter *f);
+long filter_capacity(Filter *f);
+long filter_capacity_within(size_t bytes);
+//============================== FILTER FUNCTIONS ==============================
+
+//============================== ACCESS FUNCTIONS ==============================
+void filter_add(Filter *f, int key);
+void filter_remove(Filter *f, int key);
+bool filter_may_contain(Filter *f, int key);
+//============================== ACCESS FUNCTIONS ==============================
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct Pager Pager;
+typedef struct PagerView PagerView;
+typedef struct PagerReader PagerReader;
+
+// Encode a whole page to "out", returning the amount of bytes used (at most PAGER_MAX_ENCODED(page_size))
+typedef size_t (*PageEncoder)(const void *page, void *out, void *ctx);
+// Decode "len" bytes back to the whole page
+typedef void (*PageDecoder)(const void *in, size_t len, void *page, void *ctx);
+
+#define PAGER_MAX_ENCODED(page_size) ((page_size) + 16)
+
+// Alignment of the buffers, offsets and sizes of the transfers with O_DIRECT
+#define PAGER_DIRECT_ALIGN 4096
+
+// Bytes of a cached page pulled to the CPU caches by a prefetch
+#define PAGER_PREFETCH_BYTES 256
+
+//============================== PAGER FUNCTIONS ==============================
+Pager *pager_open(char *path, size_t page_size);
+void pager_close(Pager *p);
+size_t pager_page_size(Pager *p);
+int pager_page_count(Pager *p);
+int pager_alloc(Pager *p);
+int pager_alloc_run(Pager *p, int count);
+void pager_free(Pager *p, int pos);
+int pager_free_list(Pager *p, const int **pages);
+int pager_cache_size(Pager *p);
+size_t pager_huge_bytes(Pager *p, size_t *mapped);
+long pager_flush_interval(Pager *p);
+void pager_set_cache(Pager *p, int pages);
+void pager_set_codec(Pager *p, PageEncoder encode, PageDecoder decode, void *ctx);
+long pager_file_size(Pager *p);
+void pager_enable_cow(Pager *p);
+bool pager_enable_direct(Pager *p);
+void pager_enable_huge_pages(Pager *p, int node);
+//============================== PAGER FUNCTIONS ==============================
+
+//============================== ACCESS FUNCTIONS ==============================
+void pager_read(Pager *p, int pos, void *buf);
+void pager_write(Pager *p, int pos, const void *buf);
+void pager_prefetch(Pager *p, int pos);
+void pager_set_flush_interval(Pager *p, long ms);
+void pager_flush(Pager *p);
+void pager_sync(Pager *p);
+//============================== ACCESS FUNCTIONS ==============================
+
+//============================== READER FUNCTIONS ==============================
+PagerReader *pager_reader_create(Pager *p, void *codec_ctx);
+void pager_reader_destroy(PagerReader *r);
+void pager_reader_read(PagerReader *r, int first, int count, void *buf);
+void pager_reader_prefetch(PagerReader *r, int first, int count);
+//============================== READER FUNCTIONS ==============================
+
+//============================== VIEW FUNCTIONS ==============================
+PagerView *pager_view_acquire(Pager *p);
+void pager_view_release(PagerView *v);
+unsigned pager_view_epoch(PagerView *v);
+int pager_view_count(Pager *p);
+PagerReader *pager_view_reader_create(PagerView *v, void *codec_ctx);
+void pager_view_read(PagerView *v, int pos, void *buf, void *codec_ctx);
+void pager_view_prefetch(PagerView *v, int pos);
+//============================== VIEW FUNCTIONS ==============================
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef POSTINGS_H
+#define POSTINGS_H
+
+#include <stdbool.h>
+
+typedef struct Postings Postings;
+
+// Visitor of the records of a list, returns false to stop
+typedef bool (*PostingsVisitor)(int record, void *ctx);
+
+// Size of the pages of the lists. A list takes a run of consecutive pages,
+// its first page starts with the amount of records and of pages of the run
+#define POSTINGS_PAGE_SIZE 256
+
+// Pages asked ahead of the one being read while a list is visited
+#define POSTINGS_PREFETCH_PAGES 8
+
+// A slot keeps a single record as it is, or the list starting at page "pos" as -(pos + 1)
+#define POSTINGS_IS_LIST(slot) ((slot) < 0)
+
+//============================== POSTINGS FUNCTIONS ==============================
+Postings *postings_open(char *path);
+void postings_close(Postings *p);
+void postings_set_cache_size(Postings *p, int pages);
+void postings_sync(Postings *p);
+long postings_file_size(Postings *p);
+//============================== POSTINGS FUNCTIONS ==============================
+
+//============================== LIST FUNCTIONS ==============================
+int postings_add(Postings *p, int slot, int record);
+int postings_first(Postings *p, int slot);
+long postings_count(Postings *p, int slot);
+bool postings_visit(Postings *p, int slot, PostingsVisitor visit, void *ctx);
+void postings_free(Postings *p, int slot);
+//============================== LIST FUNCTIONS ==============================
+
+#endif
@@ -1,11 +1,11 @@
 #ifndef QUEUE_H
 #define QUEUE_H
 
-#include "./btree.h"
-
-typedef struct QueueNode QueueNode;
 typedef struct Queue Queue;
 
+// Initial amount of items of the ring buffer, a power of 2
+#define QUEUE_INITIAL_CAPACITY 64
+
 //======================= MEMORY AND GETTERS =======================
 Queue *queue_create();
 int queue_get_size(Queue *q);
@@ -13,7 +13,8 @@ int queue_is_empty(Queue *q);
 void queue_destroy(Queue *q);
 
 //======================= MAIN OPERATIONS =======================
-void queue_enqueue(Queue *q, Node *n);
-Node *queue_dequeue(Queue *q);
+void queue_enqueue(Queue *q, int pos);
+int queue_dequeue(Queue *q);
+int queue_peek(Queue *q, int i);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include "btree.h"
+
+// Operations of a request
+#define SERVER_OP_INSERT 1 // Insert "key" with the record "value"
+#define SERVER_OP_GET 2    // Get the record of "key"
+#define SERVER_OP_DELETE 3 // Delete "key"
+#define SERVER_OP_SCAN 4   // Get the pairs of the range ["key", "value"], at most SERVER_SCAN_LIMIT
+#define SERVER_OP_SYNC 5   // Write the tree to the disk
+#define SERVER_OP_DELETE_RANGE 6 // Delete the keys of the range ["key", "value"]
+#define SERVER_OP_UPDATE 7 // Change the record of "key" to "value"
+#define SERVER_OP_FIND_BY_RECORD 8 // Get the pairs whose record is "value", at most SERVER_SCAN_LIMIT
+#define SERVER_OP_GET_ALL 9 // Get the pairs of "key", at most SERVER_SCAN_LIMIT, and the amount of them as the record
+
+// Status of a response
+#define SERVER_OK 0
+#define SERVER_NOT_FOUND 1
+#define SERVER_BAD_REQUEST 2
+
+// Pairs given by a scan; a longer range is read again from the last key given plus one
+#define SERVER_SCAN_LIMIT 1024
+
+// Tuning of the event loop: pending connections, events handled per wait,
+// bytes read per call, bytes of requests kept per client and time without
+// requests before the dirty pages are written to the disk
+#define SERVER_BACKLOG 128
+#define SERVER_MAX_EVENTS 64
+#define SERVER_READ_SIZE 65536
+#define SERVER_MAX_INPUT (1 << 20)
+#define SERVER_IDLE_SYNC_MS 1000
+
+// Every message is in the byte order of the host, the socket is local. A
+// client may send many requests without waiting; the responses of a client
+// come in the order of its requests
+typedef struct
+{
+    uint32_t op;   // SERVER_OP_*
+    int32_t key;   // Key, first key of a range
+    int32_t value; // Record of an insert, last key of a range
+} ServerRequest;
+
+typedef struct
+{
+    uint32_t status; // SERVER_OK, SERVER_NOT_FOUND or SERVER_BAD_REQUEST
+    int32_t record;  // Record of a get, amount of records of a get of all of them
+    uint32_t count;  // Pairs after the response, only for scans, finds by record and gets of all records
+} ServerResponse;
+
+typedef struct
+{
+    int32_t key;
+    int32_t record;
+} ServerPair;
+
+//============================== SERVER FUNCTIONS ==============================
+void server_run(BTree *bt, const char *path);
+//============================== SERVER FUNCTIONS ==============================
+
+#endif
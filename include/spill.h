@@ -0,0 +1,26 @@
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Spill Spill;
+
+// Budget of a spill that never leaves the memory
+#define SPILL_UNBOUNDED SIZE_MAX
+
+// Suffix of the temporary files, after the path given to spill_create
+#define SPILL_SUFFIX ".spillXXXXXX"
+
+//============================== SPILL FUNCTIONS ==============================
+Spill *spill_create(size_t item_size, size_t budget, const char *path);
+void spill_destroy(Spill *s);
+long spill_count(Spill *s);
+void spill_push(Spill *s, const void *items, long n);
+void spill_rewind(Spill *s);
+long spill_read(Spill *s, void *items, long n);
+void spill_clear(Spill *s);
+//============================== SPILL FUNCTIONS ==============================
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef STR_TREE_H
+#define STR_TREE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct StrNode StrNode;
+typedef struct StrTree StrTree;
+
+// Visitor of the scans, returns false to stop the scan
+typedef bool (*StrTreeVisitor)(const char *key, size_t len, int record, void *ctx);
+
+//============================== NODE FUNCTIONS ==============================
+StrNode *strnode_create(StrTree *st, bool is_leaf, int pos);
+size_t strnode_encoded_size(StrNode *n);
+void strnode_destroy(StrNode *n);
+//============================== NODE FUNCTIONS ==============================
+
+//============================== ACCESS FUNCTIONS ==============================
+void strtree_disk_write(StrTree *st, StrNode *n);
+StrNode *strtree_disk_read(StrTree *st, int pos);
+//============================== ACCESS FUNCTIONS ==============================
+
+//============================== STRING TREE FUNCTIONS ==============================
+StrTree *strtree_create(char *path, size_t page_size);
+void strtree_destroy(StrTree *st);
+size_t strtree_max_key_len(StrTree *st);
+void strtree_set_cache_size(StrTree *st, int pages);
+void strtree_sync(StrTree *st);
+
+//============================== INSERT FUNCTIONS ==============================
+bool strtree_insert(StrTree *st, const char *key, size_t len, int record);
+
+//============================== SEARCH FUNCTIONS ==============================
+bool strtree_search(StrTree *st, const char *key, size_t len, int *record);
+void strtree_scan(StrTree *st, const char *lo, size_t lo_len, const char *hi, size_t hi_len, StrTreeVisitor visit, void *ctx);
+
+//============================== DELETE FUNCTIONS ==============================
+bool strtree_delete(StrTree *st, const char *key, size_t len);
+
+//============================== PRINT FUNCTION ==============================
+void strtree_level_order_print(StrTree *st, FILE *fp);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+typedef struct Histogram Histogram;
+typedef struct Trace Trace;
+
+// Values under 2^HISTOGRAM_SUB_BITS are counted one by one, larger ones in
+// 2^HISTOGRAM_SUB_BITS buckets per power of two, about 3% apart
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+// Kinds of the events of a trace
+#define TRACE_OP_BEGIN 0
+#define TRACE_OP_END 1
+#define TRACE_SPLIT 2
+#define TRACE_MERGE 3
+#define TRACE_BORROW 4
+#define TRACE_PAGE_READ 5
+#define TRACE_PAGE_WRITE 6
+#define TRACE_KINDS 7
+
+// First bytes of a trace file
+#define TRACE_MAGIC 0x45435254u
+
+// Start of a trace file, followed by "capacity" events used as a ring
+typedef struct
+{
+    uint32_t magic;
+    uint32_t capacity; // Events the ring holds, the oldest ones are overwritten
+    uint64_t written;  // Events written since the trace was opened
+} TraceHeader;
+
+// Event of a trace, as kept in the file
+typedef struct
+{
+    uint64_t time;  // Nanoseconds since the trace was opened
+    uint32_t op;    // Operation the event belongs to, 0 out of them
+    uint8_t kind;   // One of TRACE_*
+    uint8_t type;   // Type of the operation, given to trace_begin
+    int16_t depth;  // Depth of the node of the page, 0 for the root
+    int32_t pos;    // Position of the page, -1 without one
+    int32_t key;    // Key of the operation
+} TraceEvent;
+
+//============================== HISTOGRAM FUNCTIONS ==============================
+Histogram *histogram_create();
+void histogram_destroy(Histogram *h);
+void histogram_record(Histogram *h, uint64_t value);
+void histogram_reset(Histogram *h);
+uint64_t histogram_count(Histogram *h);
+uint64_t histogram_max(Histogram *h);
+double histogram_mean(Histogram *h);
+uint64_t histogram_percentile(Histogram *h, double q);
+//============================== HISTOGRAM FUNCTIONS ==============================
+
+//============================== TRACE FUNCTIONS ==============================
+Trace *trace_open(const char *path, uint32_t capacity);
+void trace_close(Trace *t);
+uint64_t trace_now();
+void trace_begin(Trace *t, int type, int key);
+void trace_end(Trace *t);
+void trace_event(Trace *t, int kind, int pos, int depth);
+//============================== TRACE FUNCTIONS ==============================
+
+#endif
@@ -0,0 +1,280 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "../include/arena.h"
+
+// Policy and flag of mbind, as in numaif.h: the pages prefer the node but may
+// go elsewhere when it is full, and the pages already there are moved
+#define REGION_MPOL_PREFERRED 1
+#define REGION_MPOL_MF_MOVE (1 << 1)
+
+// NUMA nodes a region can be bound to
+#define REGION_MAX_NODES 1024
+
+struct Arena
+{
+    size_t block;         // Size of every block
+    size_t region;        // Size of every region, a multiple of ARENA_HUGE_PAGE
+    int node;             // NUMA node of the regions, ARENA_ANY_NODE if not bound
+    pthread_mutex_t lock; // Lock of the blocks, nodes are taken and given by many threads
+    void *free_blocks;    // Blocks given back, each one keeps the next in its first bytes
+    char *next;           // Part of the last region not taken yet
+    char *end;
+    char **regions;       // Regions of the arena
+    bool *huge;           // Flag to the regions backed by reserved huge pages
+    int n_regions;
+    int regions_cap;
+};
+
+/**
+ * @brief Round a size up to a multiple of ARENA_HUGE_PAGE
+ *
+ * @param size_t bytes
+ * @return size_t
+ */
+static size_t region_round(size_t bytes)
+{
+    return (bytes + ARENA_HUGE_PAGE - 1) / ARENA_HUGE_PAGE * ARENA_HUGE_PAGE;
+}
+
+/**
+ * @brief Map a region of anonymous memory, backed by huge pages when possible
+ *
+ * Reserved huge pages (MAP_HUGETLB) are tried first. Without them, the
+ * region takes ordinary pages and asks for transparent huge pages, which the
+ * kernel may give or not. The region is bound to the NUMA node before its
+ * pages are touched, so they are placed there from the start
+ *
+ * @param size_t bytes rounded up to ARENA_HUGE_PAGE
+ * @param int node ARENA_ANY_NODE leaves the placement to the kernel
+ * @param bool* huge if not NULL, receives if the region has reserved huge pages
+ * @return void* aligned to a page
+ */
+void *region_map(size_t bytes, int node, bool *huge)
+{
+    size_t len = region_round(bytes);
+    bool reserved = true;
+
+    void *base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        reserved = false;
+        base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            perror("The system couldn't map memory.\n");
+            exit(1);
+        }
+        madvise(base, len, MADV_HUGEPAGE);
+    }
+
+    region_bind(base, len, node);
+    if (huge)
+        *huge = reserved;
+
+    return base;
+}
+
+/**
+ * @brief Give back a region got from region_map
+ *
+ * @param void* base
+ * @param size_t bytes the size given to region_map
+ */
+void region_unmap(void *base, size_t bytes)
+{
+    if (base)
+        munmap(base, region_round(bytes));
+}
+
+/**
+ * @brief Make the pages of a region prefer a NUMA node, moving the ones already placed
+ *
+ * Does nothing on kernels without NUMA support or for nodes that don't exist,
+ * the pages just stay where the kernel puts them
+ *
+ * @param void* base
+ * @param size_t bytes
+ * @param int node ARENA_ANY_NODE does nothing
+ */
+void region_bind(void *base, size_t bytes, int node)
+{
+    if (node < 0 || node >= REGION_MAX_NODES)
+        return;
+
+    unsigned long mask[REGION_MAX_NODES / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+
+    syscall(SYS_mbind, base, region_round(bytes), REGION_MPOL_PREFERRED, mask, REGION_MAX_NODES + 1, REGION_MPOL_MF_MOVE);
+}
+
+/**
+ * @brief Get the NUMA node of the CPU running the calling thread
+ *
+ * @return int ARENA_ANY_NODE if the kernel doesn't tell
+ */
+int region_current_node()
+{
+    unsigned cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+        return ARENA_ANY_NODE;
+
+    return (int)node;
+}
+
+/**
+ * @brief Create an arena of blocks of the same size, carved from huge-page regions
+ *
+ * @param size_t block rounded up to a multiple of the size of a pointer
+ * @param int node NUMA node of the regions, ARENA_ANY_NODE if not bound
+ * @return Arena*
+ */
+Arena *arena_create(size_t block, int node)
+{
+    Arena *a = (Arena *)calloc(1, sizeof(Arena));
+
+    a->block = (block + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+    a->region = region_round(a->block);
+    a->node = node;
+    pthread_mutex_init(&a->lock, NULL);
+
+    return a;
+}
+
+/**
+ * @brief Give back every region of an arena, with all of its blocks
+ *
+ * @param Arena* a
+ */
+void arena_destroy(Arena *a)
+{
+    if (!a)
+        return;
+
+    for (int i = 0; i < a->n_regions; i++)
+        region_unmap(a->regions[i], a->region);
+    free(a->regions);
+    free(a->huge);
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+}
+
+/**
+ * @brief Bind the arena to another NUMA node, moving the regions it already has
+ *
+ * @param Arena* a
+ * @param int node
+ */
+void arena_set_node(Arena *a, int node)
+{
+    pthread_mutex_lock(&a->lock);
+
+    a->node = node;
+    for (int i = 0; i < a->n_regions; i++)
+        region_bind(a->regions[i], a->region, node);
+
+    pthread_mutex_unlock(&a->lock);
+}
+
+/**
+ * @brief Get the bytes of the regions of an arena
+ *
+ * @param Arena* a
+ * @return size_t
+ */
+size_t arena_bytes(Arena *a)
+{
+    pthread_mutex_lock(&a->lock);
+    size_t bytes = (size_t)a->n_regions * a->region;
+    pthread_mutex_unlock(&a->lock);
+
+    return bytes;
+}
+
+/**
+ * @brief Get the bytes of the regions of an arena backed by reserved huge pages
+ *
+ * @param Arena* a
+ * @return size_t
+ */
+size_t arena_huge_bytes(Arena *a)
+{
+    size_t bytes = 0;
+
+    pthread_mutex_lock(&a->lock);
+    for (int i = 0; i < a->n_regions; i++)
+    {
+        if (a->huge[i])
+            bytes += a->region;
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    return bytes;
+}
+
+/**
+ * @brief Take a block of the arena
+ *
+ * Blocks given back are reused first, then the last region is carved, and
+ * a new region is mapped when it is used up
+ *
+ * @param Arena* a
+ * @return void*
+ */
+void *arena_take(Arena *a)
+{
+    pthread_mutex_lock(&a->lock);
+
+    void *block = a->free_blocks;
+    if (block)
+    {
+        a->free_blocks = *(void **)block;
+    }
+    else
+    {
+        if (!a->next || a->next + a->block > a->end)
+        {
+            if (a->n_regions == a->regions_cap)
+            {
+                a->regions_cap = a->regions_cap ? a->regions_cap * 2 : 16;
+                a->regions = (char **)realloc(a->regions, a->regions_cap * sizeof(char *));
+                a->huge = (bool *)realloc(a->huge, a->regions_cap * sizeof(bool));
+            }
+
+            a->next = (char *)region_map(a->region, a->node, &a->huge[a->n_regions]);
+            a->end = a->next + a->region;
+            a->regions[a->n_regions++] = a->next;
+        }
+
+        block = a->next;
+        a->next += a->block;
+    }
+
+    pthread_mutex_unlock(&a->lock);
+
+    return block;
+}
+
+/**
+ * @brief Give back a block taken from the arena
+ *
+ * @param Arena* a
+ * @param void* block
+ */
+void arena_give(Arena *a, void *block)
+{
+    pthread_mutex_lock(&a->lock);
+
+    *(void **)block = a->free_blocks;
+    a->free_blocks = block;
+
+    pthread_mutex_unlock(&a->lock);
+}
@@ -1,7 +1,22 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../include/pager.h"
+#include "../include/compress.h"
+#include "../include/filter.h"
 #include "../include/queue.h"
+#include "../include/spill.h"
+#include "../include/strtree.h"
+#include "../include/postings.h"
+#include "../include/arena.h"
+#include "../include/trace.h"
 #include "../include/btree.h"
 
 struct Node
@@ -9,22 +24,176 @@ struct Node
     int n_keys;     // Number of nodes
     bool is_leaf;   // Flag to leaves
     int b_position; // Node's position in the binary file
+    int next;       // Right sibling of a leaf (only B+-tree mode)
     int *keys;      // Set of keys
+    int *children;  // Index of node's children, right after the keys
     int *records;   // Set of values associated to the keys
-    int *children;  // Index of node's children
+    int *eytz;      // Keys in Eytzinger order, NULL if not built
+    int *eytz_rank; // Index in the sorted keys of every key of eytz
+    Arena *arena;   // Arena of the block of the node, NULL if it is in the heap
 };
 
+// Context of the codec of the compressed mode, each reader of pages has its own
+typedef struct
+{
+    BTree *bt;    // Tree of the pages
+    int *scratch; // Buffer used to compress the keys and records of a leaf
+} NodeCodec;
+
 struct BTree
 {
     int order;       // Min order of the three
+    int inner_order; // Max amount of children of an internal node
+    int flags;       // Mode of the tree, given by BTREE_* flags
     Node *root;      // Tree's root
-    int node_amount; // Amount of nodes registred in the tree
-    FILE *bfile;     // The file where the data will be write/read
+    Pager *pager;    // The pages of the file where the data will be write/read
+    char *page;      // Buffer used to encode/decode a node to/from its page
+    size_t stride;   // Size of the page of a node in the binary file
+    size_t block;    // Size of the memory block of a node
+    Node **pinned;   // Internal nodes kept in memory, by position (only BTREE_PIN_INTERNAL)
+    int pinned_cap;  // Amount of positions the vector of pinned nodes can hold
+    int pinned_amount; // Amount of nodes pinned
+    NodeCodec codec; // Codec of the pages written and read by the tree
+    pthread_mutex_t lock; // Lock of the writers, snapshots are only taken between writes
+    Filter *filter;       // Keys that may be in the tree (only BTREE_BLOOM)
+    char *path;           // Binary file of the tree
+    size_t memory_limit;  // Bytes of memory the tree may use, 0 without a limit
+    StrTree *index;       // Keys of every record, ordered by (record, key) (only BTREE_RECORD_INDEX)
+    char *index_path;     // File of the index, next to the binary file
+    Postings *postings;   // Lists of the keys with more than one record (only BTREE_DUPLICATES)
+    char *postings_path;  // File of the lists, next to the binary file
+    Arena *arena;         // Blocks of the nodes, in regions of huge pages (only BTREE_HUGE_PAGES)
+    int numa_node;        // NUMA node of the memory of the nodes and of the cache
+    Histogram *latency[BTREE_OPS]; // Time of the operations, per type, NULL while not measured
+    Trace *trace;                  // Events of the operations, NULL without a trace
+};
+
+struct BTreeSnapshot
+{
+    BTree *bt;       // Tree of the snapshot
+    PagerView *view; // Pages of the tree when the snapshot was taken
+    int root;        // Position of the root, -1 if the tree was empty
+    char *page;      // Buffer used to decode a node from its page
+    NodeCodec codec; // Codec used by the reads of the snapshot
 };
 
+static Node *node_decode(BTree *bt, const char *page, int pos);
+static void node_free(BTree *bt, int pos);
+static size_t resident_budget(BTree *bt);
+static void filter_rebuild(BTree *bt, long capacity);
+static long filter_fit(BTree *bt, long capacity);
+static void scan_tree(BTree *bt, BTreeSnapshot *s, Node *root, int lo, int hi, BTreeVisitor visit, void *ctx);
+static bool record_lookup(BTree *bt, int key, int *record);
+static void record_replace(BTree *bt, int key, int record);
+
+// Depth of the node the operation of this thread is working on, 0 for the root;
+// every trace event gets the depth of the node its page belongs to
+static _Thread_local int op_depth;
+
+// Operations of this thread running, only the outermost one is timed and traced
+static _Thread_local int op_nesting;
+
+/**
+ * @brief Start timing and tracing an operation of the tree
+ *
+ * @param BTree* bt
+ * @param int op one of BTREE_OP_*
+ * @param int key
+ * @return uint64_t time the operation started, 0 if it isn't measured
+ */
+static uint64_t op_begin(BTree *bt, int op, int key)
+{
+    if ((!bt->latency[op] && !bt->trace) || op_nesting++)
+        return 0;
+
+    op_depth = 0;
+    if (bt->trace)
+        trace_begin(bt->trace, op, key);
+
+    return trace_now();
+}
+
+/**
+ * @brief End an operation started by op_begin
+ *
+ * @param BTree* bt
+ * @param int op
+ * @param uint64_t start the time given by op_begin
+ */
+static void op_end(BTree *bt, int op, uint64_t start)
+{
+    if ((!bt->latency[op] && !bt->trace) || --op_nesting)
+        return;
+
+    if (bt->latency[op])
+        histogram_record(bt->latency[op], trace_now() - start);
+    if (bt->trace)
+        trace_end(bt->trace);
+}
+
+/**
+ * @brief Mark a step of the operation in the trace, if there is one
+ *
+ * @param BTree* bt
+ * @param int kind one of TRACE_*
+ * @param int pos position of the page
+ * @param int depth
+ */
+static void op_event(BTree *bt, int kind, int pos, int depth)
+{
+    if (bt->trace)
+        trace_event(bt->trace, kind, pos, depth);
+}
+
+// Tags of the pages stored by the codec of the compressed mode
+#define PAGE_RAW 0
+#define PAGE_PACKED 1
+
+/**
+ * @brief Round a size up to a multiple of the cache line
+ *
+ * @param size_t size
+ * @return size_t
+ */
+static size_t cache_line_round(size_t size)
+{
+    return (size + BTREE_CACHE_LINE - 1) / BTREE_CACHE_LINE * BTREE_CACHE_LINE;
+}
+
+/**
+ * @brief Check if the nodes of the tree keep their keys in Eytzinger order too
+ *
+ * @param BTree* bt
+ * @return true
+ * @return false
+ */
+static bool uses_eytzinger(BTree *bt)
+{
+    return (bt->flags & BTREE_EYTZINGER) && bt->inner_order >= BTREE_EYTZINGER_MIN_ORDER;
+}
+
+/**
+ * @brief Allocate the block of a node, from the arena of the tree if it has one
+ *
+ * @param BTree* bt
+ * @return Node* only its arena is set
+ */
+static Node *node_block(BTree *bt)
+{
+    Node *n = (Node *)(bt->arena ? arena_take(bt->arena) : aligned_alloc(BTREE_CACHE_LINE, bt->block));
+
+    n->arena = bt->arena;
+
+    return n;
+}
+
 /**
  * @brief Create a node and allocate memory for it
  *
+ * The node and its vectors live in a single block aligned to the cache line:
+ * the header, then the keys followed by the children, so a search touches
+ * contiguous memory, and the records at the end
+ *
  * @param BTree* bt
  * @param bool is_leaf
  * @param int pos
@@ -32,30 +201,82 @@ struct BTree
  */
 Node *node_create(BTree *bt, bool is_leaf, int pos)
 {
-    Node *node = (Node *)malloc(sizeof(Node));
+    char *block = (char *)node_block(bt);
+    Node *node = (Node *)block;
 
     // Set initial params
     node->n_keys = 0;
     node->is_leaf = is_leaf;
     node->b_position = pos;
+    node->next = -1;
 
-    // Allocate memory to the vectors of keys, records and children
-    node->keys = (int *)calloc((bt->order - 1), sizeof(int));
-    node->records = (int *)calloc((bt->order - 1), sizeof(int));
-    node->children = (int *)calloc(bt->order, sizeof(int));
+    // Set the vectors of keys, children and records inside the block
+    node->keys = (int *)(block + cache_line_round(sizeof(Node)));
+    node->children = node->keys + (bt->inner_order - 1);
+    node->records = node->children + bt->inner_order;
+    node->eytz = NULL;
+    node->eytz_rank = NULL;
 
     // Initialize them with -1
-    for (int i = 0; i < bt->order - 1; i++)
+    for (int i = 0; i < bt->inner_order - 1; i++)
     {
         node->keys[i] = -1;
-        node->records[i] = -1;
         node->children[i] = -1;
     }
-    node->children[bt->order - 1] = -1;
+    for (int i = 0; i < bt->order - 1; i++)
+    {
+        node->records[i] = -1;
+    }
+    node->children[bt->inner_order - 1] = -1;
 
     return node;
 }
 
+/**
+ * @brief Rebuild the Eytzinger copy of the keys of a node
+ *
+ * eytz[k], k >= 1, is the key at the k-th node of an implicit binary tree (the
+ * children of k are 2k and 2k + 1) and eytz_rank[k] is its index in the
+ * sorted keys. The first levels of a search then share the same cache lines
+ *
+ * @param BTree* bt
+ * @param Node* n
+ */
+static void node_build_eytzinger(BTree *bt, Node *n)
+{
+    if (!uses_eytzinger(bt))
+        return;
+
+    n->eytz = n->records + (bt->order - 1);
+    n->eytz_rank = n->eytz + bt->inner_order;
+    int *rank = n->eytz_rank;
+
+    // In-order walk of the implicit tree gives the keys back in sorted order
+    int k = 1;
+    while (2 * k <= n->n_keys)
+        k *= 2;
+
+    for (int i = 0; i < n->n_keys; i++)
+    {
+        n->eytz[k] = n->keys[i];
+        rank[k] = i;
+
+        // Go to the next node in order: leftmost of the right subtree, or up to the first left turn
+        if (2 * k + 1 <= n->n_keys)
+        {
+            k = 2 * k + 1;
+            while (2 * k <= n->n_keys)
+                k *= 2;
+        }
+        else
+        {
+            while (k & 1)
+                k >>= 1;
+            k >>= 1;
+        }
+    }
+}
+
 /**
  * @brief Get the size of the node
  *
@@ -64,885 +285,5827 @@ Node *node_create(BTree *bt, bool is_leaf, int pos)
  */
 size_t node_size(BTree *bt)
 {
-    return sizeof(int) + sizeof(bool) + sizeof(int) + sizeof(int) * (bt->order - 1) + sizeof(int) * (bt->order - 1) + sizeof(int) * bt->order;
+    size_t size = sizeof(int) + sizeof(bool) + sizeof(int) + sizeof(int) * (bt->order - 1) + sizeof(int) * (bt->order - 1) + sizeof(int) * bt->order;
+
+    // B+-tree pages also keep the link to the right sibling
+    if (bt->flags & BTREE_PLUS)
+        size += sizeof(int);
+
+    return size;
 }
 
 /**
- * @brief Destroy a node, freeing the memory allocated for it
+ * @brief Get the largest order whose nodes fit in a page
  *
- * @param n
+ * @param size_t page_size
+ * @param int flags
+ * @return int
  */
-void node_destroy(Node *n)
+int btree_tuned_order(size_t page_size, int flags)
 {
-    if (n)
+    BTree probe;
+    probe.flags = flags;
+    probe.order = 3;
+
+    while (true)
     {
-        free(n->keys);
-        free(n->records);
-        free(n->children);
-        free(n);
+        probe.order++;
+        if (node_size(&probe) > page_size)
+            return probe.order - 1;
     }
 }
 
 /**
- * @brief Function to write the params of a node to the binary file
+ * @brief Get the max amount of keys a node can hold
  *
- * @param BTree* btree
+ * @param BTree* bt
  * @param Node* n
+ * @return int
  */
-void disk_write(BTree *bt, Node *n)
+int node_max_keys(BTree *bt, Node *n)
+{
+    return n->is_leaf ? bt->order - 1 : bt->inner_order - 1;
+}
+
+/**
+ * @brief Destroy a node, freeing the memory allocated for it
+ *
+ * @param n
+ */
+void node_destroy(Node *n)
 {
-    // Get the position of the node by calculating its position in the tree and its size
-    fseek(bt->bfile, n->b_position * node_size(bt), SEEK_SET);
+    // The vectors are in the same block of the node
+    if (n->arena)
+        arena_give(n->arena, n);
+    else
+        free(n);
+}
 
-    // Write simple params to the binary file
-    fwrite(&n->n_keys, sizeof(int), 1, bt->bfile);
-    fwrite(&n->is_leaf, sizeof(bool), 1, bt->bfile);
-    fwrite(&n->b_position, sizeof(int), 1, bt->bfile);
+/**
+ * @brief Copy a node to another block, pointing its vectors to the new block
+ *
+ * @param BTree* bt
+ * @param Node* dst
+ * @param Node* src
+ */
+static void node_copy(BTree *bt, Node *dst, Node *src)
+{
+    Arena *arena = dst->arena;
 
-    // Write the vectors of keys, records and children to the file
-    fwrite(n->keys, sizeof(int), bt->order - 1, bt->bfile);
-    fwrite(n->records, sizeof(int), bt->order - 1, bt->bfile);
-    fwrite(n->children, sizeof(int), bt->order, bt->bfile);
+    memcpy(dst, src, bt->block);
+    dst->arena = arena;
 
-    fflush(bt->bfile);
+    dst->keys = (int *)((char *)dst + ((char *)src->keys - (char *)src));
+    dst->children = (int *)((char *)dst + ((char *)src->children - (char *)src));
+    dst->records = (int *)((char *)dst + ((char *)src->records - (char *)src));
+    if (src->eytz)
+    {
+        dst->eytz = (int *)((char *)dst + ((char *)src->eytz - (char *)src));
+        dst->eytz_rank = (int *)((char *)dst + ((char *)src->eytz_rank - (char *)src));
+    }
 }
 
 /**
- * @brief Read a node from binary file
+ * @brief Get the pinned copy of a node, if there is one
  *
- * @param BTree* btree
+ * @param BTree* bt
  * @param int pos
  * @return Node*
  */
-Node *disk_read(BTree *bt, int pos)
+static Node *pinned_node(BTree *bt, int pos)
 {
-    Node *n = (Node *)malloc(sizeof(Node));
-
-    // Get the position of the node by calculating its position in the tree and its size
-    fseek(bt->bfile, pos * node_size(bt), SEEK_SET);
-
-    // Read simple params from binary file
-    fread(&n->n_keys, sizeof(int), 1, bt->bfile);
-    fread(&n->is_leaf, sizeof(bool), 1, bt->bfile);
-    fread(&n->b_position, sizeof(int), 1, bt->bfile);
+    if (pos < 0 || pos >= bt->pinned_cap)
+        return NULL;
 
-    // Allocate memory to key, records and children's vectors
-    n->keys = (int *)malloc((bt->order - 1) * sizeof(int));
-    n->records = (int *)malloc((bt->order - 1) * sizeof(int));
-    n->children = (int *)malloc(bt->order * sizeof(int));
-
-    // Read the vectors of keys, records and children from the file
-    fread(n->keys, sizeof(int), bt->order - 1, bt->bfile);
-    fread(n->records, sizeof(int), bt->order - 1, bt->bfile);
-    fread(n->children, sizeof(int), bt->order, bt->bfile);
-
-    return n;
+    return bt->pinned[pos];
 }
 
 /**
- * @brief Create a B-Tree and allocate memory to it
+ * @brief Keep in memory the last version of an internal node
  *
- * @param char* path
- * @param int order
- * @return BTree*
+ * @param BTree* bt
+ * @param Node* n
  */
-BTree *btree_create(char *path, int order)
+static void pin_node(BTree *bt, Node *n)
 {
-    BTree *bt = (BTree *)malloc(sizeof(BTree));
+    Node *pinned = pinned_node(bt, n->b_position);
+    if (!pinned)
+    {
+        int cap = bt->pinned_cap ? bt->pinned_cap : 64;
+        while (cap <= n->b_position)
+            cap *= 2;
 
-    // Set initial params
-    bt->order = order;
-    bt->root = NULL;
-    bt->node_amount = 0;
+        // Under a memory limit, the nodes past the share of the pinned ones are read from their pages
+        size_t bytes = (size_t)(bt->pinned_amount + 1) * bt->block + (size_t)cap * sizeof(Node *);
+        if (bt->memory_limit && bytes > resident_budget(bt))
+            return;
 
-    // Create binary file to tree
-    FILE *fp = fopen("btree.bin", "w+b");
-    if (!fp)
-    {
-        perror("The system couldn't create the binary file.\n");
-        exit(1);
+        if (cap > bt->pinned_cap)
+        {
+            bt->pinned = (Node **)realloc(bt->pinned, cap * sizeof(Node *));
+            for (int i = bt->pinned_cap; i < cap; i++)
+                bt->pinned[i] = NULL;
+            bt->pinned_cap = cap;
+        }
+
+        pinned = bt->pinned[n->b_position] = node_block(bt);
+        bt->pinned_amount++;
     }
 
-    bt->bfile = fp;
+    node_copy(bt, pinned, n);
+}
 
-    return bt;
+/**
+ * @brief Get a node only to read it: pinned nodes are shared instead of copied
+ *
+ * Must be given back with node_release
+ *
+ * @param BTree* bt
+ * @param int pos
+ * @return Node*
+ */
+static Node *node_fetch(BTree *bt, int pos)
+{
+    Node *n = pinned_node(bt, pos);
+    return n ? n : disk_read(bt, pos);
 }
 
 /**
- * @brief Destroy a B-Tree and free memory allocated to it
+ * @brief Give back a node got from node_fetch
  *
  * @param BTree* bt
+ * @param Node* n
  */
-void btree_destroy(BTree *bt)
+static void node_release(BTree *bt, Node *n)
 {
-    // Close binary file
-    fclose(bt->bfile);
-    free(bt);
+    if (n != bt->root && n != pinned_node(bt, n->b_position))
+        node_destroy(n);
 }
 
 /**
- * @brief Returns a pointer to root's node
+ * @brief Read a node as it was when a snapshot was taken
+ *
+ * Goes straight to the view of the pager, never to the pinned nodes or the cache
+ *
+ * @param BTreeSnapshot* s
+ * @param int pos
+ * @return Node*
+ */
+static Node *snapshot_read(BTreeSnapshot *s, int pos)
+{
+    op_event(s->bt, TRACE_PAGE_READ, pos, op_depth);
+    pager_view_read(s->view, pos, s->page, &s->codec);
+    return node_decode(s->bt, s->page, pos);
+}
+
+/**
+ * @brief Get a node to read it from the current tree or, if given, from a snapshot
  *
  * @param BTree* bt
+ * @param BTreeSnapshot* s NULL reads the current tree
+ * @param int pos
  * @return Node*
  */
-Node *btree_get_root(BTree *bt)
+static Node *source_fetch(BTree *bt, BTreeSnapshot *s, int pos)
 {
-    return bt->root;
+    return s ? snapshot_read(s, pos) : node_fetch(bt, pos);
 }
 
 /**
- * @brief Insert a value to the tree
+ * @brief Give back a node got from source_fetch
  *
  * @param BTree* bt
- * @param int key
- * @param int record
+ * @param BTreeSnapshot* s
+ * @param Node* n
+ */
+static void source_release(BTree *bt, BTreeSnapshot *s, Node *n)
+{
+    if (s)
+        node_destroy(n);
+    else
+        node_release(bt, n);
+}
+
+/**
+ * @brief Start bringing a node close before it is read
+ *
+ * @param BTree* bt
+ * @param int pos
  */
-void btree_insert(BTree *bt, int key, int record)
+static void node_prefetch(BTree *bt, int pos)
 {
-    // Check if the key already exists in the tree
-    if (btree_search(bt, key))
+    Node *n = pinned_node(bt, pos);
+    if (n)
     {
+        __builtin_prefetch(n);
+        __builtin_prefetch(n->keys);
         return;
     }
 
-    // If the tree is empty, create a new root node
-    if (!bt->root)
-    {
-        bt->root = node_create(bt, true, bt->node_amount++);
-        bt->root->keys[0] = key;
-        bt->root->records[0] = record;
-        bt->root->n_keys = 1;
-        disk_write(bt, bt->root);
-    }
+    pager_prefetch(bt->pager, pos);
+}
+
+/**
+ * @brief Start bringing a node close before it is read from the current tree or a snapshot
+ *
+ * @param BTree* bt
+ * @param BTreeSnapshot* s NULL reads the current tree
+ * @param int pos
+ */
+static void source_prefetch(BTree *bt, BTreeSnapshot *s, int pos)
+{
+    if (s)
+        pager_view_prefetch(s->view, pos);
     else
-    {
-        // If the root is full, split it and grow the tree height
-        if (bt->root->n_keys == bt->order - 1)
-        {
-            // Create the new node and define its params
-            Node *new_root = node_create(bt, false, bt->node_amount++);
-            new_root->children[0] = bt->root->b_position;
+        node_prefetch(bt, pos);
+}
 
-            node_destroy(bt->root);
-            bt->root = new_root;
-            Node *y = disk_read(bt, bt->root->children[0]);
+/**
+ * @brief Copy a field to the page, moving the offset forward
+ *
+ * @param char* page
+ * @param size_t* off
+ * @param const void* src
+ * @param size_t size
+ */
+static void page_put(char *page, size_t *off, const void *src, size_t size)
+{
+    memcpy(page + *off, src, size);
+    *off += size;
+}
 
-            // Split child and insert to the tree (preemptive insertion)
-            split_child(bt, bt->root, y, 0);
-            insert_non_full(bt, bt->root, key, record);
-        }
-        else
-        {
-            // If node isn't full, insert into it
-            insert_non_full(bt, bt->root, key, record);
-        }
-    }
+/**
+ * @brief Copy a field from the page, moving the offset forward
+ *
+ * @param const char* page
+ * @param size_t* off
+ * @param void* dst
+ * @param size_t size
+ */
+static void page_get(const char *page, size_t *off, void *dst, size_t size)
+{
+    memcpy(dst, page + *off, size);
+    *off += size;
 }
 
 /**
- * @brief Function to split a node
+ * @brief Build a node from the image of its page
  *
- * @param Btree* bt
- * @param Node* x
- * @param Node* y
- * @param i
+ * @param BTree* bt
+ * @param const char* page
+ * @param int pos
+ * @return Node*
  */
-void split_child(BTree *bt, Node *x, Node *y, int i)
+static Node *node_decode(BTree *bt, const char *page, int pos)
 {
-    Node *z = node_create(bt, y->is_leaf, bt->node_amount++);
+    size_t off = 0;
+    int n_keys;
+    bool is_leaf;
 
-    // Get the minimum order of the tree
-    int t = (bt->order - 1) / 2;
+    // Read simple params from the page
+    page_get(page, &off, &n_keys, sizeof(int));
+    page_get(page, &off, &is_leaf, sizeof(bool));
 
-    // Copy the second half of y's keys and records to z
-    z->n_keys = (bt->order - 1) - t - 1;
-    for (int j = 0; j < z->n_keys; j++)
-    {
-        z->keys[j] = y->keys[j + t + 1];
-        z->records[j] = y->records[j + t + 1];
-    }
+    Node *n = node_create(bt, is_leaf, pos);
+    n->n_keys = n_keys;
+    page_get(page, &off, &n->b_position, sizeof(int));
 
-    // If y is not a leaf, copy its children to z
-    if (!y->is_leaf)
+    if (bt->flags & BTREE_PLUS)
     {
-        for (int j = 0; j <= z->n_keys; j++)
-            z->children[j] = y->children[j + t + 1];
-    }
-
-    y->n_keys = t;
-
-    // Shift x's children to make space for z
-    for (int j = x->n_keys; j > i; j--)
-    {
-        x->children[j + 1] = x->children[j];
+        page_get(page, &off, &n->next, sizeof(int));
+        if (n->is_leaf)
+        {
+            page_get(page, &off, n->keys, sizeof(int) * (bt->order - 1));
+            page_get(page, &off, n->records, sizeof(int) * (bt->order - 1));
+        }
+        else
+        {
+            page_get(page, &off, n->keys, sizeof(int) * (bt->inner_order - 1));
+            page_get(page, &off, n->children, sizeof(int) * bt->inner_order);
+        }
     }
-
-    x->children[i + 1] = z->b_position;
-
-    // Shift x's keys and records to make space in y
-    for (int j = x->n_keys - 1; j >= i; j--)
+    else
     {
-        x->keys[j + 1] = x->keys[j];
-        x->records[j + 1] = x->records[j];
+        // Read the vectors of keys, records and children from the page
+        page_get(page, &off, n->keys, sizeof(int) * (bt->order - 1));
+        page_get(page, &off, n->records, sizeof(int) * (bt->order - 1));
+        page_get(page, &off, n->children, sizeof(int) * bt->order);
     }
 
-    // Move the median key from y to x
-    x->keys[i] = y->keys[t];
-    x->records[i] = y->records[t];
-    x->n_keys++;
-
-    // Write nodes in the binary file
-    disk_write(bt, x);
-    disk_write(bt, y);
-    disk_write(bt, z);
+    node_build_eytzinger(bt, n);
 
-    node_destroy(y);
-    node_destroy(z);
+    return n;
 }
 
 /**
- * @brief Insert a key in the tree if node isn't full
+ * @brief Function to write the params of a node to the binary file
  *
- * @param BTree* bt
- * @param Node* node
- * @param int key
- * @param int record
+ * @param BTree* btree
+ * @param Node* n
  */
-void insert_non_full(BTree *bt, Node *node, int key, int record)
+void disk_write(BTree *bt, Node *n)
 {
-    int i = node->n_keys - 1;
+    size_t off = 0;
+    memset(bt->page, 0, bt->stride);
 
-    // If the node is a leaf, insert the key directly
-    if (node->is_leaf)
+    // Write simple params to the page
+    page_put(bt->page, &off, &n->n_keys, sizeof(int));
+    page_put(bt->page, &off, &n->is_leaf, sizeof(bool));
+    page_put(bt->page, &off, &n->b_position, sizeof(int));
+
+    if (bt->flags & BTREE_PLUS)
     {
-        // Shift keys and records to make space for the new key
-        while (i >= 0 && key < node->keys[i])
+        // B+-tree leaves don't have children and internal nodes don't have records
+        page_put(bt->page, &off, &n->next, sizeof(int));
+        if (n->is_leaf)
         {
-            node->keys[i + 1] = node->keys[i];
-            node->records[i + 1] = node->records[i];
-            i--;
+            page_put(bt->page, &off, n->keys, sizeof(int) * (bt->order - 1));
+            page_put(bt->page, &off, n->records, sizeof(int) * (bt->order - 1));
+        }
+        else
+        {
+            page_put(bt->page, &off, n->keys, sizeof(int) * (bt->inner_order - 1));
+            page_put(bt->page, &off, n->children, sizeof(int) * bt->inner_order);
         }
-
-        // Insert the key and record
-        node->keys[i + 1] = key;
-        node->records[i + 1] = record;
-        node->n_keys++;
-        disk_write(bt, node);
     }
     else
     {
-        // Find the appropriate child for insertion
-        while (i >= 0 && key < node->keys[i])
-        {
-            i--;
-        }
-        i++;
-        Node *child = disk_read(bt, node->children[i]);
+        // Write the vectors of keys, records and children to the page
+        page_put(bt->page, &off, n->keys, sizeof(int) * (bt->order - 1));
+        page_put(bt->page, &off, n->records, sizeof(int) * (bt->order - 1));
+        page_put(bt->page, &off, n->children, sizeof(int) * bt->order);
+    }
 
-        // If the child is full, split it
-        if (child->n_keys == bt->order - 1)
-        {
-            Node *y = disk_read(bt, node->children[i]);
-            split_child(bt, node, y, i);
-            if (key > node->keys[i])
-            {
-                i++;
-            }
+    // Write the page in the position of the node
+    op_event(bt, TRACE_PAGE_WRITE, n->b_position, op_depth);
+    pager_write(bt->pager, n->b_position, bt->page);
 
-            node_destroy(child);
-            child = disk_read(bt, node->children[i]);
-        }
+    // Nodes are always written after they change, so their search copy is refreshed here
+    node_build_eytzinger(bt, n);
 
-        // Recursively insert the key into the child
-        insert_non_full(bt, child, key, record);
+    // Internal nodes stay in memory, their reads will never go to the disk
+    if ((bt->flags & BTREE_PIN_INTERNAL) && !n->is_leaf)
+        pin_node(bt, n);
+}
 
-        // Free the memory of the child
-        node_destroy(child);
+/**
+ * @brief Read a node from binary file
+ *
+ * @param BTree* btree
+ * @param int pos
+ * @return Node*
+ */
+Node *disk_read(BTree *bt, int pos)
+{
+    // Pinned internal nodes are copied from memory
+    Node *pinned = pinned_node(bt, pos);
+    if (pinned)
+    {
+        Node *n = node_block(bt);
+        node_copy(bt, n, pinned);
+        return n;
     }
+
+    // Read the page in the position of the node
+    op_event(bt, TRACE_PAGE_READ, pos, op_depth);
+    pager_read(bt->pager, pos, bt->page);
+
+    return node_decode(bt, bt->page, pos);
 }
 
 /**
- * @brief Search a node in B-Tree
+ * @brief Read a child of the node the operation is working on
+ *
+ * The page is traced one level below the node, as the reads of the child
+ * made once the operation moves down to it
  *
  * @param BTree* bt
- * @param int key
- * @return true
- * @return false
+ * @param int pos
+ * @return Node*
  */
-bool btree_search(BTree *bt, int key)
+static Node *child_read(BTree *bt, int pos)
 {
-    if (bt->root == NULL)
-    {
-        return false;
-    }
-    return search_node(bt, bt->root, key);
+    op_depth++;
+    Node *n = disk_read(bt, pos);
+    op_depth--;
+
+    return n;
 }
 
 /**
- * @brief Search a node by searching a key
+ * @brief Write a child of the node the operation is working on
  *
  * @param BTree* bt
  * @param Node* n
- * @param int key
- * @return true
- * @return false
  */
-bool search_node(BTree *bt, Node *n, int key)
+static void child_write(BTree *bt, Node *n)
 {
-    int i = 0;
-    // Find the position of the key in the node
-    while (i < n->n_keys && key > n->keys[i])
-    {
-        i++;
-    }
+    op_depth++;
+    disk_write(bt, n);
+    op_depth--;
+}
 
-    // If the key is found in the node, return true
-    if (i < n->n_keys && key == n->keys[i])
-    {
-        return true;
-    }
+/**
+ * @brief Get the size of the header of the pages
+ *
+ * @param BTree* bt
+ * @return size_t
+ */
+static size_t page_header_size(BTree *bt)
+{
+    size_t size = sizeof(int) + sizeof(bool) + sizeof(int);
 
-    // If the node is a leaf and the key is not found, return false
-    if (n->is_leaf)
+    if (bt->flags & BTREE_PLUS)
+        size += sizeof(int);
+
+    return size;
+}
+
+/**
+ * @brief Encoder of the compressed mode, used by the pager before a page goes to the file
+ *
+ * Leaves keep only their used slots: keys are delta encoded and bit-packed,
+ * records are bit-packed over their minimum. Internal pages are kept raw
+ *
+ * @param const void* page
+ * @param void* out
+ * @param void* ctx the NodeCodec
+ * @return size_t
+ */
+static size_t node_page_encode(const void *page, void *out, void *ctx)
+{
+    NodeCodec *codec = (NodeCodec *)ctx;
+    BTree *bt = codec->bt;
+    const char *in = (const char *)page;
+    unsigned char *o = (unsigned char *)out;
+    size_t header = page_header_size(bt);
+    int n_keys;
+    bool is_leaf;
+
+    memcpy(&n_keys, in, sizeof(int));
+    memcpy(&is_leaf, in + sizeof(int), sizeof(bool));
+
+    if (!is_leaf)
     {
-        return false;
+        o[0] = PAGE_RAW;
+        memcpy(o + 1, in, bt->stride);
+        return bt->stride + 1;
     }
 
-    // Recursively search in the appropriate child node
-    Node *child = disk_read(bt, n->children[i]);
-    bool res = search_node(bt, child, key);
+    // The header goes as it is
+    o[0] = PAGE_PACKED;
+    memcpy(o + 1, in, header);
+    size_t size = 1 + header;
 
-    // Free the memory of the child node
-    node_destroy(child);
+    // Pack the used slots of the keys and records
+    int *keys = codec->scratch;
+    int *records = codec->scratch + (bt->order - 1);
+    memcpy(keys, in + header, sizeof(int) * n_keys);
+    memcpy(records, in + header + sizeof(int) * (bt->order - 1), sizeof(int) * n_keys);
 
-    return res;
+    size += delta_pack(keys, n_keys, o + size);
+    size += for_pack(records, n_keys, o + size);
+
+    return size;
 }
 
 /**
- * @brief Delete a key and the value associated to the key from B-Tree
+ * @brief Decoder of the compressed mode, used by the pager when a page comes from the file
  *
- * @param Btree* bt
- * @param int key
+ * @param const void* in
+ * @param size_t len
+ * @param void* page
+ * @param void* ctx the NodeCodec
  */
-void btree_delete(BTree *bt, int key)
+static void node_page_decode(const void *in, size_t len, void *page, void *ctx)
 {
-    if (bt->root == NULL)
+    NodeCodec *codec = (NodeCodec *)ctx;
+    BTree *bt = codec->bt;
+    const unsigned char *i = (const unsigned char *)in;
+    char *out = (char *)page;
+    size_t header = page_header_size(bt);
+    int n_keys;
+
+    if (i[0] == PAGE_RAW)
     {
+        memcpy(out, i + 1, len - 1);
         return;
     }
 
-    // Remove a key, recursively, from node
-    remove_from_node(bt, bt->root, key);
+    memset(out, 0, bt->stride);
+    memcpy(out, i + 1, header);
+    memcpy(&n_keys, out, sizeof(int));
 
-    // Update root if root is empty
-    if (bt->root->n_keys == 0)
+    // Unused slots are back to -1, as in a node just created
+    int *keys = codec->scratch;
+    int *records = codec->scratch + (bt->order - 1);
+    for (int j = 0; j < bt->order - 1; j++)
     {
-        if (bt->root->is_leaf)
-        {
-            // If root is a leaf, let them null
-            node_destroy(bt->root);
-            bt->root = NULL;
-        }
-        else
-        {
-            // If root isn't a leaf, turn the first child in root
-            int child_pos = bt->root->children[0];
-            node_destroy(bt->root);
-            bt->root = disk_read(bt, child_pos);
-        }
+        keys[j] = -1;
+        records[j] = -1;
     }
-}
 
-/**
- * @brief Auxiliary function to find a key's index in the node
- *
- * @param Node* node
- * @param int key
- * @return int
- */
-int find_key_index(Node *node, int key)
-{
-    int i = 0;
+    size_t off = 1 + header;
+    off += delta_unpack(i + off, n_keys, keys);
+    for_unpack(i + off, n_keys, records);
 
-    while (i < node->n_keys && node->keys[i] < key)
+    memcpy(out + header, keys, sizeof(int) * (bt->order - 1));
+    memcpy(out + header + sizeof(int) * (bt->order - 1), records, sizeof(int) * (bt->order - 1));
+
+    // Leaves of the classic mode also have their children, all of them -1
+    if (!(bt->flags & BTREE_PLUS))
     {
-        ++i;
+        int none = -1;
+        for (int j = 0; j < bt->order; j++)
+            memcpy(out + header + sizeof(int) * (2 * (bt->order - 1) + j), &none, sizeof(int));
     }
-
-    return i;
 }
 
 /**
- * @brief Recursive function to delete a key from the tree
+ * @brief Lay out the nodes of a tree and open the file of its pages
  *
- * @param BTree* bt
- * @param Node* n
- * @param key
+ * @param BTree* bt a tree with its flags and path set
+ * @param char* file
+ * @param int order 0 picks the largest order that fits "page_size"
+ * @param size_t page_size
  */
-void remove_from_node(BTree *bt, Node *n, int key)
+static void tree_open(BTree *bt, char *file, int order, size_t page_size)
 {
-    // Find the index of a key in the node
-    int i = find_key_index(n, key);
+    int flags = bt->flags;
 
-    // Verify if the key is present in the node
-    if (i < n->n_keys && n->keys[i] == key)
+    // Set initial params
+    bt->order = order;
+    bt->root = NULL;
+    bt->pinned = NULL;
+    bt->pinned_cap = 0;
+    bt->pinned_amount = 0;
+    bt->filter = NULL;
+
+    // Without an order, pick the one that fills a page
+    bt->stride = 0;
+    if (order <= 0)
     {
-        if (n->is_leaf)
-        {
-            // Case 1: the node is a leaf and has the minimum amount of keys
-            remove_from_leaf(bt, n, i);
-        }
-        else
-        {
-            // Case 2: the node isn't a leaf
-            remove_from_non_leaf(bt, n, i);
-        }
+        bt->order = btree_tuned_order(page_size, flags);
+        bt->stride = page_size;
     }
-    else
-    {
-        if (n->is_leaf)
-        {
-            node_destroy(n);
-            return;
-        }
 
-        // Flag to verify if last node was found
-        bool is_last_child = (i == n->n_keys);
+    // Internal nodes of a B+-tree use the space of the records for more children
+    bt->inner_order = bt->order;
+    if (flags & BTREE_PLUS)
+        bt->inner_order = (3 * bt->order - 1) / 2;
 
-        // Read ci children from binary file
-        Node *child = disk_read(bt, n->children[i]);
+    // Pages take whole cache lines in the file, even when the page asked is too small
+    if (bt->stride < node_size(bt))
+        bt->stride = cache_line_round(node_size(bt));
 
-        // Verify if child node has the minimum amount of keys
-        int min_keys = (bt->order - 1) / 2;
-        if (child->n_keys <= min_keys)
-        {
-            // Fill the node
-            fill_node(bt, n, i);
+    // Transfers with O_DIRECT take whole aligned blocks
+    if (flags & BTREE_DIRECT)
+        bt->stride = (bt->stride + PAGER_DIRECT_ALIGN - 1) / PAGER_DIRECT_ALIGN * PAGER_DIRECT_ALIGN;
 
-            node_destroy(child);
+    // Memory block of a node: header, keys, children, records and the Eytzinger copy
+    bt->block = cache_line_round(sizeof(Node));
+    bt->block += sizeof(int) * ((bt->inner_order - 1) + bt->inner_order + (bt->order - 1));
+    if (uses_eytzinger(bt))
+        bt->block += sizeof(int) * 2 * bt->inner_order;
+    bt->block = cache_line_round(bt->block);
 
-            // If was the last child and a merge occured, an update is made
-            if (is_last_child && i > n->n_keys)
-            {
-                child = disk_read(bt, n->children[i - 1]);
-            }
-            else
-            {
-                child = disk_read(bt, n->children[i]);
-            }
-        }
+    // Create binary file to tree
+    bt->pager = pager_open(file, bt->stride);
+    if (flags & BTREE_DIRECT)
+        pager_enable_direct(bt->pager);
 
-        // Remove recursively the key from child
-        remove_from_node(bt, child, key);
+    // Nodes and the cache live in huge pages on the NUMA node of the tree
+    bt->arena = NULL;
+    if (flags & BTREE_HUGE_PAGES)
+    {
+        bt->arena = arena_create(bt->block, bt->numa_node);
+        pager_enable_huge_pages(bt->pager, bt->numa_node);
+    }
+    bt->page = (char *)malloc(bt->stride);
+    bt->codec.bt = bt;
+    bt->codec.scratch = NULL;
+    pager_set_cache(bt->pager, BTREE_CACHE_PAGES);
+    pager_set_flush_interval(bt->pager, BTREE_FLUSH_INTERVAL_MS);
+
+    // Compressed leaves go through the codec of the pager, the cache keeps them decompressed
+    if (flags & BTREE_COMPRESS)
+    {
+        bt->codec.scratch = (int *)malloc(2 * (bt->order - 1) * sizeof(int));
+        pager_set_codec(bt->pager, node_page_encode, node_page_decode, &bt->codec);
     }
+
+    // Pages seen by snapshots are never overwritten
+    if (flags & BTREE_COW)
+        pager_enable_cow(bt->pager);
+
+    // Absent keys are found by the filter, without reading the tree
+    if (flags & BTREE_BLOOM)
+        bt->filter = filter_create(filter_fit(bt, BTREE_BLOOM_KEYS));
 }
 
 /**
- * @brief Remove a key if the node is a leaf
+ * @brief Get the bytes the filter or the pinned nodes may each take under the memory limit
+ *
+ * The share of the structures kept whole in memory is split evenly between
+ * the filter and the pinned internal nodes, if the tree has both
  *
  * @param BTree* bt
- * @param Node* n
- * @param int index
+ * @return size_t
  */
-void remove_from_leaf(BTree *bt, Node *n, int index)
+static size_t resident_budget(BTree *bt)
 {
-    // Shift all keys and records to the right of the key to be removed
-    for (int i = index + 1; i < n->n_keys; ++i)
-    {
-        n->keys[i - 1] = n->keys[i];
-        n->records[i - 1] = n->records[i];
-    }
-
-    n->n_keys--;
+    int parts = ((bt->flags & BTREE_BLOOM) != 0) + ((bt->flags & BTREE_PIN_INTERNAL) != 0);
 
-    // Write the node, updating it in the file
-    disk_write(bt, n);
+    return parts ? bt->memory_limit / BTREE_MEMORY_RESIDENT_SHARE / parts : 0;
 }
 
 /**
- * @brief Remove a key if the node is a leaf
+ * @brief Get the bytes of the memory limit left to the caches and the buffers
  *
- * @param bt
- * @param n
- * @param index
+ * @param BTree* bt
+ * @return size_t
  */
-void remove_from_non_leaf(BTree *bt, Node *n, int index)
+static size_t shared_limit(BTree *bt)
 {
-    int key = n->keys[index];
+    if (!(bt->flags & (BTREE_BLOOM | BTREE_PIN_INTERNAL)))
+        return bt->memory_limit;
 
-    // Case 2a: if node doesn't have the minimum of keys, find the predecessor of the key in the node y
-    Node *child_left = disk_read(bt, n->children[index]);
+    return bt->memory_limit - bt->memory_limit / BTREE_MEMORY_RESIDENT_SHARE;
+}
 
-    int min_keys = (bt->order - 1) / 2;
-    if (child_left->n_keys > min_keys)
+/**
+ * @brief Get the capacity of a filter for an amount of keys, bounded by the memory limit
+ *
+ * Past its capacity the filter stays correct, it only answers "maybe" more often
+ *
+ * @param BTree* bt
+ * @param long capacity
+ * @return long
+ */
+static long filter_fit(BTree *bt, long capacity)
+{
+    if (bt->memory_limit)
     {
-        int pred_record = get_predecessor(bt, n, index);
-        n->records[index] = pred_record;
+        long most = filter_capacity_within(resident_budget(bt));
+        if (capacity > most)
+            capacity = most;
+    }
 
-        disk_write(bt, n);
+    return capacity;
+}
+
+/**
+ * @brief Get the bytes each cache may take under the memory limit
+ *
+ * The share of the caches is split evenly between the cache of the tree and
+ * the caches of the index of the records and of the lists, if there are any
+ *
+ * @param BTree* bt
+ * @return size_t
+ */
+static size_t cache_budget(BTree *bt)
+{
+    int caches = 1 + (bt->index != NULL) + (bt->postings != NULL);
+
+    return shared_limit(bt) / BTREE_MEMORY_CACHE_SHARE / caches;
+}
+
+/**
+ * @brief Size the caches of the index of the records and of the lists
+ *
+ * They keep their default size without a memory limit, and their part of the
+ * share of the caches under one
+ *
+ * @param BTree* bt
+ */
+static void side_caches_size(BTree *bt)
+{
+    if (bt->index)
+    {
+        long pages = bt->memory_limit ? (long)(cache_budget(bt) / BTREE_PAGE_SIZE) : BTREE_CACHE_PAGES;
+        strtree_set_cache_size(bt->index, pages > 0 ? (int)pages : 1);
+    }
+
+    if (bt->postings)
+    {
+        long pages = bt->memory_limit ? (long)(cache_budget(bt) / POSTINGS_PAGE_SIZE)
+                                      : BTREE_CACHE_PAGES * (BTREE_PAGE_SIZE / POSTINGS_PAGE_SIZE);
+        postings_set_cache_size(bt->postings, pages > 0 ? (int)pages : 1);
+    }
+}
+
+/**
+ * @brief Create a tree whose pages are in "path"
+ *
+ * @param char* path
+ * @param int order
+ * @param size_t page_size
+ * @param int flags
+ * @return BTree*
+ */
+static BTree *tree_create(char *path, int order, size_t page_size, int flags)
+{
+    BTree *bt = (BTree *)malloc(sizeof(BTree));
+
+    bt->flags = flags;
+    bt->memory_limit = 0;
+    bt->numa_node = region_current_node();
+    bt->path = (char *)malloc(strlen(path) + 1);
+    strcpy(bt->path, path);
+    pthread_mutex_init(&bt->lock, NULL);
+
+    // Nothing is measured until it is asked
+    memset(bt->latency, 0, sizeof(bt->latency));
+    bt->trace = NULL;
+
+    tree_open(bt, path, order, page_size);
+
+    // The index is kept apart from the pages of the tree, so a rebuild doesn't touch it
+    bt->index = NULL;
+    bt->index_path = NULL;
+    if (flags & BTREE_RECORD_INDEX)
+    {
+        bt->index_path = (char *)malloc(strlen(path) + strlen(BTREE_INDEX_SUFFIX) + 1);
+        strcpy(bt->index_path, path);
+        strcat(bt->index_path, BTREE_INDEX_SUFFIX);
+        bt->index = strtree_create(bt->index_path, BTREE_PAGE_SIZE);
+    }
+
+    // The lists of records are apart too: a rebuild moves the slots that refer to them as they are
+    bt->postings = NULL;
+    bt->postings_path = NULL;
+    if (flags & BTREE_DUPLICATES)
+    {
+        bt->postings_path = (char *)malloc(strlen(path) + strlen(BTREE_POSTINGS_SUFFIX) + 1);
+        strcpy(bt->postings_path, path);
+        strcat(bt->postings_path, BTREE_POSTINGS_SUFFIX);
+        bt->postings = postings_open(bt->postings_path);
+    }
+    side_caches_size(bt);
+
+    return bt;
+}
+
+/**
+ * @brief Create a B-Tree and allocate memory to it
+ *
+ * @param char* path
+ * @param int order 0 picks the largest order that fits BTREE_PAGE_SIZE
+ * @param int flags BTREE_CLASSIC or BTREE_PLUS, or-ed with any of the other BTREE_* modes of btree.h
+ * @return BTree*
+ */
+BTree *btree_create(char *path, int order, int flags)
+{
+    return tree_create(path, order, BTREE_PAGE_SIZE, flags);
+}
+
+/**
+ * @brief Create a B-Tree with the largest order whose nodes fit in pages of "page_size" bytes
+ *
+ * Keys and records are ints, so the order only depends on the page size and
+ * on the layout of the mode; each page takes a whole "page_size" in the file
+ *
+ * @param char* path
+ * @param size_t page_size
+ * @param int flags
+ * @return BTree*
+ */
+BTree *btree_create_paged(char *path, size_t page_size, int flags)
+{
+    return tree_create(path, 0, page_size, flags);
+}
+
+/**
+ * @brief Get the order of the nodes of the tree
+ *
+ * @param BTree* bt
+ * @return int
+ */
+int btree_order(BTree *bt)
+{
+    return bt->order;
+}
+
+/**
+ * @brief Get the mode the tree was created with
+ *
+ * @param BTree* bt
+ * @return int the BTREE_* flags
+ */
+int btree_flags(BTree *bt)
+{
+    return bt->flags;
+}
+
+/**
+ * @brief Time inserts and searches of random keys on a tree with pages of "page_size" bytes
+ *
+ * Every page size gets the same bytes of cache, so larger pages pay for
+ * their longer reads and smaller ones for their deeper trees
+ *
+ * @param char* path
+ * @param size_t page_size
+ * @param int flags
+ * @return double seconds taken
+ */
+static double calibrate_run(char *path, size_t page_size, int flags)
+{
+    BTree *bt = btree_create_paged(path, page_size, flags);
+    int pages = (int)(BTREE_CALIBRATE_CACHE_BYTES / bt->stride);
+    btree_set_cache_size(bt, pages > 0 ? pages : 1);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Same keys for every page size, spread by a multiplicative hash
+    for (unsigned i = 0; i < BTREE_CALIBRATE_KEYS; i++)
+        btree_insert(bt, (int)((i * 2654435761u) >> 1), (int)i);
+    btree_sync(bt);
+
+    unsigned found = 0;
+    for (unsigned i = 0; i < BTREE_CALIBRATE_KEYS; i++)
+        found += btree_search(bt, (int)(((i * 7919u % BTREE_CALIBRATE_KEYS) * 2654435761u) >> 1));
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    btree_destroy(bt);
+    remove(path);
+
+    if (found != BTREE_CALIBRATE_KEYS)
+        return -1;
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Pick the page size of the tree by timing each candidate on this host
+ *
+ * Trees with every page size from BTREE_CALIBRATE_MIN_PAGE to
+ * BTREE_CALIBRATE_MAX_PAGE are built next to "path" and timed; the fastest
+ * page size is given to btree_create_paged
+ *
+ * @param char* path where the tree will be, the benchmark uses a file next to it
+ * @param int flags
+ * @return size_t
+ */
+size_t btree_calibrate_page_size(char *path, int flags)
+{
+    char *file = (char *)malloc(strlen(path) + strlen(BTREE_CALIBRATE_SUFFIX) + 1);
+    strcpy(file, path);
+    strcat(file, BTREE_CALIBRATE_SUFFIX);
+
+    // Only the pages of the tree are timed: the filter would answer for them,
+    // and the index and the lists aren't sized by the page
+    flags &= ~(BTREE_BLOOM | BTREE_RECORD_INDEX | BTREE_DUPLICATES);
+
+    size_t best = BTREE_PAGE_SIZE;
+    double best_time = -1;
+    size_t first = flags & BTREE_DIRECT ? PAGER_DIRECT_ALIGN : BTREE_CALIBRATE_MIN_PAGE;
+
+    for (size_t page_size = first; page_size <= BTREE_CALIBRATE_MAX_PAGE; page_size *= 2)
+    {
+        double t = calibrate_run(file, page_size, flags);
+        if (t >= 0 && (best_time < 0 || t < best_time))
+        {
+            best = page_size;
+            best_time = t;
+        }
+    }
+
+    free(file);
+
+    return best;
+}
+
+/**
+ * @brief Close the file of a tree and free the memory of its nodes and filter
+ *
+ * @param BTree* bt
+ */
+static void tree_close(BTree *bt)
+{
+    filter_destroy(bt->filter);
+
+    // Close binary file
+    pager_close(bt->pager);
+    for (int i = 0; i < bt->pinned_cap; i++)
+    {
+        if (bt->pinned[i])
+            node_destroy(bt->pinned[i]);
+    }
+    free(bt->pinned);
+    free(bt->page);
+    free(bt->codec.scratch);
+
+    // Every node of the tree must be destroyed before its arena
+    arena_destroy(bt->arena);
+}
+
+/**
+ * @brief Destroy a B-Tree and free memory allocated to it
+ *
+ * @param BTree* bt
+ */
+void btree_destroy(BTree *bt)
+{
+    if (bt->index)
+        strtree_destroy(bt->index);
+    free(bt->index_path);
+
+    if (bt->postings)
+        postings_close(bt->postings);
+    free(bt->postings_path);
+
+    if (bt->root)
+        node_destroy(bt->root);
+
+    btree_set_latency_stats(bt, false);
+    btree_trace_close(bt);
+
+    tree_close(bt);
+    free(bt->path);
+    pthread_mutex_destroy(&bt->lock);
+    free(bt);
+}
+
+/**
+ * @brief Set the amount of pages the cache of the tree keeps in memory
+ *
+ * @param BTree* bt
+ * @param int pages 0 disables the cache
+ */
+void btree_set_cache_size(BTree *bt, int pages)
+{
+    // The cache never takes more than its share of the memory limit
+    if (bt->memory_limit)
+    {
+        long fit = (long)(cache_budget(bt) / pager_page_size(bt->pager));
+        if (pages > fit)
+            pages = fit > 0 ? (int)fit : 1;
+    }
+
+    pager_set_cache(bt->pager, pages);
+}
+
+/**
+ * @brief Move the memory of the nodes and of the cache to another NUMA node
+ *
+ * Only trees created with BTREE_HUGE_PAGES have memory bound to a node; it
+ * is the node of the thread that created the tree until this is called
+ *
+ * @param BTree* bt
+ * @param int node negative to take the node of the calling thread
+ */
+void btree_set_numa_node(BTree *bt, int node)
+{
+    if (!bt->arena)
+        return;
+
+    pthread_mutex_lock(&bt->lock);
+
+    bt->numa_node = node < 0 ? region_current_node() : node;
+    arena_set_node(bt->arena, bt->numa_node);
+    pager_enable_huge_pages(bt->pager, bt->numa_node);
+
+    pthread_mutex_unlock(&bt->lock);
+}
+
+/**
+ * @brief Get the bytes of the nodes and of the cache backed by reserved huge pages
+ *
+ * Only trees created with BTREE_HUGE_PAGES map regions. The part of them that
+ * isn't backed by reserved huge pages may still get transparent ones
+ *
+ * @param BTree* bt
+ * @param size_t* mapped if not NULL, receives the bytes of the regions mapped
+ * @return size_t
+ */
+size_t btree_huge_page_bytes(BTree *bt, size_t *mapped)
+{
+    pthread_mutex_lock(&bt->lock);
+
+    size_t cache_mapped;
+    size_t bytes = pager_huge_bytes(bt->pager, &cache_mapped);
+    if (bt->arena)
+        bytes += arena_huge_bytes(bt->arena);
+    if (mapped)
+        *mapped = cache_mapped + (bt->arena ? arena_bytes(bt->arena) : 0);
+
+    pthread_mutex_unlock(&bt->lock);
+
+    return bytes;
+}
+
+/**
+ * @brief Drop pinned nodes, from the last position down, until they fit their share of the memory limit
+ *
+ * @param BTree* bt
+ */
+static void pinned_trim(BTree *bt)
+{
+    size_t bytes = (size_t)bt->pinned_amount * bt->block + (size_t)bt->pinned_cap * sizeof(Node *);
+
+    for (int pos = bt->pinned_cap - 1; pos >= 0 && bytes > resident_budget(bt); pos--)
+    {
+        if (bt->pinned[pos])
+        {
+            node_destroy(bt->pinned[pos]);
+            bt->pinned[pos] = NULL;
+            bt->pinned_amount--;
+            bytes -= bt->block;
+        }
+    }
+
+    // A vector with no node left doesn't need to be kept
+    if (!bt->pinned_amount)
+    {
+        free(bt->pinned);
+        bt->pinned = NULL;
+        bt->pinned_cap = 0;
+    }
+}
+
+/**
+ * @brief Bound the memory used by the tree
+ *
+ * The filter and the pinned internal nodes, kept whole in memory, take
+ * 1 / BTREE_MEMORY_RESIDENT_SHARE of the limit: a filter over its share
+ * stops growing and answers "maybe" more often, the internal nodes past it
+ * are read from their pages. Of what is left, the caches take
+ * 1 / BTREE_MEMORY_CACHE_SHARE, split evenly between the tree, the index of
+ * the records and the lists. The rest is
+ * shared by the buffers of the walks of the levels, the exports and the bulk
+ * loads, which keep what doesn't fit in temporary files next to the binary
+ * file: the levels are read in chunks and the pairs of a bulk load are sorted
+ * in runs, merged back in one pass
+ *
+ * @param BTree* bt
+ * @param size_t bytes 0 removes the limit, the caches keep their size
+ */
+void btree_set_memory_limit(BTree *bt, size_t bytes)
+{
+    pthread_mutex_lock(&bt->lock);
+
+    bt->memory_limit = bytes;
+    if (bytes)
+    {
+        if (bt->filter && filter_capacity(bt->filter) > filter_fit(bt, filter_capacity(bt->filter)))
+            filter_rebuild(bt, filter_capacity(bt->filter));
+        pinned_trim(bt);
+
+        long pages = (long)(cache_budget(bt) / pager_page_size(bt->pager));
+        pager_set_cache(bt->pager, pages > 0 ? (int)pages : 1);
+        side_caches_size(bt);
+    }
+
+    pthread_mutex_unlock(&bt->lock);
+}
+
+/**
+ * @brief Get the bytes a buffer of the tree may use under the memory limit
+ *
+ * @param BTree* bt
+ * @param int parts the memory left by the cache is split in "parts" buffers
+ * @return size_t SPILL_UNBOUNDED without a limit
+ */
+static size_t memory_budget(BTree *bt, int parts)
+{
+    if (!bt->memory_limit)
+        return SPILL_UNBOUNDED;
+
+    size_t shared = shared_limit(bt);
+    return (shared - shared / BTREE_MEMORY_CACHE_SHARE) / parts;
+}
+
+/**
+ * @brief Set how often the dirty pages of the tree are written back to the file
+ *
+ * @param BTree* bt
+ * @param long ms 0 writes every page through, -1 only writes back on btree_sync,
+ * on evictions and on btree_destroy
+ */
+void btree_set_flush_interval(BTree *bt, long ms)
+{
+    pthread_mutex_lock(&bt->lock);
+    pager_set_flush_interval(bt->pager, ms);
+    pthread_mutex_unlock(&bt->lock);
+}
+
+/**
+ * @brief Write back the dirty pages of the tree and wait for them to reach the disk
+ *
+ * The index of the records and the lists of the duplicates are written back too
+ *
+ * @param BTree* bt
+ */
+void btree_sync(BTree *bt)
+{
+    pthread_mutex_lock(&bt->lock);
+    if (bt->index)
+        strtree_sync(bt->index);
+    if (bt->postings)
+        postings_sync(bt->postings);
+    pager_sync(bt->pager);
+    pthread_mutex_unlock(&bt->lock);
+}
+
+/**
+ * @brief Get the amount of bytes the tree takes in the binary file
+ *
+ * @param BTree* bt
+ * @return long
+ */
+long btree_file_size(BTree *bt)
+{
+    return pager_file_size(bt->pager);
+}
+
+/**
+ * @brief Returns a pointer to root's node
+ *
+ * @param BTree* bt
+ * @return Node*
+ */
+Node *btree_get_root(BTree *bt)
+{
+    return bt->root;
+}
+
+/**
+ * @brief Visitor that adds the keys of a scan to a filter
+ *
+ * @param int key
+ * @param int record
+ * @param void* ctx the Filter
+ * @return true
+ */
+static bool filter_add_visit(int key, int record, void *ctx)
+{
+    filter_add((Filter *)ctx, key);
+    return true;
+}
+
+/**
+ * @brief Build the filter again from the keys of the tree, sized for a new amount of keys
+ *
+ * @param BTree* bt
+ * @param long capacity
+ */
+static void filter_rebuild(BTree *bt, long capacity)
+{
+    filter_destroy(bt->filter);
+    bt->filter = filter_create(filter_fit(bt, capacity));
+
+    // Every key is added once, even with many records
+    if (bt->root)
+        scan_tree(bt, NULL, bt->root, INT_MIN, INT_MAX, filter_add_visit, bt->filter);
+}
+
+/**
+ * @brief Add a key just inserted to the filter, doubling the filter when it is full
+ *
+ * @param BTree* bt
+ * @param int key
+ */
+static void filter_track_insert(BTree *bt, int key)
+{
+    // Under a memory limit the filter stops growing at its share
+    long capacity = filter_capacity(bt->filter);
+    if (filter_count(bt->filter) + 1 > capacity && filter_fit(bt, 2 * capacity) > capacity)
+        filter_rebuild(bt, 2 * capacity);
+    else
+        filter_add(bt->filter, key);
+}
+
+/**
+ * @brief Encode the entry of a pair in the index
+ *
+ * Both ints are written big-endian with the sign bit flipped, so the bytes of
+ * the entries sort as (record, key)
+ *
+ * @param int record
+ * @param int key
+ * @param unsigned char* entry receives BTREE_INDEX_ENTRY_SIZE bytes
+ */
+static void index_entry(int record, int key, unsigned char *entry)
+{
+    uint32_t r = (uint32_t)record ^ 0x80000000u;
+    uint32_t k = (uint32_t)key ^ 0x80000000u;
+
+    for (int i = 0; i < 4; i++)
+    {
+        entry[i] = (unsigned char)(r >> (24 - 8 * i));
+        entry[4 + i] = (unsigned char)(k >> (24 - 8 * i));
+    }
+}
+
+/**
+ * @brief Add a pair of the tree to the index
+ *
+ * @param BTree* bt
+ * @param int key
+ * @param int record
+ */
+static void index_add(BTree *bt, int key, int record)
+{
+    unsigned char entry[BTREE_INDEX_ENTRY_SIZE];
+
+    index_entry(record, key, entry);
+    strtree_insert(bt->index, (const char *)entry, sizeof(entry), key);
+}
+
+/**
+ * @brief Remove a pair of the tree from the index
+ *
+ * @param BTree* bt
+ * @param int key
+ * @param int record
+ */
+static void index_remove(BTree *bt, int key, int record)
+{
+    unsigned char entry[BTREE_INDEX_ENTRY_SIZE];
+
+    index_entry(record, key, entry);
+    strtree_delete(bt->index, (const char *)entry, sizeof(entry));
+}
+
+/**
+ * @brief Add a pair visited by a scan to the index
+ *
+ * @param int key
+ * @param int record
+ * @param void* ctx the tree
+ * @return true
+ */
+static bool index_add_visit(int key, int record, void *ctx)
+{
+    index_add((BTree *)ctx, key, record);
+
+    return true;
+}
+
+/**
+ * @brief Fill the empty index with every pair of the tree
+ *
+ * @param BTree* bt
+ */
+static void index_rebuild(BTree *bt)
+{
+    if (bt->root)
+        btree_scan(bt, INT_MIN, INT_MAX, index_add_visit, bt);
+}
+
+// Visitor given the records of a key, one by one, out of the slot of the key
+typedef struct
+{
+    BTree *bt;
+    BTreeVisitor visit;
+    void *ctx;
+    int key; // Key whose records are being visited
+} SlotVisit;
+
+/**
+ * @brief Give a record of the list being visited to the visitor of the tree
+ *
+ * @param int record
+ * @param void* ctx the SlotVisit
+ * @return false if the visitor asked to stop
+ */
+static bool slot_record_visit(int record, void *ctx)
+{
+    SlotVisit *v = (SlotVisit *)ctx;
+
+    return v->visit(v->key, record, v->ctx);
+}
+
+/**
+ * @brief Give every record of a slot visited by a scan to the visitor of the tree
+ *
+ * @param int key
+ * @param int slot
+ * @param void* ctx the SlotVisit
+ * @return false if the visitor asked to stop
+ */
+static bool slot_scan_visit(int key, int slot, void *ctx)
+{
+    SlotVisit *v = (SlotVisit *)ctx;
+
+    v->key = key;
+    return postings_visit(v->bt->postings, slot, slot_record_visit, v);
+}
+
+/**
+ * @brief Take a pair of a key that left the tree out of the index
+ *
+ * @param int key
+ * @param int record
+ * @param void* ctx the tree
+ * @return true
+ */
+static bool index_remove_visit(int key, int record, void *ctx)
+{
+    index_remove((BTree *)ctx, key, record);
+
+    return true;
+}
+
+/**
+ * @brief Forget the records of a key that left the tree, or whose records were replaced
+ *
+ * The index loses every pair of the key and the list of the slot is given back
+ *
+ * @param BTree* bt
+ * @param int key
+ * @param int slot the record of the key, or its list with BTREE_DUPLICATES
+ */
+static void slot_forget(BTree *bt, int key, int slot)
+{
+    if (bt->index && bt->postings)
+    {
+        SlotVisit v = {bt, index_remove_visit, bt, key};
+        postings_visit(bt->postings, slot, slot_record_visit, &v);
+    }
+    else if (bt->index)
+    {
+        index_remove(bt, key, slot);
+    }
+
+    if (bt->postings)
+        postings_free(bt->postings, slot);
+}
+
+/**
+ * @brief Check if a record can be kept by the tree
+ *
+ * With BTREE_DUPLICATES, negative slots refer to lists, so records can't be negative
+ *
+ * @param BTree* bt
+ * @param int record
+ * @return true
+ * @return false the record is negative and the tree has duplicates
+ */
+static bool slot_record_valid(BTree *bt, int record)
+{
+    return !bt->postings || record >= 0;
+}
+
+/**
+ * @brief Insert a value to the tree
+ *
+ * A key already in the tree keeps its record; with BTREE_DUPLICATES it takes
+ * the new one too, at the end of its list
+ *
+ * @param BTree* bt
+ * @param int key
+ * @param int record not negative with BTREE_DUPLICATES
+ * @return true
+ * @return false the record can't be kept, nothing is inserted
+ */
+bool btree_insert(BTree *bt, int key, int record)
+{
+    if (!slot_record_valid(bt, record))
+        return false;
+
+    uint64_t start = op_begin(bt, BTREE_OP_INSERT, key);
+    pthread_mutex_lock(&bt->lock);
+
+    // Check if the key already exists in the tree, with duplicates it takes one more record
+    int slot;
+    if (bt->postings ? record_lookup(bt, key, &slot) : btree_search(bt, key))
+    {
+        if (bt->postings)
+        {
+            int grown = postings_add(bt->postings, slot, record);
+            if (grown != slot)
+                record_replace(bt, key, grown);
+            if (bt->index)
+                index_add(bt, key, record);
+        }
+
+        pthread_mutex_unlock(&bt->lock);
+        op_end(bt, BTREE_OP_INSERT, start);
+        return true;
+    }
+
+    // If the tree is empty, create a new root node
+    if (!bt->root)
+    {
+        bt->root = node_create(bt, true, pager_alloc(bt->pager));
+        bt->root->keys[0] = key;
+        bt->root->records[0] = record;
+        bt->root->n_keys = 1;
+        disk_write(bt, bt->root);
+    }
+    else
+    {
+        // If the root is full, split it and grow the tree height
+        if (bt->root->n_keys == node_max_keys(bt, bt->root))
+        {
+            // Create the new node and define its params
+            Node *new_root = node_create(bt, false, pager_alloc(bt->pager));
+            new_root->children[0] = bt->root->b_position;
+
+            node_destroy(bt->root);
+            bt->root = new_root;
+            Node *y = child_read(bt, bt->root->children[0]);
+
+            // Split child and insert to the tree (preemptive insertion)
+            split_child(bt, bt->root, y, 0);
+            insert_non_full(bt, bt->root, key, record);
+        }
+        else
+        {
+            // If node isn't full, insert into it
+            insert_non_full(bt, bt->root, key, record);
+        }
+    }
+
+    if (bt->filter)
+        filter_track_insert(bt, key);
+    if (bt->index)
+        index_add(bt, key, record);
+
+    pthread_mutex_unlock(&bt->lock);
+    op_end(bt, BTREE_OP_INSERT, start);
+
+    return true;
+}
+
+/**
+ * @brief Function to split a node
+ *
+ * @param Btree* bt
+ * @param Node* x
+ * @param Node* y
+ * @param i
+ */
+void split_child(BTree *bt, Node *x, Node *y, int i)
+{
+    op_event(bt, TRACE_SPLIT, y->b_position, op_depth + 1);
+
+    if (bt->flags & BTREE_PLUS)
+    {
+        bplus_split_child(bt, x, y, i);
+        return;
+    }
+
+    Node *z = node_create(bt, y->is_leaf, pager_alloc(bt->pager));
+
+    // Get the minimum order of the tree
+    int t = (bt->order - 1) / 2;
+
+    // Copy the second half of y's keys and records to z
+    z->n_keys = (bt->order - 1) - t - 1;
+    for (int j = 0; j < z->n_keys; j++)
+    {
+        z->keys[j] = y->keys[j + t + 1];
+        z->records[j] = y->records[j + t + 1];
+    }
+
+    // If y is not a leaf, copy its children to z
+    if (!y->is_leaf)
+    {
+        for (int j = 0; j <= z->n_keys; j++)
+            z->children[j] = y->children[j + t + 1];
+    }
+
+    y->n_keys = t;
+
+    // Shift x's children to make space for z
+    for (int j = x->n_keys; j > i; j--)
+    {
+        x->children[j + 1] = x->children[j];
+    }
+
+    x->children[i + 1] = z->b_position;
+
+    // Shift x's keys and records to make space in y
+    for (int j = x->n_keys - 1; j >= i; j--)
+    {
+        x->keys[j + 1] = x->keys[j];
+        x->records[j + 1] = x->records[j];
+    }
+
+    // Move the median key from y to x
+    x->keys[i] = y->keys[t];
+    x->records[i] = y->records[t];
+    x->n_keys++;
+
+    // Write nodes in the binary file
+    disk_write(bt, x);
+    child_write(bt, y);
+    child_write(bt, z);
+
+    node_destroy(y);
+    node_destroy(z);
+}
+
+/**
+ * @brief Insert a key in the tree if node isn't full
+ *
+ * @param BTree* bt
+ * @param Node* node
+ * @param int key
+ * @param int record
+ */
+void insert_non_full(BTree *bt, Node *node, int key, int record)
+{
+    if (bt->flags & BTREE_PLUS)
+    {
+        bplus_insert_non_full(bt, node, key, record);
+        return;
+    }
+
+    int i = node->n_keys - 1;
+
+    // If the node is a leaf, insert the key directly
+    if (node->is_leaf)
+    {
+        // Shift keys and records to make space for the new key
+        while (i >= 0 && key < node->keys[i])
+        {
+            node->keys[i + 1] = node->keys[i];
+            node->records[i + 1] = node->records[i];
+            i--;
+        }
+
+        // Insert the key and record
+        node->keys[i + 1] = key;
+        node->records[i + 1] = record;
+        node->n_keys++;
+        disk_write(bt, node);
+    }
+    else
+    {
+        // Find the appropriate child for insertion
+        while (i >= 0 && key < node->keys[i])
+        {
+            i--;
+        }
+        i++;
+        Node *child = child_read(bt, node->children[i]);
+
+        // If the child is full, split it
+        if (child->n_keys == bt->order - 1)
+        {
+            Node *y = child_read(bt, node->children[i]);
+            split_child(bt, node, y, i);
+            if (key > node->keys[i])
+            {
+                i++;
+            }
+
+            node_destroy(child);
+            child = child_read(bt, node->children[i]);
+        }
+
+        // Recursively insert the key into the child
+        op_depth++;
+        insert_non_full(bt, child, key, record);
+        op_depth--;
+
+        // Free the memory of the child
+        node_destroy(child);
+    }
+}
+
+/**
+ * @brief Search a node in B-Tree
+ *
+ * @param BTree* bt
+ * @param int key
+ * @return true
+ * @return false
+ */
+static bool tree_search(BTree *bt, int key)
+{
+    if (bt->root == NULL)
+    {
+        return false;
+    }
+    if (bt->filter && !filter_may_contain(bt->filter, key))
+    {
+        return false;
+    }
+    if (bt->flags & BTREE_PLUS)
+    {
+        return bplus_search(bt, key, NULL);
+    }
+    return search_node(bt, bt->root, key);
+}
+
+/**
+ * @brief Search a key in the tree
+ *
+ * @param BTree* bt
+ * @param int key
+ * @return true
+ * @return false
+ */
+bool btree_search(BTree *bt, int key)
+{
+    uint64_t start = op_begin(bt, BTREE_OP_SEARCH, key);
+    bool found = tree_search(bt, key);
+    op_end(bt, BTREE_OP_SEARCH, start);
+
+    return found;
+}
+
+/**
+ * @brief Search a node by searching a key
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param int key
+ * @return true
+ * @return false
+ */
+bool search_node(BTree *bt, Node *n, int key)
+{
+    // Find the position of the key in the node
+    int i = find_key_index(n, key);
+
+    // If the key is found in the node, return true
+    if (i < n->n_keys && key == n->keys[i])
+    {
+        return true;
+    }
+
+    // If the node is a leaf and the key is not found, return false
+    if (n->is_leaf)
+    {
+        return false;
+    }
+
+    // Recursively search in the appropriate child node
+    op_depth++;
+    Node *child = node_fetch(bt, n->children[i]);
+    bool res = search_node(bt, child, key);
+
+    // Free the memory of the child node
+    node_release(bt, child);
+    op_depth--;
+
+    return res;
+}
+
+/**
+ * @brief Take one step down the tree for the key of a batch
+ *
+ * @param BTree* bt
+ * @param int pos position of the node to check
+ * @param int key
+ * @param bool* found
+ * @param int* record if not NULL, receives the record of a key found
+ * @return int position of the child to check next, -1 if the search ended
+ */
+static int search_step(BTree *bt, int pos, int key, bool *found, int *record)
+{
+    Node *n = pos == bt->root->b_position ? bt->root : node_fetch(bt, pos);
+    int next = -1;
+
+    if (bt->flags & BTREE_PLUS)
+    {
+        if (!n->is_leaf)
+        {
+            next = n->children[bplus_child_index(n, key)];
+        }
+        else
+        {
+            int i = find_key_index(n, key);
+            *found = i < n->n_keys && n->keys[i] == key;
+            if (*found && record)
+                *record = n->records[i];
+        }
+    }
+    else
+    {
+        int i = find_key_index(n, key);
+        if (i < n->n_keys && key == n->keys[i])
+        {
+            *found = true;
+            if (record)
+                *record = n->records[i];
+        }
+        else if (!n->is_leaf)
+        {
+            next = n->children[i];
+        }
+    }
+
+    node_release(bt, n);
+
+    return next;
+}
+
+/**
+ * @brief Search a key and get its record
+ *
+ * @param BTree* bt
+ * @param int key
+ * @param int* record if not NULL, receives the record of the key
+ * @return true
+ * @return false
+ */
+static bool record_lookup(BTree *bt, int key, int *record)
+{
+    bool found = false;
+
+    if (!bt->root || (bt->filter && !filter_may_contain(bt->filter, key)))
+        return false;
+
+    // Each step is one level further down
+    int depth = op_depth;
+    for (int pos = bt->root->b_position; pos != -1; op_depth++)
+        pos = search_step(bt, pos, key, &found, record);
+    op_depth = depth;
+
+    return found;
+}
+
+/**
+ * @brief Search many keys, descending the tree with all of them at once
+ *
+ * The keys of a batch go down one level at a time: the nodes of the next
+ * level are all asked for before the first one is read, so the reads of the
+ * different keys overlap
+ *
+ * @param BTree* bt
+ * @param const int* keys
+ * @param int n
+ * @param bool* found receives, for every key, if it is in the tree
+ * @param int* records if not NULL, receives the record of every key found, the first one with duplicates
+ */
+void btree_search_batch(BTree *bt, const int *keys, int n, bool *found, int *records)
+{
+    int pos[BTREE_SEARCH_BATCH];
+
+    for (int b = 0; b < n; b += BTREE_SEARCH_BATCH)
+    {
+        int amount = n - b < BTREE_SEARCH_BATCH ? n - b : BTREE_SEARCH_BATCH;
+        int active = 0;
+
+        // The keys of a group are answered together, so they are measured as one search
+        uint64_t start = op_begin(bt, BTREE_OP_SEARCH, keys[b]);
+
+        for (int i = 0; i < amount; i++)
+        {
+            found[b + i] = false;
+            pos[i] = -1;
+            if (bt->root && (!bt->filter || filter_may_contain(bt->filter, keys[b + i])))
+            {
+                pos[i] = bt->root->b_position;
+                active++;
+            }
+        }
+
+        // Every key still going down is on the same level
+        int depth = op_depth;
+        for (; active; op_depth++)
+        {
+            for (int i = 0; i < amount; i++)
+            {
+                if (pos[i] != -1 && pos[i] != bt->root->b_position)
+                    node_prefetch(bt, pos[i]);
+            }
+
+            for (int i = 0; i < amount; i++)
+            {
+                if (pos[i] == -1)
+                    continue;
+
+                pos[i] = search_step(bt, pos[i], keys[b + i], &found[b + i], records ? &records[b + i] : NULL);
+                if (pos[i] == -1)
+                    active--;
+            }
+        }
+
+        op_depth = depth;
+
+        // Keys with many records give the first one of their list
+        for (int i = 0; records && bt->postings && i < amount; i++)
+        {
+            if (found[b + i])
+                records[b + i] = postings_first(bt->postings, records[b + i]);
+        }
+
+        op_end(bt, BTREE_OP_SEARCH, start);
+    }
+}
+
+// Keys of a record found so far
+typedef struct
+{
+    int record; // Record looked for, only used by scans of the tree
+    int *keys;  // Receives the first "max" keys
+    int max;
+    int count;  // Keys found, even past "max"
+} RecordMatches;
+
+/**
+ * @brief Keep a key of the record, given by the index
+ *
+ * @param const char* entry
+ * @param size_t len
+ * @param int key the index keeps the key as the record of its entries
+ * @param void* ctx the RecordMatches
+ * @return true
+ */
+static bool record_index_visit(const char *entry, size_t len, int key, void *ctx)
+{
+    RecordMatches *m = (RecordMatches *)ctx;
+
+    if (m->count < m->max)
+        m->keys[m->count] = key;
+    m->count++;
+
+    return true;
+}
+
+/**
+ * @brief Keep a key of the tree if it maps to the record
+ *
+ * @param int key
+ * @param int record
+ * @param void* ctx the RecordMatches
+ * @return true
+ */
+static bool record_scan_visit(int key, int record, void *ctx)
+{
+    RecordMatches *m = (RecordMatches *)ctx;
+
+    if (record == m->record)
+        record_index_visit(NULL, 0, key, ctx);
+
+    return true;
+}
+
+/**
+ * @brief Find the keys that map to a record, in increasing order
+ *
+ * The entries of the record are next to each other in the index. Without
+ * BTREE_RECORD_INDEX the whole tree is scanned
+ *
+ * @param BTree* bt
+ * @param int record
+ * @param int* keys receives at most "max" keys
+ * @param int max
+ * @return int amount of keys of the record, even if more than "max"
+ */
+int btree_find_by_record(BTree *bt, int record, int *keys, int max)
+{
+    RecordMatches m = {record, keys, max, 0};
+
+    if (bt->index)
+    {
+        unsigned char lo[BTREE_INDEX_ENTRY_SIZE], hi[BTREE_INDEX_ENTRY_SIZE];
+        index_entry(record, INT_MIN, lo);
+        index_entry(record, INT_MAX, hi);
+        strtree_scan(bt->index, (const char *)lo, sizeof(lo), (const char *)hi, sizeof(hi), record_index_visit, &m);
+    }
+    else if (bt->root)
+    {
+        btree_scan(bt, INT_MIN, INT_MAX, record_scan_visit, &m);
+    }
+
+    return m.count;
+}
+
+/**
+ * @brief Visit every record of a key, in the order they were inserted
+ *
+ * A single record is kept in the node of the key; more records are kept in
+ * a run of consecutive pages of the file of the lists, read in order
+ *
+ * @param BTree* bt
+ * @param int key
+ * @param BTreeVisitor visit gets the key with each record, returns false to stop
+ * @param void* ctx
+ * @return long amount of records of the key, even if the visitor stopped before, 0 if it isn't in the tree
+ */
+long btree_get_all(BTree *bt, int key, BTreeVisitor visit, void *ctx)
+{
+    uint64_t start = op_begin(bt, BTREE_OP_GET_ALL, key);
+
+    int slot;
+    long count = 0;
+    if (record_lookup(bt, key, &slot))
+    {
+        if (bt->postings)
+        {
+            SlotVisit v = {bt, visit, ctx, key};
+            count = postings_count(bt->postings, slot);
+            postings_visit(bt->postings, slot, slot_record_visit, &v);
+        }
+        else
+        {
+            count = 1;
+            visit(key, slot, ctx);
+        }
+    }
+
+    op_end(bt, BTREE_OP_GET_ALL, start);
+
+    return count;
+}
+
+/**
+ * @brief Delete a key and the value associated to the key from B-Tree
+ *
+ * @param Btree* bt
+ * @param int key
+ */
+void btree_delete(BTree *bt, int key)
+{
+    uint64_t start = op_begin(bt, BTREE_OP_DELETE, key);
+    pthread_mutex_lock(&bt->lock);
+
+    if (bt->root == NULL)
+    {
+        pthread_mutex_unlock(&bt->lock);
+        op_end(bt, BTREE_OP_DELETE, start);
+        return;
+    }
+
+    // Remove a key, recursively, from node
+    int record;
+    bool removed;
+    if (bt->flags & BTREE_PLUS)
+        removed = bplus_remove_from_node(bt, bt->root, key, &record);
+    else
+        removed = remove_from_node(bt, bt->root, key, &record);
+
+    // Update root while root is empty, giving back its page
+    while (bt->root && bt->root->n_keys == 0)
+    {
+        int old_pos = bt->root->b_position;
+
+        if (bt->root->is_leaf)
+        {
+            // If root is a leaf, let them null
+            node_destroy(bt->root);
+            bt->root = NULL;
+        }
+        else
+        {
+            // If root isn't a leaf, turn the first child in root
+            int child_pos = bt->root->children[0];
+            node_destroy(bt->root);
+            bt->root = child_read(bt, child_pos);
+        }
+
+        node_free(bt, old_pos);
+    }
+
+    // The filter, the index and the lists only forget keys that were in the tree
+    if (removed)
+    {
+        if (bt->filter)
+            filter_remove(bt->filter, key);
+        slot_forget(bt, key, record);
+    }
+
+    pthread_mutex_unlock(&bt->lock);
+    op_end(bt, BTREE_OP_DELETE, start);
+}
+
+/**
+ * @brief Write a new record to the node that holds the key
+ *
+ * @param BTree* bt
+ * @param int key a key of the tree
+ * @param int record
+ */
+static void record_replace(BTree *bt, int key, int record)
+{
+    bool plus = bt->flags & BTREE_PLUS;
+    Node *n = bt->root;
+    int depth = op_depth;
+
+    for (;; op_depth++)
+    {
+        // Internal nodes of a B+-tree only hold copies of the keys
+        int i = find_key_index(n, key);
+        if (i < n->n_keys && n->keys[i] == key && (n->is_leaf || !plus))
+        {
+            n->records[i] = record;
+            disk_write(bt, n);
+            break;
+        }
+
+        Node *child = child_read(bt, n->children[plus ? bplus_child_index(n, key) : i]);
+        if (n != bt->root)
+            node_destroy(n);
+        n = child;
+    }
+
+    op_depth = depth;
+    if (n != bt->root)
+        node_destroy(n);
+}
+
+/**
+ * @brief Change the record of a key of the tree
+ *
+ * The index moves the key to its new record in the same write. With
+ * BTREE_DUPLICATES the record replaces every record of the key
+ *
+ * @param BTree* bt
+ * @param int key
+ * @param int record not negative with BTREE_DUPLICATES
+ * @return true
+ * @return false the key isn't in the tree, or the record can't be kept
+ */
+bool btree_update(BTree *bt, int key, int record)
+{
+    if (!slot_record_valid(bt, record))
+        return false;
+
+    uint64_t start = op_begin(bt, BTREE_OP_UPDATE, key);
+    pthread_mutex_lock(&bt->lock);
+
+    int old;
+    bool found = record_lookup(bt, key, &old);
+
+    if (found && old != record)
+    {
+        record_replace(bt, key, record);
+        slot_forget(bt, key, old);
+        if (bt->index)
+            index_add(bt, key, record);
+    }
+
+    pthread_mutex_unlock(&bt->lock);
+    op_end(bt, BTREE_OP_UPDATE, start);
+
+    return found;
+}
+
+/**
+ * @brief Auxiliary function to find a key's index in the node
+ *
+ * Returns the index of the first key not smaller than the key. Small nodes are
+ * scanned, large ones use their Eytzinger copy or a binary search
+ *
+ * @param Node* node
+ * @param int key
+ * @return int
+ */
+int find_key_index(Node *node, int key)
+{
+    int n = node->n_keys;
+
+    if (n <= BTREE_LINEAR_SEARCH_KEYS)
+    {
+        int i = 0;
+
+        while (i < n && node->keys[i] < key)
+        {
+            ++i;
+        }
+
+        return i;
+    }
+
+    if (node->eytz)
+    {
+        // Go down the implicit tree, then back up to the last node where it went left
+        int k = 1;
+        while (k <= n)
+            k = 2 * k + (node->eytz[k] < key);
+        k >>= __builtin_ffs(~k);
+
+        return k == 0 ? n : node->eytz_rank[k];
+    }
+
+    // Branchless binary search
+    const int *base = node->keys;
+    while (n > 1)
+    {
+        int half = n / 2;
+        base = base[half] < key ? base + half : base;
+        n -= half;
+    }
+
+    return (int)(base - node->keys) + (*base < key);
+}
+
+/**
+ * @brief Get the min amount of keys of a non-root node of the classic tree
+ *
+ * A full node splits around its median into (order - 1) / 2 keys and the
+ * rest, so with an odd order the right half has one key less
+ *
+ * @param BTree* bt
+ * @return int
+ */
+static int classic_min_keys(BTree *bt)
+{
+    return (bt->order - 2) / 2;
+}
+
+/**
+ * @brief Recursive function to delete a key from the tree
+ *
+ * Every child is filled before going down into it, so the leaf can always lose
+ * a key. The node is owned by the caller
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param key
+ * @param int* record if not NULL, receives the record of the key removed
+ * @return true if the key was in the subtree and was removed
+ */
+bool remove_from_node(BTree *bt, Node *n, int key, int *record)
+{
+    // Find the index of a key in the node
+    int i = find_key_index(n, key);
+
+    // Verify if the key is present in the node
+    if (i < n->n_keys && n->keys[i] == key)
+    {
+        if (record)
+            *record = n->records[i];
+
+        if (n->is_leaf)
+        {
+            // Case 1: the node is a leaf and has the minimum amount of keys
+            remove_from_leaf(bt, n, i);
+        }
+        else
+        {
+            // Case 2: the node isn't a leaf
+            remove_from_non_leaf(bt, n, i);
+        }
+        return true;
+    }
+
+    // The key isn't in the tree
+    if (n->is_leaf)
+        return false;
+
+    // Flag to verify if last node was found
+    bool is_last_child = (i == n->n_keys);
+
+    // Read ci children from binary file
+    Node *child = child_read(bt, n->children[i]);
+
+    // Verify if child node has the minimum amount of keys
+    if (child->n_keys <= classic_min_keys(bt))
+    {
+        // Fill the node
+        node_destroy(child);
+        fill_node(bt, n, i);
+
+        // If was the last child and a merge occured, an update is made
+        if (is_last_child && i > n->n_keys)
+        {
+            child = child_read(bt, n->children[i - 1]);
+        }
+        else
+        {
+            child = child_read(bt, n->children[i]);
+        }
+    }
+
+    // Remove recursively the key from child
+    op_depth++;
+    bool removed = remove_from_node(bt, child, key, record);
+    op_depth--;
+    node_destroy(child);
+
+    return removed;
+}
+
+/**
+ * @brief Remove a key if the node is a leaf
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param int index
+ */
+void remove_from_leaf(BTree *bt, Node *n, int index)
+{
+    // Shift all keys and records to the right of the key to be removed
+    for (int i = index + 1; i < n->n_keys; ++i)
+    {
+        n->keys[i - 1] = n->keys[i];
+        n->records[i - 1] = n->records[i];
+    }
+
+    n->n_keys--;
+
+    // Write the node, updating it in the file
+    disk_write(bt, n);
+}
+
+/**
+ * @brief Remove a key if the node isn't a leaf
+ *
+ * @param bt
+ * @param n
+ * @param index
+ */
+void remove_from_non_leaf(BTree *bt, Node *n, int index)
+{
+    int key = n->keys[index];
+    int min_keys = classic_min_keys(bt);
+
+    // Case 2a: if the left child can lose a key, the predecessor takes the place of the key
+    // and is removed from the left subtree
+    Node *child_left = child_read(bt, n->children[index]);
+    if (child_left->n_keys > min_keys)
+    {
+        n->records[index] = get_predecessor(bt, n, index);
+        disk_write(bt, n);
+
+        op_depth++;
+        remove_from_node(bt, child_left, n->keys[index], NULL);
+        op_depth--;
+        node_destroy(child_left);
+        return;
+    }
+
+    // Case 2b: otherwise, if the right child can lose a key, the successor takes its place
+    Node *child_right = child_read(bt, n->children[index + 1]);
+    if (child_right->n_keys > min_keys)
+    {
+        n->records[index] = get_successor(bt, n, index);
+        disk_write(bt, n);
+
+        op_depth++;
+        remove_from_node(bt, child_right, n->keys[index], NULL);
+        op_depth--;
         node_destroy(child_left);
+        node_destroy(child_right);
+        return;
+    }
+
+    // Case 2c: if none of children nodes have the minimum amount of keys, merge them and remove the key
+    node_destroy(child_left);
+    node_destroy(child_right);
+    merge_nodes(bt, n, index);
+
+    // Remove the key from new node
+    child_left = child_read(bt, n->children[index]);
+    op_depth++;
+    remove_from_node(bt, child_left, key, NULL);
+    op_depth--;
+    node_destroy(child_left);
+}
+
+/**
+ * @brief Get the predecessor of a key in left's node
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param index
+ * @return int
+ */
+int get_predecessor(BTree *bt, Node *n, int i)
+{
+    // Get the left's child
+    int depth = op_depth++;
+    Node *current = disk_read(bt, n->children[i]);
+
+    // Go to the rightmost node of this subtree. With order 3 a split may leave
+    // the right node empty, so the predecessor is the last key seen on the way
+    int pred_key = 0;
+    int pred_record = 0;
+    while (true)
+    {
+        if (current->n_keys > 0)
+        {
+            pred_key = current->keys[current->n_keys - 1];
+            pred_record = current->records[current->n_keys - 1];
+        }
+
+        if (current->is_leaf)
+            break;
+
+        op_depth++;
+        Node *temp = disk_read(bt, current->children[current->n_keys]);
+        node_destroy(current);
+        current = temp;
+    }
+
+    // Update key in the original node
+    op_depth = depth;
+    n->keys[i] = pred_key;
+
+    node_destroy(current);
+    return pred_record;
+}
+
+/**
+ * @brief Get the successor of a key in right's node
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param index
+ * @return int
+ */
+int get_successor(BTree *bt, Node *n, int i)
+{
+    // Get the right's child
+    int depth = op_depth++;
+    Node *current = disk_read(bt, n->children[i + 1]);
+
+    // Go to the leftmost node of this subtree, the successor is the first key
+    // of the last node with keys on the way
+    int succ_key = 0;
+    int succ_record = 0;
+    while (true)
+    {
+        if (current->n_keys > 0)
+        {
+            succ_key = current->keys[0];
+            succ_record = current->records[0];
+        }
+
+        if (current->is_leaf)
+            break;
+
+        op_depth++;
+        Node *temp = disk_read(bt, current->children[0]);
+        node_destroy(current);
+        current = temp;
+    }
+
+    // Update key in the original node
+    op_depth = depth;
+    n->keys[i] = succ_key;
+
+    node_destroy(current);
+    return succ_record;
+}
+
+/**
+ * @brief Merge children from right and left
+ *
+ * @param bt
+ * @param n
+ * @param index
+ */
+void merge_nodes(BTree *bt, Node *n, int index)
+{
+    op_event(bt, TRACE_MERGE, n->children[index], op_depth + 1);
+
+    Node *child = child_read(bt, n->children[index]);
+    Node *sibling = child_read(bt, n->children[index + 1]);
+
+    int end = child->n_keys;
+
+    // Copy the keys from parents to the child
+    child->keys[end] = n->keys[index];
+    child->records[end] = n->records[index];
+
+    // Copy all keys and registers of a sibling to the node
+    for (int i = 0; i < sibling->n_keys; ++i)
+    {
+        child->keys[end + 1 + i] = sibling->keys[i];
+        child->records[end + 1 + i] = sibling->records[i];
+    }
+
+    // If node isn't leaf, copy the references to children
+    if (!child->is_leaf)
+    {
+        for (int i = 0; i <= sibling->n_keys; ++i)
+        {
+            child->children[end + 1 + i] = sibling->children[i];
+        }
+    }
+
+    // Move keys in parent node to fill space of removed key
+    for (int i = index + 1; i < n->n_keys; ++i)
+    {
+        n->keys[i - 1] = n->keys[i];
+        n->records[i - 1] = n->records[i];
+    }
+
+    // Moves references to children in the parent node
+    for (int i = index + 2; i <= n->n_keys; ++i)
+    {
+        n->children[i - 1] = n->children[i];
+    }
+
+    // Update amount of keys
+    child->n_keys += sibling->n_keys + 1;
+    n->n_keys--;
+
+    // Write nodes in the binary file
+    disk_write(bt, n);
+    child_write(bt, child);
+
+    // The sibling left the tree
+    node_free(bt, sibling->b_position);
+
+    node_destroy(child);
+    node_destroy(sibling);
+}
+
+/**
+ * @brief Fill the node to ensure it has the minimum number of keys
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param int index
+ */
+void fill_node(BTree *bt, Node *n, int index)
+{
+    int min_keys = classic_min_keys(bt);
+
+    // With order 3 a node may be left without keys, its only child has no sibling
+    if (n->n_keys == 0)
+        return;
+
+    // Try to borrow from the brother on the left
+    if (index != 0)
+    {
+        Node *sibling = child_read(bt, n->children[index - 1]);
+        if (sibling->n_keys > min_keys)
+        {
+            borrow_from_prev(bt, n, index);
+            node_destroy(sibling);
+            return;
+        }
+        node_destroy(sibling);
+    }
+
+    // Try to borrow from the brother on the right
+    if (index != n->n_keys)
+    {
+        Node *sibling = child_read(bt, n->children[index + 1]);
+        if (sibling->n_keys > min_keys)
+        {
+            borrow_from_next(bt, n, index);
+            node_destroy(sibling);
+            return;
+        }
+        node_destroy(sibling);
+    }
+
+    // If it was not possible to borrow, do the merge
+    if (index != n->n_keys)
+    {
+        // Merge with right node
+        merge_nodes(bt, n, index);
+    }
+    else
+    {
+        // Merge with left node
+        merge_nodes(bt, n, index - 1);
+    }
+}
+
+/**
+ * @brief Get a key from previous node
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param index
+ */
+void borrow_from_prev(BTree *bt, Node *n, int index)
+{
+    op_event(bt, TRACE_BORROW, n->children[index], op_depth + 1);
+
+    Node *child = child_read(bt, n->children[index]);
+    Node *sibling = child_read(bt, n->children[index - 1]);
+
+    // Move the keys in the child
+    for (int i = child->n_keys - 1; i >= 0; --i)
+    {
+        child->keys[i + 1] = child->keys[i];
+        child->records[i + 1] = child->records[i];
+    }
+
+    // If it is not a leaf, it also moves the references to children
+    if (!child->is_leaf)
+    {
+        for (int i = child->n_keys; i >= 0; --i)
+        {
+            child->children[i + 1] = child->children[i];
+        }
+    }
+
+    // Set the parent's key as the child's first key
+    child->keys[0] = n->keys[index - 1];
+    child->records[0] = n->records[index - 1];
+
+    // If it is not a leaf, the last child of the sibling becomes the first child.
+    if (!child->is_leaf)
+    {
+        child->children[0] = sibling->children[sibling->n_keys];
+    }
+
+    // The sibling's last key goes to the parent
+    n->keys[index - 1] = sibling->keys[sibling->n_keys - 1];
+    n->records[index - 1] = sibling->records[sibling->n_keys - 1];
+
+    // Update amount of keys
+    child->n_keys++;
+    sibling->n_keys--;
+
+    // Write nodes in the binary file
+    disk_write(bt, n);
+    child_write(bt, child);
+    child_write(bt, sibling);
+
+    node_destroy(child);
+    node_destroy(sibling);
+}
+
+/**
+ * @brief Get a key from next node
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param index
+ */
+void borrow_from_next(BTree *bt, Node *n, int index)
+{
+    op_event(bt, TRACE_BORROW, n->children[index], op_depth + 1);
+
+    Node *child = child_read(bt, n->children[index]);
+    Node *sibling = child_read(bt, n->children[index + 1]);
+
+    // The parent's key goes to the child's end
+    child->keys[child->n_keys] = n->keys[index];
+    child->records[child->n_keys] = n->records[index];
+
+    // If it is not a leaf, the first child of the sibling becomes the last child.
+    if (!child->is_leaf)
+    {
+        child->children[child->n_keys + 1] = sibling->children[0];
+    }
+
+    // The sibling's first key goes to the parent
+    n->keys[index] = sibling->keys[0];
+    n->records[index] = sibling->records[0];
+
+    // Move the keys to the sibling
+    for (int i = 1; i < sibling->n_keys; ++i)
+    {
+        sibling->keys[i - 1] = sibling->keys[i];
+        sibling->records[i - 1] = sibling->records[i];
+    }
+
+    // If it is not a leaf, it also moves the references to children
+    if (!sibling->is_leaf)
+    {
+        for (int i = 1; i <= sibling->n_keys; ++i)
+        {
+            sibling->children[i - 1] = sibling->children[i];
+        }
+    }
+
+    // Update amount of keys
+    child->n_keys++;
+    sibling->n_keys--;
+
+    // Write nodes in the binary file
+    disk_write(bt, n);
+    child_write(bt, child);
+    child_write(bt, sibling);
+
+    node_destroy(child);
+    node_destroy(sibling);
+}
+
+/**
+ * @brief Print the keys of a node
+ *
+ * @param Node* n
+ * @param FILE* fp
+ */
+static void print_keys(Node *n, FILE *fp)
+{
+    if (n->n_keys > 0)
+    {
+        fprintf(fp, "[");
+        for (int j = 0; j < n->n_keys; j++)
+            fprintf(fp, "key: %d, ", n->keys[j]);
+        fprintf(fp, "]");
+    }
+}
+
+/**
+ * @brief Print the levels of a tree with a queue of the positions of the nodes
+ *
+ * The queue holds only the positions of the nodes, each page is read when
+ * its node is dequeued
+ *
+ * @param BTree* bt
+ * @param BTreeSnapshot* s NULL prints the current tree
+ * @param int root position of the root
+ * @param FILE* fp
+ */
+static void print_levels_queued(BTree *bt, BTreeSnapshot *s, int root, FILE *fp)
+{
+    // Create a queue to make level-order traversal
+    Queue *q = queue_create();
+
+    // Enqueue root
+    queue_enqueue(q, root);
+
+    while (!queue_is_empty(q))
+    {
+        // Get the number of nodes at the current level
+        int level_size = queue_get_size(q);
+
+        // Process each node at the current level
+        for (int i = 0; i < level_size; i++)
+        {
+            // Ask for a node further in the queue, then dequeue the current node and read it
+            int ahead = queue_peek(q, BTREE_PREFETCH_DISTANCE);
+            if (ahead != -1)
+                source_prefetch(bt, s, ahead);
+
+            Node *curr = source_fetch(bt, s, queue_dequeue(q));
+
+            print_keys(curr, fp);
+
+            // If the node is not a leaf, enqueue its children for the next level
+            if (!curr->is_leaf)
+            {
+                for (int j = 0; j <= curr->n_keys; j++)
+                    queue_enqueue(q, curr->children[j]);
+            }
+
+            source_release(bt, s, curr);
+        }
+        fprintf(fp, "\n");
+    }
+
+    // Destroy the queue
+    queue_destroy(q);
+}
+
+/**
+ * @brief Print the levels of a tree keeping the positions of each level in spills
+ *
+ * A level is read in chunks while the positions of the next one are pushed
+ * behind it, both spilling to temporary files under the memory limit
+ *
+ * @param BTree* bt
+ * @param BTreeSnapshot* s NULL prints the current tree
+ * @param int root position of the root
+ * @param FILE* fp
+ */
+static void print_levels_spilled(BTree *bt, BTreeSnapshot *s, int root, FILE *fp)
+{
+    Spill *level = spill_create(sizeof(int), memory_budget(bt, 4), bt->path);
+    Spill *next = spill_create(sizeof(int), memory_budget(bt, 4), bt->path);
+    int chunk[BTREE_EXPORT_BATCH];
+
+    spill_push(level, &root, 1);
+
+    while (spill_count(level) > 0)
+    {
+        long got;
+
+        spill_rewind(level);
+        while ((got = spill_read(level, chunk, BTREE_EXPORT_BATCH)) > 0)
+        {
+            for (long i = 0; i < got; i++)
+            {
+                // Ask for a node further in the chunk, then read the current one
+                if (i + BTREE_PREFETCH_DISTANCE < got)
+                    source_prefetch(bt, s, chunk[i + BTREE_PREFETCH_DISTANCE]);
+
+                Node *curr = source_fetch(bt, s, chunk[i]);
+
+                print_keys(curr, fp);
+
+                // If the node is not a leaf, its children make the next level
+                if (!curr->is_leaf)
+                    spill_push(next, curr->children, curr->n_keys + 1);
+
+                source_release(bt, s, curr);
+            }
+        }
+        fprintf(fp, "\n");
+
+        Spill *tmp = level;
+        level = next;
+        next = tmp;
+        spill_clear(next);
+    }
+
+    spill_destroy(level);
+    spill_destroy(next);
+}
+
+/**
+ * @brief Print the levels of a tree, from the root down, one per line
+ *
+ * Only the positions of the nodes are kept, each page is read when its node
+ * is printed. The positions wait in a queue, or in spills when the tree has a
+ * memory limit, since the widest level may not fit it
+ *
+ * @param BTree* bt
+ * @param BTreeSnapshot* s NULL prints the current tree
+ * @param int root position of the root
+ * @param FILE* fp
+ */
+static void print_levels(BTree *bt, BTreeSnapshot *s, int root, FILE *fp)
+{
+    if (bt->memory_limit)
+        print_levels_spilled(bt, s, root, fp);
+    else
+        print_levels_queued(bt, s, root, fp);
+}
+
+/**
+ * @brief Print B-Tree in level-order
+ *
+ * @param bt
+ */
+void btree_level_order_print(BTree *bt, FILE *fp)
+{
+    if (!bt->root)
+    {
+        return;
+    }
+
+    btree_export(bt, fp, BTREE_EXPORT_TEXT, 0);
+}
+
+/**
+ * @brief Run a function in parallel over "n" arguments, the first one in the calling thread
+ *
+ * @param int n
+ * @param void* (*fn)(void*)
+ * @param void* args vector of n arguments
+ * @param size_t size size of each argument
+ */
+static void parallel_run(int n, void *(*fn)(void *), void *args, size_t size)
+{
+    pthread_t *workers = (pthread_t *)malloc((n > 0 ? n : 1) * sizeof(pthread_t));
+
+    for (int t = 1; t < n; t++)
+        pthread_create(&workers[t], NULL, fn, (char *)args + t * size);
+    if (n > 0)
+        fn(args);
+    for (int t = 1; t < n; t++)
+        pthread_join(workers[t], NULL);
+
+    free(workers);
+}
+
+/**
+ * @brief Get the amount of threads to use, 0 meaning every online CPU
+ *
+ * @param int threads
+ * @return int
+ */
+static int thread_count(int threads)
+{
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    return threads > 0 ? threads : 1;
+}
+
+// Part of a level of the tree exported by a thread
+typedef struct
+{
+    BTree *bt;
+    const int *level;    // Positions of the nodes of the level
+    int first;           // First node of the part
+    int count;           // Amount of nodes of the part
+    int format;          // BTREE_EXPORT_TEXT or BTREE_EXPORT_BINARY
+    char *out;           // The part of the level, formatted
+    size_t out_len;
+    size_t out_cap;
+    int *next;           // Children of the nodes of the part, in order
+    int next_len;
+    int next_cap;
+    PagerReader *reader; // Reader of the pages of the thread
+    NodeCodec codec;     // Codec used by the reader
+    char *run;           // Pages read at once from the file
+} ExportPart;
+
+// Position of a node of the level and its index in the batch
+typedef struct
+{
+    int pos;
+    int index;
+} ExportSlot;
+
+/**
+ * @brief Append bytes to the output of a part
+ *
+ * @param ExportPart* part
+ * @param const void* src
+ * @param size_t size
+ */
+static void export_put(ExportPart *part, const void *src, size_t size)
+{
+    if (part->out_len + size > part->out_cap)
+    {
+        part->out_cap = part->out_cap ? part->out_cap * 2 : 4096;
+        while (part->out_len + size > part->out_cap)
+            part->out_cap *= 2;
+        part->out = (char *)realloc(part->out, part->out_cap);
+    }
+
+    memcpy(part->out + part->out_len, src, size);
+    part->out_len += size;
+}
+
+/**
+ * @brief Append an int as decimal text to the output of a part
+ *
+ * @param ExportPart* part
+ * @param int v
+ */
+static void export_put_int(ExportPart *part, int v)
+{
+    char digits[12];
+    int i = sizeof(digits);
+    uint32_t u = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+
+    do
+    {
+        digits[--i] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+
+    if (v < 0)
+        digits[--i] = '-';
+
+    export_put(part, digits + i, sizeof(digits) - i);
+}
+
+/**
+ * @brief Compare two slots by the position of their nodes
+ *
+ * @param const void* a
+ * @param const void* b
+ * @return int
+ */
+static int export_slot_cmp(const void *a, const void *b)
+{
+    int pa = ((const ExportSlot *)a)->pos;
+    int pb = ((const ExportSlot *)b)->pos;
+
+    return (pa > pb) - (pa < pb);
+}
+
+/**
+ * @brief Format a node of the level and queue its children
+ *
+ * @param ExportPart* part
+ * @param Node* n
+ */
+static void export_node(ExportPart *part, Node *n)
+{
+    BTree *bt = part->bt;
+
+    if (part->format == BTREE_EXPORT_BINARY)
+    {
+        // Internal nodes of a B+-tree don't have records
+        int32_t n_keys = n->n_keys;
+        unsigned char is_leaf = n->is_leaf;
+        export_put(part, &n_keys, sizeof(int32_t));
+        export_put(part, &is_leaf, 1);
+        export_put(part, n->keys, sizeof(int) * n->n_keys);
+        if (n->is_leaf || !(bt->flags & BTREE_PLUS))
+            export_put(part, n->records, sizeof(int) * n->n_keys);
+    }
+    else if (n->n_keys > 0)
+    {
+        export_put(part, "[", 1);
+        for (int j = 0; j < n->n_keys; j++)
+        {
+            export_put(part, "key: ", 5);
+            export_put_int(part, n->keys[j]);
+            export_put(part, ", ", 2);
+        }
+        export_put(part, "]", 1);
+    }
+
+    if (!n->is_leaf)
+    {
+        if (part->next_len + n->n_keys + 1 > part->next_cap)
+        {
+            part->next_cap = part->next_cap ? part->next_cap * 2 : 256;
+            while (part->next_len + n->n_keys + 1 > part->next_cap)
+                part->next_cap *= 2;
+            part->next = (int *)realloc(part->next, part->next_cap * sizeof(int));
+        }
+
+        memcpy(part->next + part->next_len, n->children, sizeof(int) * (n->n_keys + 1));
+        part->next_len += n->n_keys + 1;
+    }
+}
+
+/**
+ * @brief Ask for the pages of the batch of a part starting at "b"
+ *
+ * @param ExportPart* part
+ * @param int b
+ */
+static void export_prefetch(ExportPart *part, int b)
+{
+    int end = part->count - b < BTREE_EXPORT_BATCH ? part->count : b + BTREE_EXPORT_BATCH;
+
+    for (int i = b; i < end; i++)
+        pager_reader_prefetch(part->reader, part->level[part->first + i], 1);
+}
+
+/**
+ * @brief Export a part of a level, reading its pages in batches
+ *
+ * The pages of a batch are sorted by position and read in runs of
+ * consecutive pages, then formatted back in the order of the level
+ *
+ * @param void* arg the ExportPart
+ * @return void*
+ */
+static void *export_part(void *arg)
+{
+    ExportPart *part = (ExportPart *)arg;
+    BTree *bt = part->bt;
+    ExportSlot slots[BTREE_EXPORT_BATCH];
+    Node *nodes[BTREE_EXPORT_BATCH];
+
+    part->out_len = 0;
+    part->next_len = 0;
+
+    export_prefetch(part, 0);
+
+    for (int b = 0; b < part->count; b += BTREE_EXPORT_BATCH)
+    {
+        int amount = part->count - b < BTREE_EXPORT_BATCH ? part->count - b : BTREE_EXPORT_BATCH;
+
+        // The next batch is read ahead while this one is formatted
+        export_prefetch(part, b + BTREE_EXPORT_BATCH);
+
+        for (int i = 0; i < amount; i++)
+        {
+            slots[i].pos = part->level[part->first + b + i];
+            slots[i].index = i;
+        }
+        qsort(slots, amount, sizeof(ExportSlot), export_slot_cmp);
+
+        // Read close pages together, skipping small gaps between them
+        for (int i = 0; i < amount;)
+        {
+            int start = slots[i].pos;
+            int end = i + 1;
+            while (end < amount && slots[end].pos - slots[end - 1].pos <= BTREE_EXPORT_RUN_GAP &&
+                   slots[end].pos - start < BTREE_EXPORT_RUN_PAGES)
+                end++;
+
+            pager_reader_read(part->reader, start, slots[end - 1].pos - start + 1, part->run);
+
+            for (; i < end; i++)
+                nodes[slots[i].index] = node_decode(bt, part->run + (size_t)(slots[i].pos - start) * bt->stride, slots[i].pos);
+        }
+
+        for (int i = 0; i < amount; i++)
+        {
+            export_node(part, nodes[i]);
+            node_destroy(nodes[i]);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Get the bytes an exported node takes until its chunk is written
+ *
+ * Its children are kept for the next level and its keys are formatted, at
+ * most 20 chars each
+ *
+ * @param BTree* bt
+ * @return size_t
+ */
+static size_t export_node_bytes(BTree *bt)
+{
+    return (size_t)bt->inner_order * (sizeof(int) + 20);
+}
+
+/**
+ * @brief Write the whole tree to a file, level by level
+ *
+ * The nodes of a level are split among threads, each one reading its pages
+ * and formatting them to its own buffer; the buffers are written in order, so
+ * the text is the same of a serial walk. The binary format has a header
+ * ("BTEX", version, order and flags), then each level as its amount of nodes
+ * followed by the nodes (n_keys, is_leaf, keys and records, internal nodes of
+ * a B+-tree without records), ending with an empty level
+ *
+ * A tree with copy-on-write pages is exported from a snapshot, so the writers
+ * go on meanwhile; any other tree is locked until the export ends
+ *
+ * @param BTree* bt
+ * @param FILE* fp
+ * @param int format BTREE_EXPORT_TEXT or BTREE_EXPORT_BINARY
+ * @param int threads 0 uses every online CPU
+ */
+void btree_export(BTree *bt, FILE *fp, int format, int threads)
+{
+    threads = thread_count(threads);
+
+    // The pages aren't written while the tree is exported without a snapshot
+    BTreeSnapshot *s = btree_snapshot_acquire(bt);
+    if (!s)
+        pthread_mutex_lock(&bt->lock);
+
+    if (format == BTREE_EXPORT_BINARY)
+    {
+        int32_t header[3] = {1, bt->order, bt->flags & BTREE_PLUS};
+        fwrite("BTEX", 1, 4, fp);
+        fwrite(header, sizeof(int32_t), 3, fp);
+    }
+
+    ExportPart *parts = (ExportPart *)calloc(threads, sizeof(ExportPart));
+    for (int t = 0; t < threads; t++)
+    {
+        parts[t].bt = bt;
+        parts[t].format = format;
+        parts[t].codec.bt = bt;
+        if (bt->flags & BTREE_COMPRESS)
+            parts[t].codec.scratch = (int *)malloc(2 * (bt->order - 1) * sizeof(int));
+        parts[t].reader = s ? pager_view_reader_create(s->view, &parts[t].codec) : pager_reader_create(bt->pager, &parts[t].codec);
+        parts[t].run = (char *)malloc(BTREE_EXPORT_RUN_PAGES * bt->stride);
+    }
+
+    // A level is exported in chunks that fit the memory limit, the positions of
+    // the next one are pushed behind it
+    Spill *level = spill_create(sizeof(int), memory_budget(bt, 4), bt->path);
+    Spill *next = spill_create(sizeof(int), memory_budget(bt, 4), bt->path);
+    long chunk = bt->memory_limit ? (long)(memory_budget(bt, 4) / export_node_bytes(bt)) : LONG_MAX;
+    if (chunk < BTREE_EXPORT_BATCH)
+        chunk = BTREE_EXPORT_BATCH;
+    int *chunk_pos = NULL;
+
+    int root = s ? s->root : bt->root ? bt->root->b_position : -1;
+    if (root >= 0)
+        spill_push(level, &root, 1);
+
+    while (spill_count(level) > 0)
+    {
+        long level_size = spill_count(level);
+        long got;
+
+        if (format == BTREE_EXPORT_BINARY)
+        {
+            int32_t amount = (int32_t)level_size;
+            fwrite(&amount, sizeof(int32_t), 1, fp);
+        }
+
+        chunk_pos = (int *)realloc(chunk_pos, (level_size < chunk ? level_size : chunk) * sizeof(int));
+        spill_rewind(level);
+
+        while ((got = spill_read(level, chunk_pos, chunk)) > 0)
+        {
+            // Small chunks aren't worth a thread
+            int used = (int)((got + BTREE_EXPORT_MIN_PART - 1) / BTREE_EXPORT_MIN_PART);
+            if (used > threads)
+                used = threads;
+
+            for (int t = 0; t < used; t++)
+            {
+                parts[t].level = chunk_pos;
+                parts[t].first = (int)(got * t / used);
+                parts[t].count = (int)(got * (t + 1) / used) - parts[t].first;
+            }
+
+            parallel_run(used, export_part, parts, sizeof(ExportPart));
+
+            // Stitch the parts together, in the order of the level
+            for (int t = 0; t < used; t++)
+            {
+                fwrite(parts[t].out, 1, parts[t].out_len, fp);
+                spill_push(next, parts[t].next, parts[t].next_len);
+            }
+        }
+
+        if (format == BTREE_EXPORT_TEXT)
+            fputc('\n', fp);
+
+        Spill *tmp = level;
+        level = next;
+        next = tmp;
+        spill_clear(next);
+    }
+
+    if (format == BTREE_EXPORT_BINARY)
+    {
+        int32_t end = 0;
+        fwrite(&end, sizeof(int32_t), 1, fp);
+    }
+
+    for (int t = 0; t < threads; t++)
+    {
+        pager_reader_destroy(parts[t].reader);
+        free(parts[t].codec.scratch);
+        free(parts[t].run);
+        free(parts[t].out);
+        free(parts[t].next);
+    }
+
+    if (s)
+        btree_snapshot_release(s);
+    else
+        pthread_mutex_unlock(&bt->lock);
+    free(parts);
+    free(chunk_pos);
+    spill_destroy(level);
+    spill_destroy(next);
+}
+
+// Pair of the input of a bulk load and its place in the input, so the last one of a key wins
+typedef struct
+{
+    int key;
+    int record;
+    long seq;
+} BulkItem;
+
+// Vector of pairs, filled by a thread
+typedef struct
+{
+    BulkItem *items;
+    long n;
+    long cap;
+    const char *begin; // Part of the input parsed by the thread
+    const char *end;
+} BulkPart;
+
+// Merge of two sorted runs of pairs, done by a thread
+typedef struct
+{
+    const BulkItem *src;
+    BulkItem *dst;
+    long lo;
+    long mid;
+    long hi;
+} BulkMerge;
+
+// Leaves of a window filled by a thread
+typedef struct
+{
+    BTree *bt;
+    const BulkItem *items; // Pairs of the window
+    long offset;    // Place of the first pair of the window among all of them
+    Node **nodes;   // Nodes of the window
+    long first;     // First leaf of the thread
+    long count;     // Amount of leaves of the thread
+    long window;    // First leaf of the window
+    long leaves;    // Amount of leaves of the level
+    long base;      // Amount of keys of every leaf, the first "extra" ones have one more
+    long extra;
+    int first_pos;  // Position of the first leaf
+} BulkLeaves;
+
+/**
+ * @brief Compare two pairs by key and then by place in the input
+ *
+ * @param const void* a
+ * @param const void* b
+ * @return int
+ */
+static int bulk_item_cmp(const void *a, const void *b)
+{
+    const BulkItem *x = (const BulkItem *)a;
+    const BulkItem *y = (const BulkItem *)b;
+
+    if (x->key != y->key)
+        return (x->key > y->key) - (x->key < y->key);
+
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/**
+ * @brief Sort the pairs of a part
+ *
+ * @param void* arg the BulkPart
+ * @return void*
+ */
+static void *bulk_sort_part(void *arg)
+{
+    BulkPart *part = (BulkPart *)arg;
+
+    qsort(part->items, part->n, sizeof(BulkItem), bulk_item_cmp);
+
+    return NULL;
+}
+
+/**
+ * @brief Merge two sorted runs of pairs
+ *
+ * @param void* arg the BulkMerge
+ * @return void*
+ */
+static void *bulk_merge(void *arg)
+{
+    BulkMerge *m = (BulkMerge *)arg;
+    long i = m->lo, j = m->mid, k = m->lo;
+
+    while (i < m->mid && j < m->hi)
+        m->dst[k++] = bulk_item_cmp(&m->src[j], &m->src[i]) < 0 ? m->src[j++] : m->src[i++];
+    while (i < m->mid)
+        m->dst[k++] = m->src[i++];
+    while (j < m->hi)
+        m->dst[k++] = m->src[j++];
+
+    return NULL;
+}
+
+/**
+ * @brief Sort pairs in parallel: every thread sorts a run, then pairs of runs are merged in rounds
+ *
+ * @param BulkItem* items
+ * @param long n
+ * @param int threads
+ */
+static void bulk_sort(BulkItem *items, long n, int threads)
+{
+    if (n < BTREE_BULK_MIN_PART * threads)
+        threads = n / BTREE_BULK_MIN_PART + 1;
+
+    long *bound = (long *)malloc((threads + 1) * sizeof(long));
+    BulkPart *parts = (BulkPart *)calloc(threads, sizeof(BulkPart));
+    for (int t = 0; t <= threads; t++)
+        bound[t] = n * t / threads;
+    for (int t = 0; t < threads; t++)
+    {
+        parts[t].items = items + bound[t];
+        parts[t].n = bound[t + 1] - bound[t];
+    }
+    parallel_run(threads, bulk_sort_part, parts, sizeof(BulkPart));
+    free(parts);
+
+    // Merge runs two by two until one is left
+    BulkItem *src = items;
+    BulkItem *dst = (BulkItem *)malloc((n ? n : 1) * sizeof(BulkItem));
+    BulkMerge *merges = (BulkMerge *)malloc(threads * sizeof(BulkMerge));
+    int runs = threads;
+
+    while (runs > 1)
+    {
+        int used = 0;
+        for (int r = 0; r < runs; r += 2)
+        {
+            merges[used].src = src;
+            merges[used].dst = dst;
+            merges[used].lo = bound[r];
+            merges[used].mid = bound[r + 1];
+            merges[used].hi = bound[r + 2 <= runs ? r + 2 : r + 1];
+            bound[used] = bound[r];
+            used++;
+        }
+        bound[used] = n;
+        parallel_run(used, bulk_merge, merges, sizeof(BulkMerge));
+
+        BulkItem *tmp = src;
+        src = dst;
+        dst = tmp;
+        runs = used;
+    }
+
+    if (src != items)
+        memcpy(items, src, n * sizeof(BulkItem));
+    free(src == items ? dst : src);
+    free(merges);
+    free(bound);
+}
+
+/**
+ * @brief Parse the lines "key, record" of a part of the input, skipping the ones that aren't pairs
+ *
+ * @param void* arg the BulkPart
+ * @return void*
+ */
+static void *bulk_parse(void *arg)
+{
+    BulkPart *part = (BulkPart *)arg;
+    const char *p = part->begin;
+
+    while (p < part->end)
+    {
+        const char *eol = memchr(p, '\n', part->end - p);
+        if (!eol)
+            eol = part->end;
+
+        char *e;
+        long key = strtol(p, &e, 10);
+        bool ok = e != p && e <= eol;
+
+        // The record comes after blanks or a comma, on the same line
+        p = e;
+        while (p < eol && (*p == ' ' || *p == '\t' || *p == ','))
+            p++;
+        long record = strtol(p, &e, 10);
+        ok = ok && e != p && e <= eol;
+
+        if (ok)
+        {
+            if (part->n == part->cap)
+            {
+                part->cap = part->cap ? part->cap * 2 : 1024;
+                part->items = (BulkItem *)realloc(part->items, part->cap * sizeof(BulkItem));
+            }
+            part->items[part->n].key = (int)key;
+            part->items[part->n].record = (int)record;
+            part->n++;
+        }
+
+        p = eol + 1;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Get the first pair of a leaf of the level built by a bulk load
+ *
+ * Leaves of the classic mode are separated by a pair that goes up to their parent
+ *
+ * @param BulkLeaves* b
+ * @param long i
+ * @return long
+ */
+static long bulk_leaf_start(BulkLeaves *b, long i)
+{
+    long start = i * b->base + (i < b->extra ? i : b->extra);
+
+    if (!(b->bt->flags & BTREE_PLUS))
+        start += i;
+
+    return start;
+}
+
+/**
+ * @brief Fill the leaves of a thread in the current window
+ *
+ * @param void* arg the BulkLeaves
+ * @return void*
+ */
+static void *bulk_fill_leaves(void *arg)
+{
+    BulkLeaves *b = (BulkLeaves *)arg;
+
+    for (long i = b->first; i < b->first + b->count; i++)
+    {
+        Node *n = node_create(b->bt, true, b->first_pos + (int)i);
+        long start = bulk_leaf_start(b, i) - b->offset;
+
+        n->n_keys = (int)(b->base + (i < b->extra));
+        for (int j = 0; j < n->n_keys; j++)
+        {
+            n->keys[j] = b->items[start + j].key;
+            n->records[j] = b->items[start + j].record;
+        }
+
+        // Leaves of a B+-tree are linked to their right sibling
+        if ((b->bt->flags & BTREE_PLUS) && i + 1 < b->leaves)
+            n->next = n->b_position + 1;
+
+        b->nodes[i - b->window] = n;
+    }
+
+    return NULL;
+}
+
+// Pairs of a bulk build, taken in order from a vector or from a sequence
+typedef struct
+{
+    const BulkItem *items; // Vector of the pairs, NULL if they are read from "spill"
+    Spill *spill;
+    BulkItem *buf;         // Pairs read from the sequence
+    long buf_cap;
+} BulkSource;
+
+/**
+ * @brief Take the next pairs of a source
+ *
+ * @param BulkSource* src
+ * @param long count
+ * @return const BulkItem* valid until the next pairs are taken
+ */
+static const BulkItem *bulk_source_take(BulkSource *src, long count)
+{
+    if (src->items)
+    {
+        src->items += count;
+        return src->items - count;
+    }
+
+    if (count > src->buf_cap)
+    {
+        src->buf_cap = count;
+        src->buf = (BulkItem *)realloc(src->buf, count * sizeof(BulkItem));
+    }
+    spill_read(src->spill, src->buf, count);
+
+    return src->buf;
+}
+
+/**
+ * @brief Build the tree bottom-up from sorted pairs without repeated keys
+ *
+ * Nodes are packed full and the keys spread evenly, so none of them gets
+ * below the minimum. The leaves are filled in parallel, window by window, and
+ * written in order of position; internal levels group the nodes below them,
+ * taking the separators between the groups up to the next level. The pairs
+ * are only read once, in order, and the levels are kept in sequences that
+ * spill to temporary files under the memory limit
+ *
+ * @param BTree* bt
+ * @param BulkSource* src
+ * @param long n
+ * @param int threads
+ */
+static void bulk_build(BTree *bt, BulkSource *src, long n, int threads)
+{
+    bool plus = bt->flags & BTREE_PLUS;
+    long max_keys = bt->order - 1;
+
+    if (n == 0)
+        return;
+
+    // Classic leaves give a key to their parent, B+-tree ones a copy
+    long leaves = plus ? (n + max_keys - 1) / max_keys : (n + 1 + max_keys) / (max_keys + 1);
+    long in_leaves = plus ? n : n - (leaves - 1);
+
+    // Fewer leaves are filled at once when their nodes and pairs don't fit the memory limit
+    long window = BTREE_BULK_WINDOW;
+    if (bt->memory_limit)
+    {
+        long fit = (long)(memory_budget(bt, 4) / (bt->block + (max_keys + 1) * sizeof(BulkItem)));
+        if (fit < window)
+            window = fit > 0 ? fit : 1;
+    }
+
+    BulkLeaves *parts = (BulkLeaves *)calloc(threads, sizeof(BulkLeaves));
+    Node **nodes = (Node **)malloc(window * sizeof(Node *));
+    int first_pos = pager_alloc_run(bt->pager, (int)leaves);
+
+    for (int t = 0; t < threads; t++)
+    {
+        parts[t].bt = bt;
+        parts[t].nodes = nodes;
+        parts[t].leaves = leaves;
+        parts[t].base = in_leaves / leaves;
+        parts[t].extra = in_leaves % leaves;
+        parts[t].first_pos = first_pos;
+    }
+
+    // Positions of the nodes of the level and the separators between them
+    Spill *pos = spill_create(sizeof(int), memory_budget(bt, 8), bt->path);
+    Spill *seps = spill_create(sizeof(BulkItem), memory_budget(bt, 8), bt->path);
+
+    for (long w = 0; w < leaves; w += window)
+    {
+        long amount = leaves - w < window ? leaves - w : window;
+        int used = (int)((amount + BTREE_BULK_MIN_LEAVES - 1) / BTREE_BULK_MIN_LEAVES);
+        if (used > threads)
+            used = threads;
+
+        // Pairs of the leaves of the window and, in the classic mode, the ones between them
+        long start = bulk_leaf_start(&parts[0], w);
+        long end = w + amount < leaves ? bulk_leaf_start(&parts[0], w + amount) : n;
+        const BulkItem *items = bulk_source_take(src, end - start);
+
+        for (int t = 0; t < used; t++)
+        {
+            parts[t].items = items;
+            parts[t].offset = start;
+            parts[t].window = w;
+            parts[t].first = w + amount * t / used;
+            parts[t].count = w + amount * (t + 1) / used - parts[t].first;
+        }
+        parallel_run(used, bulk_fill_leaves, parts, sizeof(BulkLeaves));
+
+        for (long i = 0; i < amount; i++)
+        {
+            // A B+-tree leaf gives a copy of its first key, a classic one the pair after it
+            long leaf = w + i;
+            if (plus && leaf > 0)
+                spill_push(seps, &items[bulk_leaf_start(&parts[0], leaf) - start], 1);
+            if (!plus && leaf + 1 < leaves)
+                spill_push(seps, &items[bulk_leaf_start(&parts[0], leaf + 1) - 1 - start], 1);
+
+            spill_push(pos, &nodes[i]->b_position, 1);
+            disk_write(bt, nodes[i]);
+            node_destroy(nodes[i]);
+        }
+    }
+
+    long max_children = plus ? bt->inner_order : bt->order;
+    long level_size = leaves;
+    Spill *up_pos = spill_create(sizeof(int), memory_budget(bt, 8), bt->path);
+    Spill *up_seps = spill_create(sizeof(BulkItem), memory_budget(bt, 8), bt->path);
+
+    while (level_size > 1)
+    {
+        long groups = (level_size + max_children - 1) / max_children;
+        long base = level_size / groups;
+        long extra = level_size % groups;
+        BulkItem sep;
+
+        spill_rewind(pos);
+        spill_rewind(seps);
+
+        for (long g = 0; g < groups; g++)
+        {
+            Node *x = node_create(bt, false, pager_alloc(bt->pager));
+            long children = base + (g < extra);
+
+            x->n_keys = (int)(children - 1);
+            spill_read(pos, x->children, children);
+            for (long j = 0; j + 1 < children; j++)
+            {
+                spill_read(seps, &sep, 1);
+                x->keys[j] = sep.key;
+                if (!plus)
+                    x->records[j] = sep.record;
+            }
+            disk_write(bt, x);
+
+            // The separator after the group goes up
+            spill_push(up_pos, &x->b_position, 1);
+            if (g + 1 < groups)
+            {
+                spill_read(seps, &sep, 1);
+                spill_push(up_seps, &sep, 1);
+            }
+            node_destroy(x);
+        }
+
+        Spill *tmp = pos;
+        pos = up_pos;
+        up_pos = tmp;
+        tmp = seps;
+        seps = up_seps;
+        up_seps = tmp;
+        spill_clear(up_pos);
+        spill_clear(up_seps);
+
+        level_size = groups;
+    }
+
+    int root;
+    spill_rewind(pos);
+    spill_read(pos, &root, 1);
+    bt->root = disk_read(bt, root);
+
+    spill_destroy(pos);
+    spill_destroy(seps);
+    spill_destroy(up_pos);
+    spill_destroy(up_seps);
+    free(nodes);
+    free(parts);
+}
+
+/**
+ * @brief Sort, remove repeated keys and load pairs to the tree
+ *
+ * With BTREE_DUPLICATES the records of a repeated key go to its list when
+ * the tree is empty, or are inserted one by one otherwise
+ *
+ * @param BTree* bt
+ * @param BulkItem* items
+ * @param long n
+ * @param int threads
+ */
+static void bulk_load_items(BTree *bt, BulkItem *items, long n, int threads)
+{
+    bulk_sort(items, n, threads);
+
+    // Keep the last pair of each key, or every record of it with duplicates
+    long kept = 0;
+    for (long i = 0; i < n; i++)
+    {
+        if (bt->postings)
+        {
+            if (!slot_record_valid(bt, items[i].record))
+                continue;
+            if (!bt->root && kept && items[kept - 1].key == items[i].key)
+            {
+                items[kept - 1].record = postings_add(bt->postings, items[kept - 1].record, items[i].record);
+                continue;
+            }
+        }
+        else if (i + 1 < n && items[i + 1].key == items[i].key)
+        {
+            continue;
+        }
+        items[kept++] = items[i];
+    }
+
+    if (bt->root)
+    {
+        for (long i = 0; i < kept; i++)
+            btree_insert(bt, items[i].key, items[i].record);
+        return;
+    }
+
+    BulkSource src = {items, NULL, NULL, 0};
+    pthread_mutex_lock(&bt->lock);
+    bulk_build(bt, &src, kept, threads);
+    if (bt->filter)
+        filter_rebuild(bt, kept > BTREE_BLOOM_KEYS ? 2 * kept : BTREE_BLOOM_KEYS);
+    if (bt->index)
+        index_rebuild(bt);
+    pthread_mutex_unlock(&bt->lock);
+}
+
+// Pairs of a bulk load under the memory limit, sorted in runs that are kept in temporary files
+typedef struct
+{
+    BTree *bt;
+    int threads;
+    BulkItem *items; // Pairs of the run being filled
+    long n;
+    long cap;
+    long seq;        // Place in the input of the next pair
+    Spill **runs;    // Runs already sorted
+    int *tiers;      // Merges that made each run, runs of a tier are merged together
+    int amount;
+} BulkRuns;
+
+// Run being merged and the pairs read from it
+typedef struct
+{
+    Spill *run;
+    BulkItem *buf;
+    long len;
+    long at;
+} BulkCursor;
+
+/**
+ * @brief Start the runs of a bulk load, each one as large as the memory limit allows
+ *
+ * @param BulkRuns* r
+ * @param BTree* bt
+ * @param int threads
+ */
+static void bulk_runs_init(BulkRuns *r, BTree *bt, int threads)
+{
+    memset(r, 0, sizeof(BulkRuns));
+    r->bt = bt;
+    r->threads = threads;
+
+    // The sort takes as much memory again for its merges
+    r->cap = (long)(memory_budget(bt, 4) / sizeof(BulkItem));
+    if (r->cap < 1)
+        r->cap = 1;
+    r->items = (BulkItem *)malloc(r->cap * sizeof(BulkItem));
+}
+
+/**
+ * @brief Read the next pairs of a run being merged
+ *
+ * @param BulkCursor* c
+ * @param long block
+ * @return true
+ * @return false the run is over
+ */
+static bool bulk_cursor_fill(BulkCursor *c, long block)
+{
+    c->len = spill_read(c->run, c->buf, block);
+    c->at = 0;
+
+    return c->len > 0;
+}
+
+/**
+ * @brief Move a run down the heap of the merge until its next pair is in order
+ *
+ * @param BulkCursor* cursors
+ * @param int* heap
+ * @param int size
+ * @param int i
+ */
+static void bulk_heap_down(BulkCursor *cursors, int *heap, int size, int i)
+{
+    while (2 * i + 1 < size)
+    {
+        int c = 2 * i + 1;
+        if (c + 1 < size && bulk_item_cmp(&cursors[heap[c + 1]].buf[cursors[heap[c + 1]].at],
+                                          &cursors[heap[c]].buf[cursors[heap[c]].at]) < 0)
+            c++;
+        if (bulk_item_cmp(&cursors[heap[c]].buf[cursors[heap[c]].at], &cursors[heap[i]].buf[cursors[heap[i]].at]) >= 0)
+            break;
+
+        int tmp = heap[i];
+        heap[i] = heap[c];
+        heap[c] = tmp;
+        i = c;
+    }
+}
+
+/**
+ * @brief Merge the last sorted runs in one pass, keeping the last pair of each key
+ *
+ * With BTREE_DUPLICATES every pair is kept, until the last merge for an
+ * empty tree gathers the records of each key in its list
+ *
+ * @param BulkRuns* r
+ * @param int first first run merged, the ones after it are merged too and freed
+ * @param Spill* out receives the pairs, sorted and without repeated keys
+ * @param bool last_merge the merge gives the pairs that are loaded
+ */
+static void bulk_runs_merge(BulkRuns *r, int first, Spill *out, bool last_merge)
+{
+    Postings *postings = r->bt->postings;
+    bool gather = postings && last_merge && !r->bt->root;
+
+    int ways = r->amount - first;
+
+    // The memory of the runs is shared by the pairs read from each one
+    long block = (long)(memory_budget(r->bt, 4) / sizeof(BulkItem) / ways);
+    if (block < 1)
+        block = 1;
+
+    BulkCursor *cursors = (BulkCursor *)calloc(ways, sizeof(BulkCursor));
+    int *heap = (int *)malloc(ways * sizeof(int));
+    int size = 0;
+
+    for (int i = 0; i < ways; i++)
+    {
+        cursors[i].run = r->runs[first + i];
+        cursors[i].buf = (BulkItem *)malloc(block * sizeof(BulkItem));
+        if (bulk_cursor_fill(&cursors[i], block))
+            heap[size++] = i;
+    }
+    for (int i = size / 2 - 1; i >= 0; i--)
+        bulk_heap_down(cursors, heap, size, i);
+
+    BulkItem last;
+    bool have = false;
+
+    while (size > 0)
+    {
+        BulkCursor *c = &cursors[heap[0]];
+
+        // Pairs of a key come in the order of the input, the last one wins
+        BulkItem *item = &c->buf[c->at];
+        if (gather && have && item->key == last.key)
+        {
+            last.record = postings_add(postings, last.record, item->record);
+        }
+        else
+        {
+            if (have && (item->key != last.key || postings))
+                spill_push(out, &last, 1);
+            last = *item;
+        }
+        have = true;
+
+        if (++c->at == c->len && !bulk_cursor_fill(c, block))
+            heap[0] = heap[--size];
+        bulk_heap_down(cursors, heap, size, 0);
+    }
+    if (have)
+        spill_push(out, &last, 1);
+
+    for (int i = 0; i < ways; i++)
+    {
+        free(cursors[i].buf);
+        spill_destroy(r->runs[first + i]);
+    }
+    free(cursors);
+    free(heap);
+
+    r->amount = first;
+}
+
+/**
+ * @brief Keep a sorted run of pairs
+ *
+ * Runs are merged in tiers of BTREE_BULK_MERGE_WAYS, so few files are open at
+ * once and every pair is merged a logarithmic amount of times
+ *
+ * @param BulkRuns* r
+ * @param Spill* run
+ * @param int tier
+ */
+static void bulk_runs_keep(BulkRuns *r, Spill *run, int tier)
+{
+    spill_rewind(run);
+
+    r->runs = (Spill **)realloc(r->runs, (r->amount + 1) * sizeof(Spill *));
+    r->tiers = (int *)realloc(r->tiers, (r->amount + 1) * sizeof(int));
+    r->runs[r->amount] = run;
+    r->tiers[r->amount] = tier;
+    r->amount++;
+
+    // Tiers only go down along the runs, the last ones are the newest
+    int first = r->amount - BTREE_BULK_MERGE_WAYS;
+    if (first >= 0 && r->tiers[first] == tier)
+    {
+        Spill *merged = spill_create(sizeof(BulkItem), 0, r->bt->path);
+        bulk_runs_merge(r, first, merged, false);
+        bulk_runs_keep(r, merged, tier + 1);
+    }
+}
+
+/**
+ * @brief Sort the run being filled and move it to a temporary file
+ *
+ * @param BulkRuns* r
+ */
+static void bulk_runs_flush(BulkRuns *r)
+{
+    if (!r->n)
+        return;
+
+    bulk_sort(r->items, r->n, r->threads);
+
+    Spill *run = spill_create(sizeof(BulkItem), 0, r->bt->path);
+    spill_push(run, r->items, r->n);
+    r->n = 0;
+
+    bulk_runs_keep(r, run, 0);
+}
+
+/**
+ * @brief Add a pair to the runs of a bulk load
+ *
+ * @param BulkRuns* r
+ * @param int key
+ * @param int record
+ */
+static void bulk_runs_add(BulkRuns *r, int key, int record)
+{
+    if (!slot_record_valid(r->bt, record))
+        return;
+
+    if (r->n == r->cap)
+        bulk_runs_flush(r);
+
+    r->items[r->n].key = key;
+    r->items[r->n].record = record;
+    r->items[r->n].seq = r->seq++;
+    r->n++;
+}
+
+/**
+ * @brief Load the pairs of the runs to the tree and free them
+ *
+ * Pairs that fit in a single run are loaded as without the limit; the
+ * others are merged to a sequence read in order by the build, or by the
+ * inserts if the tree isn't empty
+ *
+ * @param BulkRuns* r
+ */
+static void bulk_runs_load(BulkRuns *r)
+{
+    BTree *bt = r->bt;
+
+    if (!r->amount)
+    {
+        bulk_load_items(bt, r->items, r->n, r->threads);
+        free(r->items);
+        return;
+    }
+
+    bulk_runs_flush(r);
+    free(r->items);
+
+    Spill *sorted = spill_create(sizeof(BulkItem), memory_budget(bt, 4), bt->path);
+    bulk_runs_merge(r, 0, sorted, true);
+    free(r->runs);
+    free(r->tiers);
+    spill_rewind(sorted);
+
+    long n = spill_count(sorted);
+    BulkSource src = {NULL, sorted, NULL, 0};
+
+    if (bt->root)
+    {
+        for (long i = 0; i < n; i += BTREE_BULK_WINDOW)
+        {
+            long amount = n - i < BTREE_BULK_WINDOW ? n - i : BTREE_BULK_WINDOW;
+            const BulkItem *items = bulk_source_take(&src, amount);
+            for (long j = 0; j < amount; j++)
+                btree_insert(bt, items[j].key, items[j].record);
+        }
+    }
+    else
+    {
+        pthread_mutex_lock(&bt->lock);
+        bulk_build(bt, &src, n, r->threads);
+        if (bt->filter)
+            filter_rebuild(bt, n > BTREE_BLOOM_KEYS ? 2 * n : BTREE_BLOOM_KEYS);
+        if (bt->index)
+            index_rebuild(bt);
+        pthread_mutex_unlock(&bt->lock);
+    }
+
+    free(src.buf);
+    spill_destroy(sorted);
+}
+
+/**
+ * @brief Load pairs to the tree, using many threads
+ *
+ * The pairs are sorted in parallel and, when a key repeats, the last pair
+ * wins. An empty tree is built bottom-up; otherwise the sorted pairs are
+ * inserted one by one, keeping the keys already in the tree. Under the
+ * memory limit, the pairs are sorted in runs kept in temporary files. With
+ * BTREE_DUPLICATES, every pair is kept and the ones with negative records
+ * are skipped
+ *
+ * @param BTree* bt
+ * @param const int* keys
+ * @param const int* records
+ * @param long n
+ * @param int threads 0 uses every online CPU
+ */
+void btree_bulk_load(BTree *bt, const int *keys, const int *records, long n, int threads)
+{
+    if (bt->memory_limit)
+    {
+        BulkRuns r;
+        bulk_runs_init(&r, bt, thread_count(threads));
+        for (long i = 0; i < n; i++)
+            bulk_runs_add(&r, keys[i], records[i]);
+        bulk_runs_load(&r);
+        return;
+    }
+
+    BulkItem *items = (BulkItem *)malloc((n ? n : 1) * sizeof(BulkItem));
+
+    for (long i = 0; i < n; i++)
+    {
+        items[i].key = keys[i];
+        items[i].record = records[i];
+        items[i].seq = i;
+    }
+
+    bulk_load_items(bt, items, n, thread_count(threads));
+    free(items);
+}
+
+/**
+ * @brief Keep a pair of the tree being rebuilt
+ *
+ * @param int key
+ * @param int record
+ * @param void* ctx the Spill receiving the pairs
+ * @return true
+ */
+static bool rebuild_visit(int key, int record, void *ctx)
+{
+    Spill *all = (Spill *)ctx;
+    BulkItem item = {key, record, spill_count(all)};
+
+    spill_push(all, &item, 1);
+
+    return true;
+}
+
+/**
+ * @brief Move the tree to nodes of another order, rebuilding it bottom-up
+ *
+ * The new tree is built in a file next to the current one, written to the
+ * disk and then renamed over it, so the file always holds a whole tree. The
+ * handle stays valid: the writers wait for the rebuild, and the cache keeps
+ * the same amount of memory. The snapshots read the pages of the old file in
+ * its layout, so the tree isn't rebuilt while any of them is held
+ *
+ * @param BTree* bt
+ * @param int order 0 picks the largest order that fits "page_size"
+ * @param size_t page_size 0 is BTREE_PAGE_SIZE
+ * @return true if rebuilt, false if some snapshot of the tree isn't released
+ */
+bool btree_rebuild(BTree *bt, int order, size_t page_size)
+{
+    pthread_mutex_lock(&bt->lock);
+
+    // Snapshots are taken under the lock, none can start until the rebuild ends
+    if ((bt->flags & BTREE_COW) && pager_view_count(bt->pager) > 0)
+    {
+        pthread_mutex_unlock(&bt->lock);
+        return false;
+    }
+
+    // The scan gives the pairs sorted and without repeated keys. Keys with
+    // many records keep the slot of their list, the lists don't move
+    Spill *all = spill_create(sizeof(BulkItem), memory_budget(bt, 4), bt->path);
+    if (bt->root)
+        scan_tree(bt, NULL, bt->root, INT_MIN, INT_MAX, rebuild_visit, all);
+
+    // Write the old pages back, so the old file is never encoded again, and
+    // keep its storage aside: only its fields are used from now on
+    pager_flush(bt->pager);
+    BTree *old = (BTree *)malloc(sizeof(BTree));
+    memcpy(old, bt, sizeof(BTree));
+
+    char *file = (char *)malloc(strlen(bt->path) + strlen(BTREE_REBUILD_SUFFIX) + 1);
+    strcpy(file, bt->path);
+    strcat(file, BTREE_REBUILD_SUFFIX);
+
+    tree_open(bt, file, order, page_size ? page_size : BTREE_PAGE_SIZE);
+
+    int pages = pager_cache_size(old->pager);
+    if (pages > 0)
+    {
+        pages = (int)((size_t)pages * old->stride / bt->stride);
+        pager_set_cache(bt->pager, pages > 0 ? pages : 1);
+    }
+    else
+    {
+        pager_set_cache(bt->pager, 0);
+    }
+    pager_set_flush_interval(bt->pager, pager_flush_interval(old->pager));
+
+    long n = spill_count(all);
+    BulkSource src = {NULL, all, NULL, 0};
+    spill_rewind(all);
+    bulk_build(bt, &src, n, thread_count(0));
+    if (bt->filter)
+        filter_rebuild(bt, n > BTREE_BLOOM_KEYS ? 2 * n : BTREE_BLOOM_KEYS);
+
+    // The new file replaces the old one only once it is whole on the disk
+    pager_sync(bt->pager);
+    if (rename(file, bt->path) != 0)
+    {
+        perror("The system couldn't replace the binary file.\n");
+        exit(1);
+    }
+
+    if (old->root)
+        node_destroy(old->root);
+    tree_close(old);
+    free(old);
+    free(file);
+    free(src.buf);
+    spill_destroy(all);
+
+    pthread_mutex_unlock(&bt->lock);
+
+    return true;
+}
+
+/**
+ * @brief Parse text in parallel, split in parts that end at the end of a line
+ *
+ * @param const char* text ends with a '\0' after "len" chars
+ * @param size_t len
+ * @param int threads
+ * @return BulkPart* the pairs of each part, in the order of the text
+ */
+static BulkPart *bulk_parse_text(const char *text, size_t len, int threads)
+{
+    BulkPart *parts = (BulkPart *)calloc(threads, sizeof(BulkPart));
+    const char *p = text;
+
+    for (int t = 0; t < threads; t++)
+    {
+        const char *end = text + len * (t + 1) / threads;
+        if (end < p)
+            end = p;
+        while (end < text + len && end > text && end[-1] != '\n')
+            end++;
+
+        parts[t].begin = p;
+        parts[t].end = end;
+        p = end;
+    }
+    parallel_run(threads, bulk_parse, parts, sizeof(BulkPart));
+
+    return parts;
+}
+
+/**
+ * @brief Load the pairs of a text file under the memory limit
+ *
+ * The file is read in chunks that end at the end of a line, and their pairs
+ * are sorted in runs
+ *
+ * @param BTree* bt
+ * @param FILE* fp
+ * @param int threads
+ */
+static void bulk_load_file_runs(BTree *bt, FILE *fp, int threads)
+{
+    BulkRuns r;
+    bulk_runs_init(&r, bt, threads);
+
+    // The pairs of a chunk take about 3 times its size
+    size_t cap = memory_budget(bt, 16);
+    if (cap < BTREE_PAGE_SIZE)
+        cap = BTREE_PAGE_SIZE;
+    char *text = (char *)malloc(cap + 1);
+    size_t len = 0;
+    bool eof = false;
+
+    while (!eof || len > 0)
+    {
+        size_t got = eof ? 0 : fread(text + len, 1, cap - len, fp);
+        len += got;
+        eof = eof || len < cap;
+
+        // The last line of the chunk waits for the next one, unless it fills the whole chunk
+        size_t cut = len;
+        if (!eof)
+        {
+            while (cut > 0 && text[cut - 1] != '\n')
+                cut--;
+            if (cut == 0)
+                cut = len;
+        }
+
+        char keep = text[cut];
+        text[cut] = '\0';
+
+        BulkPart *parts = bulk_parse_text(text, cut, threads);
+        for (int t = 0; t < threads; t++)
+        {
+            for (long i = 0; i < parts[t].n; i++)
+                bulk_runs_add(&r, parts[t].items[i].key, parts[t].items[i].record);
+            free(parts[t].items);
+        }
+        free(parts);
+
+        text[cut] = keep;
+        memmove(text, text + cut, len - cut);
+        len -= cut;
+    }
+
+    free(text);
+    bulk_runs_load(&r);
+}
+
+/**
+ * @brief Load to the tree the pairs of a text file, one "key, record" per line
+ *
+ * The file is read at once and its lines are parsed in parallel, split in
+ * parts at line boundaries. Under the memory limit, it is read in chunks
+ *
+ * @param BTree* bt
+ * @param FILE* fp
+ * @param int threads 0 uses every online CPU
+ */
+void btree_bulk_load_file(BTree *bt, FILE *fp, int threads)
+{
+    threads = thread_count(threads);
+
+    if (bt->memory_limit)
+    {
+        bulk_load_file_runs(bt, fp, threads);
+        return;
+    }
+
+    // Read the whole file
+    size_t len = 0, cap = 1 << 16;
+    char *text = (char *)malloc(cap);
+    size_t got;
+    while ((got = fread(text + len, 1, cap - len, fp)) > 0)
+    {
+        len += got;
+        if (len == cap)
+        {
+            cap *= 2;
+            text = (char *)realloc(text, cap);
+        }
+    }
+    text[len] = '\0';
+
+    BulkPart *parts = bulk_parse_text(text, len, threads);
+
+    // Join the parts in the order of the file
+    long n = 0;
+    for (int t = 0; t < threads; t++)
+        n += parts[t].n;
+
+    BulkItem *items = (BulkItem *)malloc((n ? n : 1) * sizeof(BulkItem));
+    long k = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        for (long i = 0; i < parts[t].n; i++, k++)
+        {
+            items[k] = parts[t].items[i];
+            items[k].seq = k;
+        }
+        free(parts[t].items);
+    }
+    free(parts);
+    free(text);
+
+    bulk_load_items(bt, items, n, threads);
+    free(items);
+}
+
+/**
+ * @brief Find the child of a B+-tree internal node that may hold the key
+ *
+ * A separator sends to its right every key greater than or equal to it
+ *
+ * @param Node* n
+ * @param int key
+ * @return int
+ */
+int bplus_child_index(Node *n, int key)
+{
+    // First separator greater than the key
+    if (key == INT_MAX)
+        return n->n_keys;
+
+    return find_key_index(n, key + 1);
+}
+
+/**
+ * @brief Search a key in the B+-tree, going always down to the leaves
+ *
+ * @param BTree* bt
+ * @param int key
+ * @param int* record if not NULL, receives the record of the key
+ * @return true
+ * @return false
+ */
+bool bplus_search(BTree *bt, int key, int *record)
+{
+    Node *n = bt->root;
+    int depth = op_depth;
+
+    // Go down to the leaf that may hold the key
+    while (!n->is_leaf)
+    {
+        op_depth++;
+        Node *child = node_fetch(bt, n->children[bplus_child_index(n, key)]);
+        node_release(bt, n);
+        n = child;
+    }
+
+    int i = find_key_index(n, key);
+    bool found = i < n->n_keys && n->keys[i] == key;
+
+    if (found && record)
+        *record = n->records[i];
+
+    node_release(bt, n);
+    op_depth = depth;
+
+    return found;
+}
+
+/**
+ * @brief Function to split a full B+-tree node
+ *
+ * A leaf keeps a copy of the first key of its new sibling in the parent and is
+ * linked to it; an internal node moves its median key up
+ *
+ * @param Btree* bt
+ * @param Node* x
+ * @param Node* y
+ * @param int i
+ */
+void bplus_split_child(BTree *bt, Node *x, Node *y, int i)
+{
+    Node *z = node_create(bt, y->is_leaf, pager_alloc(bt->pager));
+    int separator;
+
+    if (y->is_leaf)
+    {
+        // Copy the second half of y's keys and records to z
+        int t = (bt->order - 1) / 2;
+
+        z->n_keys = (bt->order - 1) - t;
+        for (int j = 0; j < z->n_keys; j++)
+        {
+            z->keys[j] = y->keys[j + t];
+            z->records[j] = y->records[j + t];
+        }
+        y->n_keys = t;
+
+        // Link the leaves
+        z->next = y->next;
+        y->next = z->b_position;
+
+        separator = z->keys[0];
+    }
+    else
+    {
+        // Copy the keys and children after the median to z
+        int t = (bt->inner_order - 1) / 2;
+
+        z->n_keys = (bt->inner_order - 1) - t - 1;
+        for (int j = 0; j < z->n_keys; j++)
+            z->keys[j] = y->keys[j + t + 1];
+        for (int j = 0; j <= z->n_keys; j++)
+            z->children[j] = y->children[j + t + 1];
+        y->n_keys = t;
+
+        separator = y->keys[t];
+    }
+
+    // Shift x's keys and children to make space for z
+    for (int j = x->n_keys; j > i; j--)
+    {
+        x->children[j + 1] = x->children[j];
+    }
+    for (int j = x->n_keys - 1; j >= i; j--)
+    {
+        x->keys[j + 1] = x->keys[j];
+    }
+
+    x->children[i + 1] = z->b_position;
+    x->keys[i] = separator;
+    x->n_keys++;
+
+    // Write nodes in the binary file
+    disk_write(bt, x);
+    child_write(bt, y);
+    child_write(bt, z);
+
+    node_destroy(y);
+    node_destroy(z);
+}
+
+/**
+ * @brief Insert a key in the B+-tree if node isn't full
+ *
+ * @param BTree* bt
+ * @param Node* node
+ * @param int key
+ * @param int record
+ */
+void bplus_insert_non_full(BTree *bt, Node *node, int key, int record)
+{
+    if (node->is_leaf)
+    {
+        int i = node->n_keys - 1;
+
+        // Shift keys and records to make space for the new key
+        while (i >= 0 && key < node->keys[i])
+        {
+            node->keys[i + 1] = node->keys[i];
+            node->records[i + 1] = node->records[i];
+            i--;
+        }
+
+        // Insert the key and record
+        node->keys[i + 1] = key;
+        node->records[i + 1] = record;
+        node->n_keys++;
+        disk_write(bt, node);
         return;
     }
 
-    // Case 2b: if node y doesn't have the minimum amount of node, get the successor of a key in node z
-    Node *child_right = disk_read(bt, n->children[index + 1]);
-    if (child_right->n_keys > min_keys)
+    // Find the appropriate child for insertion
+    int i = bplus_child_index(node, key);
+    Node *child = child_read(bt, node->children[i]);
+
+    // If the child is full, split it
+    if (child->n_keys == node_max_keys(bt, child))
+    {
+        split_child(bt, node, child, i);
+        if (key >= node->keys[i])
+        {
+            i++;
+        }
+        child = child_read(bt, node->children[i]);
+    }
+
+    // Recursively insert the key into the child
+    op_depth++;
+    bplus_insert_non_full(bt, child, key, record);
+    op_depth--;
+
+    // Free the memory of the child
+    node_destroy(child);
+}
+
+/**
+ * @brief Get the min amount of keys of a non-root B+-tree node
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @return int
+ */
+static int bplus_min_keys(BTree *bt, Node *n)
+{
+    return n->is_leaf ? (bt->order - 1) / 2 : (bt->inner_order - 2) / 2;
+}
+
+/**
+ * @brief Merge the children index and index + 1 of a B+-tree node
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param Node* child
+ * @param Node* sibling
+ * @param int index
+ */
+static void bplus_merge_nodes(BTree *bt, Node *n, Node *child, Node *sibling, int index)
+{
+    op_event(bt, TRACE_MERGE, child->b_position, op_depth + 1);
+
+    if (child->is_leaf)
+    {
+        // Leaves just concatenate, the separator disappears with the sibling
+        for (int i = 0; i < sibling->n_keys; ++i)
+        {
+            child->keys[child->n_keys + i] = sibling->keys[i];
+            child->records[child->n_keys + i] = sibling->records[i];
+        }
+        child->n_keys += sibling->n_keys;
+        child->next = sibling->next;
+    }
+    else
+    {
+        // Internal nodes take the separator from the parent
+        child->keys[child->n_keys] = n->keys[index];
+        for (int i = 0; i < sibling->n_keys; ++i)
+            child->keys[child->n_keys + 1 + i] = sibling->keys[i];
+        for (int i = 0; i <= sibling->n_keys; ++i)
+            child->children[child->n_keys + 1 + i] = sibling->children[i];
+        child->n_keys += sibling->n_keys + 1;
+    }
+
+    // Move keys and children in parent node to fill space of removed separator
+    for (int i = index + 1; i < n->n_keys; ++i)
+    {
+        n->keys[i - 1] = n->keys[i];
+    }
+    for (int i = index + 2; i <= n->n_keys; ++i)
+    {
+        n->children[i - 1] = n->children[i];
+    }
+    n->n_keys--;
+
+    // Write nodes in the binary file, the sibling left the tree
+    disk_write(bt, n);
+    child_write(bt, child);
+    node_free(bt, sibling->b_position);
+}
+
+/**
+ * @brief Fill the child index of a B+-tree node, borrowing from or merging with a sibling
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param int index
+ */
+void bplus_fill_node(BTree *bt, Node *n, int index)
+{
+    Node *child = child_read(bt, n->children[index]);
+
+    // Try to borrow from the brother on the left
+    if (index != 0)
+    {
+        Node *sibling = child_read(bt, n->children[index - 1]);
+        if (sibling->n_keys > bplus_min_keys(bt, sibling))
+        {
+            // Open space at the beginning of the child
+            for (int i = child->n_keys - 1; i >= 0; --i)
+            {
+                child->keys[i + 1] = child->keys[i];
+                if (child->is_leaf)
+                    child->records[i + 1] = child->records[i];
+            }
+
+            if (child->is_leaf)
+            {
+                // The sibling's last entry moves and becomes the new separator
+                child->keys[0] = sibling->keys[sibling->n_keys - 1];
+                child->records[0] = sibling->records[sibling->n_keys - 1];
+                n->keys[index - 1] = child->keys[0];
+            }
+            else
+            {
+                // Rotate the separator down and the sibling's last key up
+                for (int i = child->n_keys; i >= 0; --i)
+                    child->children[i + 1] = child->children[i];
+                child->keys[0] = n->keys[index - 1];
+                child->children[0] = sibling->children[sibling->n_keys];
+                n->keys[index - 1] = sibling->keys[sibling->n_keys - 1];
+            }
+
+            child->n_keys++;
+            sibling->n_keys--;
+            op_event(bt, TRACE_BORROW, child->b_position, op_depth + 1);
+
+            disk_write(bt, n);
+            child_write(bt, child);
+            child_write(bt, sibling);
+
+            node_destroy(child);
+            node_destroy(sibling);
+            return;
+        }
+        node_destroy(sibling);
+    }
+
+    // Try to borrow from the brother on the right
+    if (index != n->n_keys)
+    {
+        Node *sibling = child_read(bt, n->children[index + 1]);
+        if (sibling->n_keys > bplus_min_keys(bt, sibling))
+        {
+            if (child->is_leaf)
+            {
+                // The sibling's first entry moves, its second key becomes the separator
+                child->keys[child->n_keys] = sibling->keys[0];
+                child->records[child->n_keys] = sibling->records[0];
+                n->keys[index] = sibling->keys[1];
+            }
+            else
+            {
+                // Rotate the separator down and the sibling's first key up
+                child->keys[child->n_keys] = n->keys[index];
+                child->children[child->n_keys + 1] = sibling->children[0];
+                n->keys[index] = sibling->keys[0];
+                for (int i = 1; i <= sibling->n_keys; ++i)
+                    sibling->children[i - 1] = sibling->children[i];
+            }
+
+            // Move the keys of the sibling
+            for (int i = 1; i < sibling->n_keys; ++i)
+            {
+                sibling->keys[i - 1] = sibling->keys[i];
+                if (sibling->is_leaf)
+                    sibling->records[i - 1] = sibling->records[i];
+            }
+
+            child->n_keys++;
+            sibling->n_keys--;
+            op_event(bt, TRACE_BORROW, child->b_position, op_depth + 1);
+
+            disk_write(bt, n);
+            child_write(bt, child);
+            child_write(bt, sibling);
+
+            node_destroy(child);
+            node_destroy(sibling);
+            return;
+        }
+        node_destroy(sibling);
+    }
+
+    // If it was not possible to borrow, do the merge
+    if (index != n->n_keys)
+    {
+        // Merge with right node
+        Node *sibling = child_read(bt, n->children[index + 1]);
+        bplus_merge_nodes(bt, n, child, sibling, index);
+        node_destroy(child);
+        node_destroy(sibling);
+    }
+    else
+    {
+        // Merge with left node
+        Node *sibling = child_read(bt, n->children[index - 1]);
+        bplus_merge_nodes(bt, n, sibling, child, index - 1);
+        node_destroy(child);
+        node_destroy(sibling);
+    }
+}
+
+/**
+ * @brief Recursive function to delete a key from the B+-tree
+ *
+ * Every child is filled before going down into it, so the leaf can always lose
+ * a key. Separators may outlive their keys, they still route correctly
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @param int key
+ * @param int* record if not NULL, receives the record of the key removed
+ * @return true if the key was in the subtree and was removed
+ */
+bool bplus_remove_from_node(BTree *bt, Node *n, int key, int *record)
+{
+    if (n->is_leaf)
+    {
+        int i = find_key_index(n, key);
+        if (i >= n->n_keys || n->keys[i] != key)
+            return false;
+
+        if (record)
+            *record = n->records[i];
+        remove_from_leaf(bt, n, i);
+        return true;
+    }
+
+    int i = bplus_child_index(n, key);
+    Node *child = child_read(bt, n->children[i]);
+
+    // Verify if child node has the minimum amount of keys
+    if (child->n_keys <= bplus_min_keys(bt, child))
+    {
+        node_destroy(child);
+        bplus_fill_node(bt, n, i);
+
+        // The children may have moved, look for the key again
+        i = bplus_child_index(n, key);
+        child = child_read(bt, n->children[i]);
+    }
+
+    // Remove recursively the key from child
+    op_depth++;
+    bool removed = bplus_remove_from_node(bt, child, key, record);
+    op_depth--;
+    node_destroy(child);
+
+    return removed;
+}
+
+/**
+ * @brief Check if the keys of a node come with records
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @return true
+ * @return false internal nodes of a B+-tree only have separators
+ */
+static bool range_has_records(BTree *bt, Node *n)
+{
+    return n->is_leaf || !(bt->flags & BTREE_PLUS);
+}
+
+/**
+ * @brief Get the min amount of keys a node keeps after a range is deleted
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @return int
+ */
+static int range_min_keys(BTree *bt, Node *n)
+{
+    int min = bt->flags & BTREE_PLUS ? bplus_min_keys(bt, n) : classic_min_keys(bt);
+    return min > 1 ? min : 1;
+}
+
+/**
+ * @brief Create a node with room for the keys of two full nodes and one more
+ *
+ * Wide nodes only live in memory, while the nodes of the boundaries of a
+ * deleted range are trimmed and joined
+ *
+ * @param BTree* bt
+ * @param bool is_leaf
+ * @param int pos
+ * @return Node*
+ */
+static Node *wide_create(BTree *bt, bool is_leaf, int pos)
+{
+    int cap = 2 * bt->inner_order + 2;
+    Node *w = (Node *)malloc(sizeof(Node));
+
+    w->n_keys = 0;
+    w->is_leaf = is_leaf;
+    w->b_position = pos;
+    w->next = -1;
+    w->keys = (int *)calloc(3 * cap, sizeof(int));
+    w->children = w->keys + cap;
+    w->records = w->children + cap;
+    w->eytz = NULL;
+    w->eytz_rank = NULL;
+    w->arena = NULL;
+
+    return w;
+}
+
+/**
+ * @brief Free memory allocated to a wide node
+ *
+ * @param Node* w
+ */
+static void wide_destroy(Node *w)
+{
+    free(w->keys);
+    free(w);
+}
+
+/**
+ * @brief Copy a node to a new wide node
+ *
+ * @param BTree* bt
+ * @param Node* n
+ * @return Node*
+ */
+static Node *wide_copy(BTree *bt, Node *n)
+{
+    Node *w = wide_create(bt, n->is_leaf, n->b_position);
+
+    w->n_keys = n->n_keys;
+    w->next = n->next;
+    memcpy(w->keys, n->keys, n->n_keys * sizeof(int));
+    if (range_has_records(bt, n))
+        memcpy(w->records, n->records, n->n_keys * sizeof(int));
+    if (!n->is_leaf)
+        memcpy(w->children, n->children, (n->n_keys + 1) * sizeof(int));
+
+    return w;
+}
+
+/**
+ * @brief Read a node to a new wide node
+ *
+ * @param BTree* bt
+ * @param int pos
+ * @return Node*
+ */
+static Node *wide_load(BTree *bt, int pos)
+{
+    Node *n = node_fetch(bt, pos);
+    Node *w = wide_copy(bt, n);
+    node_release(bt, n);
+
+    return w;
+}
+
+/**
+ * @brief Create a node with "count" keys of a wide node, from "first" on
+ *
+ * @param BTree* bt
+ * @param Node* w
+ * @param int first
+ * @param int count
+ * @param int pos
+ * @return Node*
+ */
+static Node *wide_part(BTree *bt, Node *w, int first, int count, int pos)
+{
+    Node *n = node_create(bt, w->is_leaf, pos);
+
+    n->n_keys = count;
+    memcpy(n->keys, w->keys + first, count * sizeof(int));
+    if (range_has_records(bt, w))
+        memcpy(n->records, w->records + first, count * sizeof(int));
+    if (!w->is_leaf)
+        memcpy(n->children, w->children + first, (count + 1) * sizeof(int));
+
+    return n;
+}
+
+/**
+ * @brief Insert a key and the child at its right in a wide node
+ *
+ * @param Node* w
+ * @param int i
+ * @param int key
+ * @param int record
+ * @param int child
+ */
+static void wide_insert(Node *w, int i, int key, int record, int child)
+{
+    memmove(w->keys + i + 1, w->keys + i, (w->n_keys - i) * sizeof(int));
+    memmove(w->records + i + 1, w->records + i, (w->n_keys - i) * sizeof(int));
+    memmove(w->children + i + 2, w->children + i + 1, (w->n_keys - i) * sizeof(int));
+
+    w->keys[i] = key;
+    w->records[i] = record;
+    w->children[i + 1] = child;
+    w->n_keys++;
+}
+
+/**
+ * @brief Remove "count" keys of a wide node from "i" on, with the children at their right
+ *
+ * @param Node* w
+ * @param int i
+ * @param int count
+ */
+static void wide_remove(Node *w, int i, int count)
+{
+    memmove(w->keys + i, w->keys + i + count, (w->n_keys - i - count) * sizeof(int));
+    memmove(w->records + i, w->records + i + count, (w->n_keys - i - count) * sizeof(int));
+    if (!w->is_leaf)
+        memmove(w->children + i + 1, w->children + i + 1 + count, (w->n_keys - i - count) * sizeof(int));
+    w->n_keys -= count;
+}
+
+/**
+ * @brief Append to a wide node the keys of its right sibling, with the separator between them
+ *
+ * Leaves of a B+-tree drop the separator, it is only a copy
+ *
+ * @param BTree* bt
+ * @param Node* l
+ * @param int key
+ * @param int record
+ * @param Node* r
+ */
+static void wide_append(BTree *bt, Node *l, int key, int record, Node *r)
+{
+    int at = l->n_keys;
+
+    if (!(bt->flags & BTREE_PLUS) || !l->is_leaf)
+    {
+        l->keys[l->n_keys] = key;
+        l->records[l->n_keys] = record;
+        l->n_keys++;
+    }
+
+    memcpy(l->keys + l->n_keys, r->keys, r->n_keys * sizeof(int));
+    memcpy(l->records + l->n_keys, r->records, r->n_keys * sizeof(int));
+    if (!l->is_leaf)
+        memcpy(l->children + at + 1, r->children, (r->n_keys + 1) * sizeof(int));
+    l->n_keys += r->n_keys;
+    l->next = r->next;
+}
+
+/**
+ * @brief Give back the page of a node that left the tree
+ *
+ * @param BTree* bt
+ * @param int pos
+ */
+static void node_free(BTree *bt, int pos)
+{
+    Node *pinned = pinned_node(bt, pos);
+    if (pinned)
     {
-        int succ_record = get_successor(bt, n, index);
-        n->records[index] = succ_record;
+        node_destroy(pinned);
+        bt->pinned[pos] = NULL;
+        bt->pinned_amount--;
+    }
+
+    pager_free(bt->pager, pos);
+}
 
+/**
+ * @brief Write a wide node as one node or, when it overflows, as two halves
+ *
+ * @param BTree* bt
+ * @param Node* w
+ * @param int right position of the second half, given back if it isn't needed; -1 allocates one
+ * @param int* sep receives the key that separates the halves
+ * @param int* sep_record receives the record of the separator
+ * @return int position of the second half, -1 if the node wasn't split
+ */
+static int wide_write(BTree *bt, Node *w, int right, int *sep, int *sep_record)
+{
+    if (w->n_keys <= node_max_keys(bt, w))
+    {
+        Node *n = wide_part(bt, w, 0, w->n_keys, w->b_position);
+        n->next = w->next;
         disk_write(bt, n);
-        node_destroy(child_left);
-        node_destroy(child_right);
+        node_destroy(n);
+
+        if (right != -1)
+            node_free(bt, right);
+        return -1;
+    }
+
+    if (right == -1)
+        right = pager_alloc(bt->pager);
+
+    // Leaves of a B+-tree keep every key and give a copy of the first one of the right half
+    bool copy = (bt->flags & BTREE_PLUS) && w->is_leaf;
+    int half = copy ? w->n_keys / 2 : (w->n_keys - 1) / 2;
+    int skip = copy ? 0 : 1;
+
+    Node *l = wide_part(bt, w, 0, half, w->b_position);
+    Node *r = wide_part(bt, w, half + skip, w->n_keys - half - skip, right);
+    l->next = copy ? right : -1;
+    r->next = copy ? w->next : -1;
+    *sep = w->keys[half];
+    *sep_record = w->records[half];
+
+    disk_write(bt, l);
+    disk_write(bt, r);
+    node_destroy(l);
+    node_destroy(r);
+
+    return right;
+}
+
+/**
+ * @brief Write back the child "i" of a wide node after its keys changed
+ *
+ * A child that overflows is split; one below the minimum takes the keys of a
+ * sibling and is split again only if they don't fit in one node
+ *
+ * @param BTree* bt
+ * @param Node* w
+ * @param int i
+ * @param Node* c wide copy of the child
+ */
+static void range_settle(BTree *bt, Node *w, int i, Node *c)
+{
+    int sep, sep_record;
+
+    // The children of "w" are one level below it
+    op_depth++;
+
+    if (c->n_keys >= range_min_keys(bt, c) || w->n_keys == 0)
+    {
+        int right = wide_write(bt, c, -1, &sep, &sep_record);
+        if (right != -1)
+            wide_insert(w, i, sep, sep_record, right);
+        op_depth--;
         return;
     }
 
-    // Case 2c: if none of children nodes have the minimum amount of keys, merge them and remove the key
-    merge_nodes(bt, n, index);
-    node_destroy(child_right);
+    // Join the child with its right sibling, or the left one for the last child
+    int li = i < w->n_keys ? i : i - 1;
+    Node *l = li == i ? c : wide_load(bt, w->children[li]);
+    Node *r = li == i ? wide_load(bt, w->children[li + 1]) : c;
+    int right_pos = r->b_position;
 
-    // Remove the key from new node
-    remove_from_node(bt, child_left, key);
+    // The left node absorbs the right one, so the link to it from the previous leaf stays valid
+    int seam = li == i ? 0 : l->n_keys + 1;
+    bool hollow = !c->is_leaf && c->n_keys == 0;
+    wide_append(bt, l, w->keys[li], w->records[li], r);
+    wide_remove(w, li, 1);
+
+    // A child without keys was settled alone, its only child may be below the minimum too
+    if (hollow)
+    {
+        op_depth++;
+        Node *g = wide_load(bt, l->children[seam]);
+        op_depth--;
+        if (g->n_keys < range_min_keys(bt, g))
+            range_settle(bt, l, seam, g);
+        wide_destroy(g);
+    }
+
+    int right = wide_write(bt, l, right_pos, &sep, &sep_record);
+    if (right != -1)
+        wide_insert(w, li, sep, sep_record, right);
+
+    wide_destroy(li == i ? r : l);
+    op_depth--;
 }
 
 /**
- * @brief Get the predecessor of a key in left's node
+ * @brief Take out of the filter, the index and the lists "count" keys of a node, from "first" on
  *
  * @param BTree* bt
  * @param Node* n
- * @param index
+ * @param int first
+ * @param int count
+ */
+static void range_forget(BTree *bt, Node *n, int first, int count)
+{
+    if (!range_has_records(bt, n))
+        return;
+
+    for (int i = first; i < first + count; i++)
+    {
+        if (bt->filter)
+            filter_remove(bt->filter, n->keys[i]);
+        slot_forget(bt, n->keys[i], n->records[i]);
+    }
+}
+
+/**
+ * @brief Give back the pages of a whole subtree
+ *
+ * Leaves are only read when their keys must leave the filter, the index or the lists
+ *
+ * @param BTree* bt
+ * @param int pos
+ * @param int height 0 for a leaf
+ * @param bool forget take the keys out of the filter, the index and the lists
+ */
+static void range_free_subtree(BTree *bt, int pos, int height, bool forget)
+{
+    if (height > 0 || (forget && (bt->filter || bt->index || bt->postings)))
+    {
+        Node *n = node_fetch(bt, pos);
+
+        if (forget)
+            range_forget(bt, n, 0, n->n_keys);
+        op_depth++;
+        for (int i = 0; height > 0 && i <= n->n_keys; i++)
+            range_free_subtree(bt, n->children[i], height - 1, forget);
+        op_depth--;
+
+        node_release(bt, n);
+    }
+
+    node_free(bt, pos);
+}
+
+/**
+ * @brief Get the index of the first key of a node greater than a key
+ *
+ * @param Node* n
+ * @param int key
  * @return int
  */
-int get_predecessor(BTree *bt, Node *n, int i)
+static int range_end(Node *n, int key)
 {
-    // Get the left's child
-    Node *current = disk_read(bt, n->children[i]);
+    return key == INT_MAX ? n->n_keys : find_key_index(n, key + 1);
+}
 
-    // Go to the rightmost node of this subtree
-    while (!current->is_leaf)
+static void range_trim(BTree *bt, Node *w, int height, int lo, int hi);
+
+/**
+ * @brief Join two trimmed subtrees of the same height, the keys of "r" after the ones of "l"
+ *
+ * The last child of "l" and the first one of "r" meet in the middle and are
+ * joined in turn, down to the leaves. "l" receives everything, the page of
+ * "r" is given back; "l" may overflow and is left to its parent
+ *
+ * @param BTree* bt
+ * @param Node* l
+ * @param Node* r
+ * @param int height
+ */
+static void range_join(BTree *bt, Node *l, Node *r, int height)
+{
+    if (height > 0)
     {
-        Node *temp = disk_read(bt, current->children[current->n_keys]);
-        node_destroy(current);
-        current = temp;
+        int at = l->n_keys;
+        op_depth++;
+        Node *cl = wide_load(bt, l->children[at]);
+        Node *cr = wide_load(bt, r->children[0]);
+        range_join(bt, cl, cr, height - 1);
+        op_depth--;
+
+        memcpy(l->keys + at, r->keys, r->n_keys * sizeof(int));
+        memcpy(l->records + at, r->records, r->n_keys * sizeof(int));
+        memcpy(l->children + at + 1, r->children + 1, r->n_keys * sizeof(int));
+        l->n_keys += r->n_keys;
+
+        range_settle(bt, l, at, cl);
+        wide_destroy(cl);
+        wide_destroy(cr);
+    }
+    else
+    {
+        memcpy(l->keys + l->n_keys, r->keys, r->n_keys * sizeof(int));
+        memcpy(l->records + l->n_keys, r->records, r->n_keys * sizeof(int));
+        l->n_keys += r->n_keys;
+        l->next = r->next;
     }
 
-    // Predecessor is the last key of this node
-    int pred_key = current->keys[current->n_keys - 1];
-    int pred_record = current->records[current->n_keys - 1];
+    node_free(bt, r->b_position);
+}
 
-    // Update key in the original node
-    n->keys[i] = pred_key;
+/**
+ * @brief Delete the keys of the range [lo, hi] from the subtree of a wide node
+ *
+ * Children that only hold keys of the range are given back whole; at most two
+ * children, the ones where the range starts and ends, are trimmed and then
+ * joined. The node may be left below its minimum, its parent settles it
+ *
+ * @param BTree* bt
+ * @param Node* w
+ * @param int height
+ * @param int lo
+ * @param int hi
+ */
+static void range_trim(BTree *bt, Node *w, int height, int lo, int hi)
+{
+    if (w->is_leaf)
+    {
+        int first = find_key_index(w, lo);
+        int count = range_end(w, hi) - first;
 
-    node_destroy(current);
-    return pred_record;
+        range_forget(bt, w, first, count);
+        memmove(w->keys + first, w->keys + first + count, (w->n_keys - first - count) * sizeof(int));
+        memmove(w->records + first, w->records + first + count, (w->n_keys - first - count) * sizeof(int));
+        w->n_keys -= count;
+        return;
+    }
+
+    // Children where the range starts and ends; the keys between them are all in it
+    int a, b;
+    if (bt->flags & BTREE_PLUS)
+    {
+        a = bplus_child_index(w, lo);
+        b = bplus_child_index(w, hi);
+    }
+    else
+    {
+        a = find_key_index(w, lo);
+        b = range_end(w, hi);
+    }
+
+    if (a == b)
+    {
+        op_depth++;
+        Node *c = wide_load(bt, w->children[a]);
+        range_trim(bt, c, height - 1, lo, hi);
+        op_depth--;
+        range_settle(bt, w, a, c);
+        wide_destroy(c);
+        return;
+    }
+
+    op_depth++;
+    for (int i = a + 1; i < b; i++)
+        range_free_subtree(bt, w->children[i], height - 1, true);
+    op_depth--;
+    range_forget(bt, w, a, b - a);
+
+    op_depth++;
+    Node *l = wide_load(bt, w->children[a]);
+    Node *r = wide_load(bt, w->children[b]);
+    range_trim(bt, l, height - 1, lo, hi);
+    range_trim(bt, r, height - 1, lo, hi);
+    range_join(bt, l, r, height - 1);
+    op_depth--;
+
+    wide_remove(w, a, b - a);
+    range_settle(bt, w, a, l);
+
+    wide_destroy(l);
+    wide_destroy(r);
 }
 
 /**
- * @brief Get the successor of a key in right's node
+ * @brief Get the amount of levels below the root
  *
  * @param BTree* bt
- * @param Node* n
- * @param index
  * @return int
  */
-int get_successor(BTree *bt, Node *n, int i)
+static int tree_height(BTree *bt)
 {
-    // Get the right's child
-    Node *current = disk_read(bt, n->children[i + 1]);
+    int height = 0;
+    Node *n = bt->root;
 
-    // Go to the leftmost node of this subtree
-    while (!current->is_leaf)
+    while (!n->is_leaf)
     {
-        Node *temp = disk_read(bt, current->children[0]);
-        node_destroy(current);
-        current = temp;
+        height++;
+        op_depth++;
+        Node *child = node_fetch(bt, n->children[0]);
+        node_release(bt, n);
+        n = child;
+    }
+    node_release(bt, n);
+    op_depth -= height;
+
+    return height;
+}
+
+/**
+ * @brief Delete every key of the range [lo, hi] with its record
+ *
+ * Only the paths from the root to the first and the last key of the range
+ * are read and written: the subtrees between them are given back whole to
+ * the pager, which reuses their pages, and the two paths are joined and
+ * rebalanced on the way up
+ *
+ * @param BTree* bt
+ * @param int lo
+ * @param int hi
+ */
+void btree_delete_range(BTree *bt, int lo, int hi)
+{
+    uint64_t start = op_begin(bt, BTREE_OP_DELETE_RANGE, lo);
+    pthread_mutex_lock(&bt->lock);
+
+    if (!bt->root || lo > hi)
+    {
+        pthread_mutex_unlock(&bt->lock);
+        op_end(bt, BTREE_OP_DELETE_RANGE, start);
+        return;
+    }
+
+    Node *w = wide_copy(bt, bt->root);
+    range_trim(bt, w, tree_height(bt), lo, hi);
+
+    node_destroy(bt->root);
+    bt->root = NULL;
+
+    // A root without keys leaves the tree empty or one level shorter
+    while (w && w->n_keys == 0)
+    {
+        op_depth++;
+        Node *child = w->is_leaf ? NULL : wide_load(bt, w->children[0]);
+        op_depth--;
+        node_free(bt, w->b_position);
+        wide_destroy(w);
+        w = child;
+    }
+
+    // A root that took the split of a child may overflow, the tree grows a level
+    if (w && w->n_keys > node_max_keys(bt, w))
+    {
+        int sep, sep_record;
+        Node *top = wide_create(bt, false, pager_alloc(bt->pager));
+
+        top->children[0] = w->b_position;
+        op_depth++;
+        wide_insert(top, 0, 0, 0, wide_write(bt, w, -1, &sep, &sep_record));
+        op_depth--;
+        top->keys[0] = sep;
+        top->records[0] = sep_record;
+
+        wide_destroy(w);
+        w = top;
+    }
+
+    if (w)
+    {
+        bt->root = wide_part(bt, w, 0, w->n_keys, w->b_position);
+        bt->root->next = w->next;
+        disk_write(bt, bt->root);
+        wide_destroy(w);
+    }
+
+    pthread_mutex_unlock(&bt->lock);
+    op_end(bt, BTREE_OP_DELETE_RANGE, start);
+}
+
+/**
+ * @brief Delete every key of the tree, giving back all of its pages
+ *
+ * @param BTree* bt
+ */
+void btree_truncate(BTree *bt)
+{
+    pthread_mutex_lock(&bt->lock);
+
+    if (bt->root)
+    {
+        range_free_subtree(bt, bt->root->b_position, tree_height(bt), false);
+        node_destroy(bt->root);
+        bt->root = NULL;
+    }
+
+    if (bt->filter)
+    {
+        filter_destroy(bt->filter);
+        bt->filter = filter_create(filter_fit(bt, BTREE_BLOOM_KEYS));
+    }
+
+    // The file of the index is truncated when it is opened again
+    if (bt->index)
+    {
+        strtree_destroy(bt->index);
+        bt->index = strtree_create(bt->index_path, BTREE_PAGE_SIZE);
+    }
+
+    // So is the file of the lists
+    if (bt->postings)
+    {
+        postings_close(bt->postings);
+        bt->postings = postings_open(bt->postings_path);
+    }
+    side_caches_size(bt);
+
+    pthread_mutex_unlock(&bt->lock);
+}
+
+/**
+ * @brief Ask for the child "i" of a node if a scan up to "hi" will read it
+ *
+ * @param BTree* bt
+ * @param BTreeSnapshot* s
+ * @param Node* n
+ * @param int i
+ * @param int hi
+ */
+static void scan_prefetch(BTree *bt, BTreeSnapshot *s, Node *n, int i, int hi)
+{
+    // Subtrees starting after hi are never read
+    if (!n->is_leaf && i <= n->n_keys && (i == 0 || n->keys[i - 1] <= hi))
+        source_prefetch(bt, s, n->children[i]);
+}
+
+/**
+ * @brief Visit in order the keys of a subtree in the range [lo, hi]
+ *
+ * @param BTree* bt
+ * @param BTreeSnapshot* s NULL scans the current tree
+ * @param Node* n
+ * @param int lo
+ * @param int hi
+ * @param BTreeVisitor visit
+ * @param void* ctx
+ * @return false if the visitor asked to stop
+ */
+static bool scan_node(BTree *bt, BTreeSnapshot *s, Node *n, int lo, int hi, BTreeVisitor visit, void *ctx)
+{
+    int i = find_key_index(n, lo);
+
+    for (int j = i + 1; j < i + BTREE_PREFETCH_DISTANCE; j++)
+        scan_prefetch(bt, s, n, j, hi);
+
+    for (; i <= n->n_keys; i++)
+    {
+        // Visit the subtree at the left of the key i, asking for a later sibling meanwhile
+        if (!n->is_leaf)
+        {
+            scan_prefetch(bt, s, n, i + BTREE_PREFETCH_DISTANCE, hi);
+
+            op_depth++;
+            Node *child = source_fetch(bt, s, n->children[i]);
+            bool go_on = scan_node(bt, s, child, lo, hi, visit, ctx);
+            source_release(bt, s, child);
+            op_depth--;
+            if (!go_on)
+                return false;
+        }
+
+        if (i == n->n_keys || n->keys[i] > hi)
+            return i == n->n_keys;
+
+        if (!visit(n->keys[i], n->records[i], ctx))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Visit in order the keys of the range [lo, hi] of the tree under a root
+ *
+ * In B+-tree mode only the first leaf is found from the root, the rest of the
+ * range is read following the links between the leaves
+ *
+ * @param BTree* bt
+ * @param BTreeSnapshot* s NULL scans the current tree
+ * @param Node* root
+ * @param int lo
+ * @param int hi
+ * @param BTreeVisitor visit
+ * @param void* ctx
+ */
+static void scan_tree(BTree *bt, BTreeSnapshot *s, Node *root, int lo, int hi, BTreeVisitor visit, void *ctx)
+{
+    if (!(bt->flags & BTREE_PLUS))
+    {
+        scan_node(bt, s, root, lo, hi, visit, ctx);
+        source_release(bt, s, root);
+        return;
+    }
+
+    // Go down to the leaf where the range starts, every leaf is on its level
+    Node *n = root;
+    int depth = op_depth;
+    while (!n->is_leaf)
+    {
+        int c = bplus_child_index(n, lo);
+
+        // The next siblings of the range are asked for while the tree is descended
+        for (int j = c + 1; j <= c + BTREE_PREFETCH_DISTANCE; j++)
+            scan_prefetch(bt, s, n, j, hi);
+
+        op_depth++;
+        Node *child = source_fetch(bt, s, n->children[c]);
+        source_release(bt, s, n);
+        n = child;
+    }
+
+    // Walk the leaves from left to right, asking for the next one before visiting each
+    int i = find_key_index(n, lo);
+    while (n)
+    {
+        if (n->next != -1 && (n->n_keys == 0 || n->keys[n->n_keys - 1] <= hi))
+            source_prefetch(bt, s, n->next);
+
+        for (; i < n->n_keys; i++)
+        {
+            if (n->keys[i] > hi || !visit(n->keys[i], n->records[i], ctx))
+            {
+                source_release(bt, s, n);
+                op_depth = depth;
+                return;
+            }
+        }
+
+        int next = n->next;
+        source_release(bt, s, n);
+
+        n = next == -1 ? NULL : (s ? snapshot_read(s, next) : disk_read(bt, next));
+        i = 0;
+    }
+
+    op_depth = depth;
+}
+
+/**
+ * @brief Visit in order every key of the tree in the range [lo, hi] with its record
+ *
+ * With BTREE_DUPLICATES a key is visited once per record, in the order they were inserted
+ *
+ * @param BTree* bt
+ * @param int lo
+ * @param int hi
+ * @param BTreeVisitor visit returns false to stop the scan
+ * @param void* ctx
+ */
+void btree_scan(BTree *bt, int lo, int hi, BTreeVisitor visit, void *ctx)
+{
+    if (!bt->root || lo > hi)
+        return;
+
+    uint64_t start = op_begin(bt, BTREE_OP_SCAN, lo);
+    if (bt->postings)
+    {
+        SlotVisit v = {bt, visit, ctx, 0};
+        scan_tree(bt, NULL, bt->root, lo, hi, slot_scan_visit, &v);
+    }
+    else
+    {
+        scan_tree(bt, NULL, bt->root, lo, hi, visit, ctx);
     }
+    op_end(bt, BTREE_OP_SCAN, start);
+}
 
-    // Successor is the first key of this node
-    int succ_key = current->keys[0];
-    int succ_record = current->records[0];
+/**
+ * @brief Take a snapshot of the tree: its readers see the tree as it is now
+ *
+ * The readers of a snapshot may run in other threads, in parallel with the
+ * inserts and deletes of the tree and with the readers of other snapshots.
+ * Pages replaced while a snapshot can read them are only reused after it is
+ * released. The lists of BTREE_DUPLICATES are changed in place, so trees
+ * with them can't be seen by snapshots
+ *
+ * @param BTree* bt a tree created with BTREE_COW
+ * @return BTreeSnapshot* NULL if the tree doesn't have copy-on-write pages or has lists
+ */
+BTreeSnapshot *btree_snapshot_acquire(BTree *bt)
+{
+    if (!(bt->flags & BTREE_COW) || bt->postings)
+        return NULL;
+
+    BTreeSnapshot *s = (BTreeSnapshot *)malloc(sizeof(BTreeSnapshot));
+    s->bt = bt;
+    s->page = (char *)malloc(bt->stride);
+    s->codec.bt = bt;
+    s->codec.scratch = NULL;
+    if (bt->flags & BTREE_COMPRESS)
+        s->codec.scratch = (int *)malloc(2 * (bt->order - 1) * sizeof(int));
+
+    // Freeze the root and the pages between two writes
+    pthread_mutex_lock(&bt->lock);
+    s->root = bt->root ? bt->root->b_position : -1;
+    s->view = pager_view_acquire(bt->pager);
+    pthread_mutex_unlock(&bt->lock);
+
+    return s;
+}
 
-    // Update key in the original node
-    n->keys[i] = succ_key;
+/**
+ * @brief Release a snapshot and free memory allocated to it
+ *
+ * @param BTreeSnapshot* s
+ */
+void btree_snapshot_release(BTreeSnapshot *s)
+{
+    if (!s)
+        return;
 
-    node_destroy(current);
-    return succ_record;
+    pager_view_release(s->view);
+    free(s->page);
+    free(s->codec.scratch);
+    free(s);
 }
 
 /**
- * @brief Merge children from right and left
+ * @brief Get the epoch of a snapshot, snapshots taken later have greater epochs
  *
- * @param bt
- * @param n
- * @param index
+ * @param BTreeSnapshot* s
+ * @return unsigned
  */
-void merge_nodes(BTree *bt, Node *n, int index)
+unsigned btree_snapshot_epoch(BTreeSnapshot *s)
 {
-    Node *child = disk_read(bt, n->children[index]);
-    Node *sibling = disk_read(bt, n->children[index + 1]);
+    return pager_view_epoch(s->view);
+}
 
-    int min_keys = (bt->order - 1) / 2;
+/**
+ * @brief Search a key in the tree as it was when the snapshot was taken
+ *
+ * @param BTreeSnapshot* s
+ * @param int key
+ * @param int* record if not NULL, receives the record of the key
+ * @return true
+ * @return false
+ */
+bool btree_snapshot_search(BTreeSnapshot *s, int key, int *record)
+{
+    if (s->root == -1)
+        return false;
 
-    // Copy the keys from parents to the child
-    child->keys[min_keys] = n->keys[index];
-    child->records[min_keys] = n->records[index];
+    bool plus = s->bt->flags & BTREE_PLUS;
+    Node *n = snapshot_read(s, s->root);
+    int depth = op_depth;
 
-    // Copy all keys and registers of a sibling to the node
-    for (int i = 0; i < sibling->n_keys; ++i)
+    for (;; op_depth++)
     {
-        child->keys[min_keys + 1 + i] = sibling->keys[i];
-        child->records[min_keys + 1 + i] = sibling->records[i];
-    }
+        int i = plus && !n->is_leaf ? bplus_child_index(n, key) : find_key_index(n, key);
 
-    // If node isn't leaf, copy the references to children
-    if (!child->is_leaf)
-    {
-        for (int i = 0; i <= sibling->n_keys; ++i)
+        // Keys of internal nodes of a B+-tree are only separators
+        if ((!plus || n->is_leaf) && i < n->n_keys && n->keys[i] == key)
         {
-            child->children[min_keys + 1 + i] = sibling->children[i];
+            if (record)
+                *record = n->records[i];
+            node_destroy(n);
+            op_depth = depth;
+            return true;
         }
-    }
 
-    // Move keys in parent node to fill space of removed key
-    for (int i = index + 1; i < n->n_keys; ++i)
-    {
-        n->keys[i - 1] = n->keys[i];
-        n->records[i - 1] = n->records[i];
-    }
+        if (n->is_leaf)
+        {
+            node_destroy(n);
+            op_depth = depth;
+            return false;
+        }
 
-    // Moves references to children in the parent node
-    for (int i = index + 2; i <= n->n_keys; ++i)
-    {
-        n->children[i - 1] = n->children[i];
+        op_depth++;
+        Node *child = snapshot_read(s, n->children[i]);
+        op_depth--;
+        node_destroy(n);
+        n = child;
     }
+}
 
-    // Update amount of keys
-    child->n_keys += sibling->n_keys + 1;
-    n->n_keys--;
-
-    // Write nodes in the binary file
-    disk_write(bt, n);
-    disk_write(bt, child);
+/**
+ * @brief Visit in order every key in the range [lo, hi] of the tree as it was when the snapshot was taken
+ *
+ * @param BTreeSnapshot* s
+ * @param int lo
+ * @param int hi
+ * @param BTreeVisitor visit returns false to stop the scan
+ * @param void* ctx
+ */
+void btree_snapshot_scan(BTreeSnapshot *s, int lo, int hi, BTreeVisitor visit, void *ctx)
+{
+    if (s->root == -1 || lo > hi)
+        return;
 
-    node_destroy(child);
-    node_destroy(sibling);
+    scan_tree(s->bt, s, snapshot_read(s, s->root), lo, hi, visit, ctx);
 }
 
 /**
- * @brief Fill the node to ensure it has the minimum number of keys
+ * @brief Print in level-order the tree as it was when the snapshot was taken
  *
- * @param BTree* bt
- * @param Node* n
- * @param int index
+ * @param BTreeSnapshot* s
+ * @param FILE* fp
  */
-void fill_node(BTree *bt, Node *n, int index)
+void btree_snapshot_level_order_print(BTreeSnapshot *s, FILE *fp)
 {
-    int min_keys = (bt->order - 1) / 2;
+    if (s->root == -1)
+        return;
 
-    // Try to borrow from the brother on the left
-    if (index != 0)
-    {
-        Node *sibling = disk_read(bt, n->children[index - 1]);
-        if (sibling->n_keys > min_keys)
-        {
-            borrow_from_prev(bt, n, index);
-            node_destroy(sibling);
-            return;
-        }
-        node_destroy(sibling);
-    }
+    print_levels(s->bt, s, s->root, fp);
+}
 
-    // Try to borrow from the brother on the right
-    if (index != n->n_keys)
-    {
-        Node *sibling = disk_read(bt, n->children[index + 1]);
-        if (sibling->n_keys > min_keys)
-        {
-            borrow_from_next(bt, n, index);
-            node_destroy(sibling);
-            return;
-        }
-        node_destroy(sibling);
-    }
+// State of a check of the whole tree
+typedef struct
+{
+    BTree *bt;
+    FILE *fp;       // Receives the first broken rule, may be NULL
+    char *seen;     // How each page was reached: 0 not yet, 1 from the root, 2 in the free list
+    int pages;      // Amount of pages of the file
+    int leaf_depth; // Depth of the leaves, -1 before the first one
+    int next_leaf;  // Position the last leaf links to, -2 before the first one (only B+-tree mode)
+    bool ok;
+} TreeCheck;
 
-    // If it was not possible to borrow, do the merge
-    if (index != n->n_keys)
-    {
-        // Merge with right node
-        merge_nodes(bt, n, index);
-    }
-    else
+/**
+ * @brief Report a broken rule of the tree, only the first one is written
+ *
+ * @param TreeCheck* c
+ * @param const char* fmt
+ */
+static void check_fail(TreeCheck *c, const char *fmt, ...)
+{
+    if (c->ok && c->fp)
     {
-        // Merge with left node
-        merge_nodes(bt, n, index - 1);
+        va_list ap;
+        va_start(ap, fmt);
+        fprintf(c->fp, "btree_check: ");
+        vfprintf(c->fp, fmt, ap);
+        fprintf(c->fp, "\n");
+        va_end(ap);
     }
+
+    c->ok = false;
 }
 
 /**
- * @brief Get a key from previous node
+ * @brief Check a node and, recursively, its subtree
  *
- * @param BTree* bt
+ * The keys of a subtree lie between the separators around it in the parent:
+ * strictly for the classic tree, and from the left one on for the B+-tree
+ *
+ * @param TreeCheck* c
  * @param Node* n
- * @param index
+ * @param int depth
+ * @param bool root
+ * @param const int* lo separator on the left, NULL without one
+ * @param const int* hi separator on the right, NULL without one
  */
-void borrow_from_prev(BTree *bt, Node *n, int index)
+static void check_node(TreeCheck *c, Node *n, int depth, bool root, const int *lo, const int *hi)
 {
-    Node *child = disk_read(bt, n->children[index]);
-    Node *sibling = disk_read(bt, n->children[index - 1]);
+    BTree *bt = c->bt;
+    bool plus = bt->flags & BTREE_PLUS;
 
-    // Move the keys in the child
-    for (int i = child->n_keys - 1; i >= 0; --i)
-    {
-        child->keys[i + 1] = child->keys[i];
-        child->records[i + 1] = child->records[i];
-    }
+    // The node must hold between the min and the max amount of keys
+    int min = root ? 1 : plus ? bplus_min_keys(bt, n) : classic_min_keys(bt);
+    if (n->n_keys < min || n->n_keys > node_max_keys(bt, n))
+        check_fail(c, "node %d has %d keys, out of [%d, %d]", n->b_position, n->n_keys, min, node_max_keys(bt, n));
 
-    // If it is not a leaf, it also moves the references to children
-    if (!child->is_leaf)
+    for (int i = 0; c->ok && i < n->n_keys; i++)
     {
-        for (int i = child->n_keys; i >= 0; --i)
-        {
-            child->children[i + 1] = child->children[i];
-        }
+        if (i > 0 && n->keys[i - 1] >= n->keys[i])
+            check_fail(c, "keys %d and %d of node %d are out of order", n->keys[i - 1], n->keys[i], n->b_position);
+        if ((lo && (plus ? n->keys[i] < *lo : n->keys[i] <= *lo)) || (hi && n->keys[i] >= *hi))
+            check_fail(c, "key %d of node %d is out of the range of its subtree", n->keys[i], n->b_position);
     }
 
-    // Set the parent's key as the child's first key
-    child->keys[0] = n->keys[index - 1];
-    child->records[0] = n->records[index - 1];
+    if (!c->ok)
+        return;
 
-    // If it is not a leaf, the last child of the sibling becomes the first child.
-    if (!child->is_leaf)
+    if (n->is_leaf)
     {
-        child->children[0] = sibling->children[sibling->n_keys];
+        // Every leaf is at the same depth, and B+-tree leaves link to the next one
+        if (c->leaf_depth == -1)
+            c->leaf_depth = depth;
+        if (depth != c->leaf_depth)
+            check_fail(c, "leaf %d is at depth %d, the first one at %d", n->b_position, depth, c->leaf_depth);
+        if (plus && c->next_leaf != -2 && c->next_leaf != n->b_position)
+            check_fail(c, "the leaf before %d links to %d", n->b_position, c->next_leaf);
+
+        c->next_leaf = n->next;
+        return;
     }
 
-    // The sibling's last key goes to the parent
-    n->keys[index - 1] = sibling->keys[sibling->n_keys - 1];
-    n->records[index - 1] = sibling->records[sibling->n_keys - 1];
-
-    // Update amount of keys
-    child->n_keys++;
-    sibling->n_keys--;
-
-    // Write nodes in the binary file
-    disk_write(bt, n);
-    disk_write(bt, child);
-    disk_write(bt, sibling);
+    for (int i = 0; c->ok && i <= n->n_keys; i++)
+    {
+        int pos = n->children[i];
+        if (pos < 0 || pos >= c->pages)
+        {
+            check_fail(c, "child %d of node %d is out of the file", pos, n->b_position);
+            return;
+        }
+        if (c->seen[pos])
+        {
+            check_fail(c, "page %d is reached twice", pos);
+            return;
+        }
+        c->seen[pos] = 1;
 
-    node_destroy(child);
-    node_destroy(sibling);
+        Node *child = disk_read(bt, pos);
+        check_node(c, child, depth + 1, false, i > 0 ? &n->keys[i - 1] : lo, i < n->n_keys ? &n->keys[i] : hi);
+        node_destroy(child);
+    }
 }
 
 /**
- * @brief Get a key from next node
+ * @brief Check the rules of the tree and of its file
+ *
+ * Keys are sorted in every node and lie in the range of their subtree, every
+ * node but the root holds between the min and the max amount of keys, every
+ * leaf is at the same depth, B+-tree leaves are linked in order, and every
+ * page of the file is either in the tree or given back, never both
  *
  * @param BTree* bt
- * @param Node* n
- * @param index
+ * @param FILE* fp receives the first broken rule, NULL to only get the result
+ * @return true
+ * @return false a rule is broken
  */
-void borrow_from_next(BTree *bt, Node *n, int index)
+bool btree_check(BTree *bt, FILE *fp)
 {
-    Node *child = disk_read(bt, n->children[index]);
-    Node *sibling = disk_read(bt, n->children[index + 1]);
+    pthread_mutex_lock(&bt->lock);
 
-    // The parent's key goes to the child's end
-    child->keys[child->n_keys] = n->keys[index];
-    child->records[child->n_keys] = n->records[index];
+    TreeCheck c = {bt, fp, NULL, pager_page_count(bt->pager), -1, -2, true};
+    c.seen = (char *)calloc(c.pages ? c.pages : 1, 1);
 
-    // If it is not a leaf, the first child of the sibling becomes the last child.
-    if (!child->is_leaf)
+    if (bt->root)
     {
-        child->children[child->n_keys + 1] = sibling->children[0];
+        int pos = bt->root->b_position;
+        if (pos < 0 || pos >= c.pages)
+        {
+            check_fail(&c, "root %d is out of the file", pos);
+        }
+        else
+        {
+            c.seen[pos] = 1;
+            check_node(&c, bt->root, 0, true, NULL, NULL);
+        }
+
+        if (c.ok && (bt->flags & BTREE_PLUS) && c.next_leaf != -1)
+            check_fail(&c, "the last leaf links to %d", c.next_leaf);
     }
 
-    // The sibling's first key goes to the parent
-    n->keys[index] = sibling->keys[0];
-    n->records[index] = sibling->records[0];
+    // No page is lost: the ones out of the tree are in the free list
+    const int *free_pages;
+    int n_free = pager_free_list(bt->pager, &free_pages);
 
-    // Move the keys to the sibling
-    for (int i = 1; i < sibling->n_keys; ++i)
+    for (int i = 0; c.ok && i < n_free; i++)
     {
-        sibling->keys[i - 1] = sibling->keys[i];
-        sibling->records[i - 1] = sibling->records[i];
+        int pos = free_pages[i];
+        if (pos < 0 || pos >= c.pages)
+            check_fail(&c, "free page %d is out of the file", pos);
+        else if (c.seen[pos])
+            check_fail(&c, "page %d is given back twice or while in the tree", pos);
+        else
+            c.seen[pos] = 2;
     }
 
-    // If it is not a leaf, it also moves the references to children
-    if (!sibling->is_leaf)
+    for (int pos = 0; c.ok && pos < c.pages; pos++)
     {
-        for (int i = 1; i <= sibling->n_keys; ++i)
-        {
-            sibling->children[i - 1] = sibling->children[i];
-        }
+        if (!c.seen[pos])
+            check_fail(&c, "page %d is neither in the tree nor given back", pos);
     }
 
-    // Update amount of keys
-    child->n_keys++;
-    sibling->n_keys--;
-
-    // Write nodes in the binary file
-    disk_write(bt, n);
-    disk_write(bt, child);
-    disk_write(bt, sibling);
+    free(c.seen);
+    pthread_mutex_unlock(&bt->lock);
 
-    node_destroy(child);
-    node_destroy(sibling);
+    return c.ok;
 }
 
 /**
- * @brief Print B-Tree in level-order
+ * @brief Get the name of an operation of the tree
  *
- * @param bt
+ * @param int op one of BTREE_OP_*
+ * @return const char*
  */
-void btree_level_order_print(BTree *bt, FILE *fp)
+const char *btree_op_name(int op)
 {
-    // Create a queue to make level-order traversal
-    Queue *q = queue_create();
+    static const char *names[BTREE_OPS] = {"insert", "search", "delete", "delete_range", "update", "scan", "get_all"};
 
-    // Enqueue root
-    queue_enqueue(q, bt->root);
+    return op >= 0 && op < BTREE_OPS ? names[op] : "unknown";
+}
 
-    while (!queue_is_empty(q))
+/**
+ * @brief Start or stop measuring the time of every operation of the tree
+ *
+ * Each type of operation gets its own histogram, enabling them again starts
+ * from zero. Call it between operations
+ *
+ * @param BTree* bt
+ * @param bool enabled
+ */
+void btree_set_latency_stats(BTree *bt, bool enabled)
+{
+    for (int op = 0; op < BTREE_OPS; op++)
     {
-        // Get the number of nodes at the current level
-        int level_size = queue_get_size(q);
-
-        // Process each node at the current level
-        for (int i = 0; i < level_size; i++)
-        {
-            // Dequeue the current node
-            Node *curr = queue_dequeue(q);
+        if (bt->latency[op])
+            histogram_destroy(bt->latency[op]);
+        bt->latency[op] = enabled ? histogram_create() : NULL;
+    }
+}
 
-            if (curr->n_keys > 0)
-            {
-                fprintf(fp, "[");
-                for (int j = 0; j < curr->n_keys; j++)
-                    fprintf(fp, "key: %d, ", curr->keys[j]);
-                fprintf(fp, "]");
-            }
+/**
+ * @brief Get the time under which a fraction of the operations of a type ended
+ *
+ * @param BTree* bt
+ * @param int op one of BTREE_OP_*
+ * @param double q fraction, from 0 to 1
+ * @return uint64_t nanoseconds, 0 while not measured
+ */
+uint64_t btree_latency_percentile(BTree *bt, int op, double q)
+{
+    return bt->latency[op] ? histogram_percentile(bt->latency[op], q) : 0;
+}
 
-            // If the node is not a leaf, enqueue its children for the next level
-            if (!curr->is_leaf)
-            {
-                for (int j = 0; j <= curr->n_keys; j++)
-                {
-                    Node *child = disk_read(bt, curr->children[j]);
-                    queue_enqueue(q, child);
-                }
-            }
+/**
+ * @brief Print the percentiles of the time of the operations, one type per line
+ *
+ * @param BTree* bt
+ * @param FILE* fp
+ */
+void btree_latency_print(BTree *bt, FILE *fp)
+{
+    fprintf(fp, "%-13s %10s %10s %10s %10s %10s %10s %10s\n", "op (us)", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
 
-            if (curr != bt->root)
-                node_destroy(curr);
-        }
-        fprintf(fp, "\n");
+    for (int op = 0; op < BTREE_OPS; op++)
+    {
+        Histogram *h = bt->latency[op];
+        if (!h || !histogram_count(h))
+            continue;
+
+        fprintf(fp, "%-13s %10llu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", btree_op_name(op),
+                (unsigned long long)histogram_count(h), histogram_mean(h) / 1e3,
+                histogram_percentile(h, 0.5) / 1e3, histogram_percentile(h, 0.9) / 1e3,
+                histogram_percentile(h, 0.99) / 1e3, histogram_percentile(h, 0.999) / 1e3,
+                histogram_max(h) / 1e3);
     }
+}
 
-    // Destroy the root node after traversal is complete
-    if (bt->root)
+/**
+ * @brief Write the events of the operations to a trace file
+ *
+ * Every operation marks its start and end, and in between each split, merge,
+ * borrow, page read and page write with the position of the page and its
+ * depth. The file keeps the last "events" of them, the tracetool program turns
+ * it into timelines. Call it between operations
+ *
+ * @param BTree* bt
+ * @param const char* path
+ * @param int events 0 keeps BTREE_TRACE_EVENTS
+ */
+void btree_trace_open(BTree *bt, const char *path, int events)
+{
+    btree_trace_close(bt);
+    bt->trace = trace_open(path, events > 0 ? (uint32_t)events : BTREE_TRACE_EVENTS);
+}
+
+/**
+ * @brief Stop tracing the operations, closing the trace file
+ *
+ * @param BTree* bt
+ */
+void btree_trace_close(BTree *bt)
+{
+    if (bt->trace)
     {
-        node_destroy(bt->root);
+        trace_close(bt->trace);
+        bt->trace = NULL;
     }
-
-    // Destroy the queue
-    queue_destroy(q);
-}
\ No newline at end of file
+}
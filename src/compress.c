@@ -0,0 +1,244 @@
+#include <string.h>
+#include <stdint.h>
+#include "../include/compress.h"
+
+/**
+ * @brief Get the amount of bits needed to represent a value
+ *
+ * @param uint32_t v
+ * @return int
+ */
+int bit_width(uint32_t v)
+{
+    int width = 0;
+
+    while (v)
+    {
+        width++;
+        v >>= 1;
+    }
+
+    return width;
+}
+
+/**
+ * @brief Pack n values of "width" bits each, one after the other
+ *
+ * @param const uint32_t* v
+ * @param int n
+ * @param int width
+ * @param unsigned char* out
+ * @return size_t amount of bytes written
+ */
+size_t bit_pack(const uint32_t *v, int n, int width, unsigned char *out)
+{
+    uint64_t acc = 0;
+    int bits = 0;
+    size_t size = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        acc |= (uint64_t)v[i] << bits;
+        bits += width;
+
+        // Flush every full byte of the accumulator
+        while (bits >= 8)
+        {
+            out[size++] = (unsigned char)acc;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+
+    if (bits > 0)
+        out[size++] = (unsigned char)acc;
+
+    return size;
+}
+
+/**
+ * @brief Unpack n values of "width" bits each
+ *
+ * @param const unsigned char* in
+ * @param int n
+ * @param int width
+ * @param uint32_t* v
+ * @return size_t amount of bytes read
+ */
+size_t bit_unpack(const unsigned char *in, int n, int width, uint32_t *v)
+{
+    uint64_t acc = 0;
+    uint64_t mask = width == 32 ? 0xFFFFFFFFull : ((1ull << width) - 1);
+    int bits = 0;
+    size_t size = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        // Load bytes until the value is complete
+        while (bits < width)
+        {
+            acc |= (uint64_t)in[size++] << bits;
+            bits += 8;
+        }
+
+        v[i] = (uint32_t)(acc & mask);
+        acc >>= width;
+        bits -= width;
+    }
+
+    return size;
+}
+
+/**
+ * @brief Pack sorted ints as the first value and the bit-packed gaps between them
+ *
+ * @param const int* v
+ * @param int n
+ * @param unsigned char* out
+ * @return size_t amount of bytes written
+ */
+size_t delta_pack(const int *v, int n, unsigned char *out)
+{
+    if (n == 0)
+        return 0;
+
+    uint32_t max = 0;
+    for (int i = 1; i < n; i++)
+    {
+        uint32_t gap = (uint32_t)v[i] - (uint32_t)v[i - 1];
+        if (gap > max)
+            max = gap;
+    }
+
+    // Base value and width of the gaps
+    int32_t base = v[0];
+    int width = bit_width(max);
+    memcpy(out, &base, sizeof(int32_t));
+    out[sizeof(int32_t)] = (unsigned char)width;
+
+    size_t size = sizeof(int32_t) + 1;
+    uint64_t acc = 0;
+    int bits = 0;
+
+    for (int i = 1; i < n; i++)
+    {
+        acc |= (uint64_t)((uint32_t)v[i] - (uint32_t)v[i - 1]) << bits;
+        bits += width;
+        while (bits >= 8)
+        {
+            out[size++] = (unsigned char)acc;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+
+    if (bits > 0)
+        out[size++] = (unsigned char)acc;
+
+    return size;
+}
+
+/**
+ * @brief Unpack ints packed by delta_pack
+ *
+ * @param const unsigned char* in
+ * @param int n
+ * @param int* v
+ * @return size_t amount of bytes read
+ */
+size_t delta_unpack(const unsigned char *in, int n, int *v)
+{
+    if (n == 0)
+        return 0;
+
+    int32_t base;
+    memcpy(&base, in, sizeof(int32_t));
+    int width = in[sizeof(int32_t)];
+
+    // Unpack the gaps in place and sum them back
+    size_t size = sizeof(int32_t) + 1;
+    size += bit_unpack(in + size, n - 1, width, (uint32_t *)v + 1);
+
+    v[0] = base;
+    for (int i = 1; i < n; i++)
+        v[i] = (int)((uint32_t)v[i - 1] + (uint32_t)v[i]);
+
+    return size;
+}
+
+/**
+ * @brief Pack ints as their minimum (frame of reference) and the bit-packed offsets to it
+ *
+ * @param const int* v
+ * @param int n
+ * @param unsigned char* out
+ * @return size_t amount of bytes written
+ */
+size_t for_pack(const int *v, int n, unsigned char *out)
+{
+    if (n == 0)
+        return 0;
+
+    int32_t min = v[0];
+    int32_t max = v[0];
+    for (int i = 1; i < n; i++)
+    {
+        if (v[i] < min)
+            min = v[i];
+        if (v[i] > max)
+            max = v[i];
+    }
+
+    // Frame of reference and width of the offsets
+    int width = bit_width((uint32_t)max - (uint32_t)min);
+    memcpy(out, &min, sizeof(int32_t));
+    out[sizeof(int32_t)] = (unsigned char)width;
+
+    size_t size = sizeof(int32_t) + 1;
+    uint64_t acc = 0;
+    int bits = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        acc |= (uint64_t)((uint32_t)v[i] - (uint32_t)min) << bits;
+        bits += width;
+        while (bits >= 8)
+        {
+            out[size++] = (unsigned char)acc;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+
+    if (bits > 0)
+        out[size++] = (unsigned char)acc;
+
+    return size;
+}
+
+/**
+ * @brief Unpack ints packed by for_pack
+ *
+ * @param const unsigned char* in
+ * @param int n
+ * @param int* v
+ * @return size_t amount of bytes read
+ */
+size_t for_unpack(const unsigned char *in, int n, int *v)
+{
+    if (n == 0)
+        return 0;
+
+    int32_t min;
+    memcpy(&min, in, sizeof(int32_t));
+    int width = in[sizeof(int32_t)];
+
+    // Unpack the offsets in place and add the frame of reference back
+    size_t size = sizeof(int32_t) + 1;
+    size += bit_unpack(in + size, n, width, (uint32_t *)v);
+
+    for (int i = 0; i < n; i++)
+        v[i] = (int)((uint32_t)min + (uint32_t)v[i]);
+
+    return size;
+}
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../include/filter.h"
+
+// Every key lives in a block of a cache line, with 128 counters of 4 bits
+#define BLOCK_BYTES 64
+#define BLOCK_COUNTERS (BLOCK_BYTES * 2)
+#define COUNTER_MAX 15
+
+struct Filter
+{
+    unsigned char *blocks; // Counters of 4 bits, two per byte
+    long n_blocks;         // Amount of blocks of the filter
+    long capacity;         // Amount of keys the filter was sized for
+    long count;            // Amount of keys in the filter
+};
+
+/**
+ * @brief Create a counting Bloom filter sized for an amount of keys
+ *
+ * @param long capacity
+ * @return Filter*
+ */
+Filter *filter_create(long capacity)
+{
+    Filter *f = (Filter *)malloc(sizeof(Filter));
+
+    if (capacity < 1)
+        capacity = 1;
+
+    f->capacity = capacity;
+    f->count = 0;
+    f->n_blocks = (capacity * FILTER_COUNTERS_PER_KEY + BLOCK_COUNTERS - 1) / BLOCK_COUNTERS;
+    f->blocks = (unsigned char *)aligned_alloc(BLOCK_BYTES, f->n_blocks * BLOCK_BYTES);
+    memset(f->blocks, 0, f->n_blocks * BLOCK_BYTES);
+
+    return f;
+}
+
+/**
+ * @brief Free memory allocated to the filter
+ *
+ * @param Filter* f
+ */
+void filter_destroy(Filter *f)
+{
+    if (f)
+    {
+        free(f->blocks);
+        free(f);
+    }
+}
+
+/**
+ * @brief Get the amount of keys in the filter
+ *
+ * @param Filter* f
+ * @return long
+ */
+long filter_count(Filter *f)
+{
+    return f->count;
+}
+
+/**
+ * @brief Get the amount of keys the filter was sized for
+ *
+ * @param Filter* f
+ * @return long
+ */
+long filter_capacity(Filter *f)
+{
+    return f->capacity;
+}
+
+/**
+ * @brief Get the largest amount of keys a filter of at most "bytes" can be sized for
+ *
+ * @param size_t bytes
+ * @return long at least 1
+ */
+long filter_capacity_within(size_t bytes)
+{
+    long capacity = (long)(bytes / BLOCK_BYTES) * BLOCK_COUNTERS / FILTER_COUNTERS_PER_KEY;
+
+    return capacity > 0 ? capacity : 1;
+}
+
+/**
+ * @brief Mix the bits of a value (splitmix64 finalizer)
+ *
+ * @param uint64_t x
+ * @return uint64_t
+ */
+static uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+
+    return x;
+}
+
+/**
+ * @brief Get the block of a key and the hash that picks its counters
+ *
+ * @param Filter* f
+ * @param int key
+ * @param uint64_t* probes
+ * @return unsigned char*
+ */
+static unsigned char *key_block(Filter *f, int key, uint64_t *probes)
+{
+    uint64_t h = mix((uint64_t)(uint32_t)key + 0x9e3779b97f4a7c15ull);
+
+    *probes = mix(h);
+
+    // Map the high bits of the hash to a block without a division
+    return f->blocks + (long)(((h >> 32) * (uint64_t)f->n_blocks) >> 32) * BLOCK_BYTES;
+}
+
+/**
+ * @brief Get a counter of a block
+ *
+ * @param const unsigned char* block
+ * @param int i
+ * @return int
+ */
+static int counter_get(const unsigned char *block, int i)
+{
+    return (block[i >> 1] >> ((i & 1) * 4)) & 0xF;
+}
+
+/**
+ * @brief Set a counter of a block
+ *
+ * @param unsigned char* block
+ * @param int i
+ * @param int v
+ */
+static void counter_set(unsigned char *block, int i, int v)
+{
+    int shift = (i & 1) * 4;
+    block[i >> 1] = (unsigned char)((block[i >> 1] & ~(0xF << shift)) | (v << shift));
+}
+
+/**
+ * @brief Add a key to the filter
+ *
+ * Counters that reach their max stay there, so removes never make them lie
+ *
+ * @param Filter* f
+ * @param int key
+ */
+void filter_add(Filter *f, int key)
+{
+    uint64_t probes;
+    unsigned char *block = key_block(f, key, &probes);
+
+    for (int j = 0; j < FILTER_PROBES; j++, probes >>= 7)
+    {
+        int i = (int)(probes & (BLOCK_COUNTERS - 1));
+        int v = counter_get(block, i);
+        if (v < COUNTER_MAX)
+            counter_set(block, i, v + 1);
+    }
+
+    f->count++;
+}
+
+/**
+ * @brief Remove a key from the filter, the key must have been added before
+ *
+ * @param Filter* f
+ * @param int key
+ */
+void filter_remove(Filter *f, int key)
+{
+    uint64_t probes;
+    unsigned char *block = key_block(f, key, &probes);
+
+    for (int j = 0; j < FILTER_PROBES; j++, probes >>= 7)
+    {
+        int i = (int)(probes & (BLOCK_COUNTERS - 1));
+        int v = counter_get(block, i);
+        if (v > 0 && v < COUNTER_MAX)
+            counter_set(block, i, v - 1);
+    }
+
+    f->count--;
+}
+
+/**
+ * @brief Check if a key may be in the filter: false is always right, true may be a false positive
+ *
+ * @param Filter* f
+ * @param int key
+ * @return true
+ * @return false
+ */
+bool filter_may_contain(Filter *f, int key)
+{
+    uint64_t probes;
+    const unsigned char *block = key_block(f, key, &probes);
+
+    for (int j = 0; j < FILTER_PROBES; j++, probes >>= 7)
+    {
+        if (!counter_get(block, (int)(probes & (BLOCK_COUNTERS - 1))))
+            return false;
+    }
+
+    return true;
+}
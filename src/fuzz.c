@@ -0,0 +1,982 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include "../include/btree.h"
+#include "../include/strtree.h"
+
+// File of the trees under test, and of the string-key trees
+#define FUZZ_PATH "fuzz.bin"
+#define FUZZ_STR_PATH "fuzz.str.bin"
+
+// Keys of a range deleted at once
+#define FUZZ_RANGE_WIDTH 64
+
+// Operations of a phase that grows the tree, followed by one that shrinks it
+#define FUZZ_PHASE 20000
+
+// Bytes of an operation in an input of the fuzzer: the operation, the key and the record
+#define FUZZ_OP_BYTES 5
+
+// Pairs of a bulk load among the operations, and the width of the range of their keys
+#define FUZZ_BULK_PAIRS 256
+#define FUZZ_BULK_SPREAD 4096
+
+// Memory limit of the rounds that run under one, small enough to spill the bulk loads
+#define FUZZ_MEMORY_LIMIT (256 << 10)
+
+// Modes tried by the runs, one per round
+static const int fuzz_flags[] = {
+    BTREE_CLASSIC,
+    BTREE_PLUS,
+    BTREE_COMPRESS,
+    BTREE_PLUS | BTREE_COMPRESS,
+    BTREE_PIN_INTERNAL,
+    BTREE_PLUS | BTREE_PIN_INTERNAL,
+    BTREE_COW,
+    BTREE_PLUS | BTREE_COW | BTREE_EYTZINGER,
+    BTREE_BLOOM | BTREE_RECORD_INDEX,
+    BTREE_PLUS | BTREE_BLOOM | BTREE_RECORD_INDEX,
+    BTREE_DUPLICATES,
+    BTREE_PLUS | BTREE_DUPLICATES | BTREE_BLOOM | BTREE_RECORD_INDEX,
+    BTREE_DIRECT,
+    BTREE_PLUS | BTREE_DIRECT | BTREE_COMPRESS,
+    BTREE_HUGE_PAGES,
+    BTREE_PLUS | BTREE_HUGE_PAGES | BTREE_PIN_INTERNAL | BTREE_DUPLICATES,
+};
+#define FUZZ_MODES (int)(sizeof(fuzz_flags) / sizeof(fuzz_flags[0]))
+
+// Mode of the rounds that test a string-key tree instead, one after each turn of the modes
+#define FUZZ_STRTREE -2
+
+// Page sizes of the string-key trees, small ones split and underflow often
+static const int fuzz_str_pages[] = {256, 320, 512, 1024, 4096};
+#define FUZZ_STR_PAGES (int)(sizeof(fuzz_str_pages) / sizeof(fuzz_str_pages[0]))
+
+// Prefixes of the string keys, so many keys share long runs of bytes
+static const char *fuzz_str_prefixes[] = {
+    "", "a", "user/", "user/profile/", "user/profile/settings/", "usr",
+    "zzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzzz/", "\xff\xfe",
+};
+#define FUZZ_STR_PREFIXES (int)(sizeof(fuzz_str_prefixes) / sizeof(fuzz_str_prefixes[0]))
+
+// Orders tried by the runs
+static const int fuzz_orders[] = {3, 4, 5, 6, 7, 8, 11, 16, 33, 64, 101};
+#define FUZZ_ORDERS (int)(sizeof(fuzz_orders) / sizeof(fuzz_orders[0]))
+
+typedef struct
+{
+    BTree *bt;    // Tree under test
+    int order;
+    int flags;
+    int *keys;    // Reference: the keys of the tree, sorted
+    int *records; // Reference: the record of each key, the first one with duplicates
+    int **more;   // Reference: the records of each key after the first one (only BTREE_DUPLICATES)
+    int *more_n;
+    int n;
+    int cap;
+    long ops;     // Operations applied since the tree was created
+} Fuzz;
+
+/**
+ * @brief Next value of a xorshift generator
+ *
+ * @param uint64_t* state
+ * @return uint64_t
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state;
+}
+
+/**
+ * @brief Get the place of the first key of the reference not smaller than "key"
+ *
+ * @param Fuzz* f
+ * @param int key
+ * @return int
+ */
+static int ref_find(Fuzz *f, int key)
+{
+    int lo = 0, hi = f->n;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (f->keys[mid] < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * @brief Check if the reference has a key
+ *
+ * @param Fuzz* f
+ * @param int key
+ * @param int* i receives the place of the key, or where it would be
+ * @return true
+ * @return false
+ */
+static bool ref_has(Fuzz *f, int key, int *i)
+{
+    *i = ref_find(f, key);
+
+    return *i < f->n && f->keys[*i] == key;
+}
+
+/**
+ * @brief Take the keys of the places [first, end) out of the reference
+ *
+ * @param Fuzz* f
+ * @param int first
+ * @param int end
+ */
+static void ref_remove(Fuzz *f, int first, int end)
+{
+    for (int i = first; i < end; i++)
+        free(f->more[i]);
+
+    memmove(&f->keys[first], &f->keys[end], (f->n - end) * sizeof(int));
+    memmove(&f->records[first], &f->records[end], (f->n - end) * sizeof(int));
+    memmove(&f->more[first], &f->more[end], (f->n - end) * sizeof(int *));
+    memmove(&f->more_n[first], &f->more_n[end], (f->n - end) * sizeof(int));
+    f->n -= end - first;
+}
+
+/**
+ * @brief Report a difference between the tree and the reference, and stop
+ *
+ * @param Fuzz* f
+ * @param const char* what
+ * @param int key
+ */
+static void fuzz_fail(Fuzz *f, const char *what, int key)
+{
+    fprintf(stderr, "fuzz: %s (key %d) after %ld operations, order %d, flags 0x%x, %d keys\n",
+            what, key, f->ops, f->order, f->flags, f->n);
+    abort();
+}
+
+/**
+ * @brief Create an empty tree and its reference
+ *
+ * @param Fuzz* f
+ * @param int order
+ * @param int flags
+ * @param int cache pages of the cache, 0 keeps the default
+ * @param size_t limit memory limit of the tree, 0 for none
+ */
+static void fuzz_open(Fuzz *f, int order, int flags, int cache, size_t limit)
+{
+    memset(f, 0, sizeof(Fuzz));
+    f->order = order;
+    f->flags = flags;
+    f->bt = btree_create(FUZZ_PATH, order, flags);
+    if (limit)
+        btree_set_memory_limit(f->bt, limit);
+    if (cache)
+        btree_set_cache_size(f->bt, cache);
+}
+
+/**
+ * @brief Destroy the tree and its files, and free the reference
+ *
+ * @param Fuzz* f
+ */
+static void fuzz_close(Fuzz *f)
+{
+    btree_destroy(f->bt);
+    remove(FUZZ_PATH);
+    remove(FUZZ_PATH BTREE_INDEX_SUFFIX);
+    remove(FUZZ_PATH BTREE_POSTINGS_SUFFIX);
+
+    for (int i = 0; i < f->n; i++)
+        free(f->more[i]);
+    free(f->keys);
+    free(f->records);
+    free(f->more);
+    free(f->more_n);
+}
+
+/**
+ * @brief Get a record of a key of the reference
+ *
+ * @param Fuzz* f
+ * @param int i place of the key
+ * @param int j 0 for its first record
+ * @return int
+ */
+static int ref_record(Fuzz *f, int i, int j)
+{
+    return j == 0 ? f->records[i] : f->more[i][j - 1];
+}
+
+/**
+ * @brief Insert a pair to the reference
+ *
+ * A key already there keeps its record, or takes one more with duplicates
+ *
+ * @param Fuzz* f
+ * @param int key
+ * @param int record
+ */
+static void ref_insert(Fuzz *f, int key, int record)
+{
+    int i;
+    bool has = ref_has(f, key, &i);
+
+    if (has && (f->flags & BTREE_DUPLICATES))
+    {
+        f->more[i] = (int *)realloc(f->more[i], (f->more_n[i] + 1) * sizeof(int));
+        f->more[i][f->more_n[i]++] = record;
+    }
+    else if (!has)
+    {
+        if (f->n == f->cap)
+        {
+            f->cap = f->cap ? f->cap * 2 : 1024;
+            f->keys = (int *)realloc(f->keys, f->cap * sizeof(int));
+            f->records = (int *)realloc(f->records, f->cap * sizeof(int));
+            f->more = (int **)realloc(f->more, f->cap * sizeof(int *));
+            f->more_n = (int *)realloc(f->more_n, f->cap * sizeof(int));
+        }
+
+        memmove(&f->keys[i + 1], &f->keys[i], (f->n - i) * sizeof(int));
+        memmove(&f->records[i + 1], &f->records[i], (f->n - i) * sizeof(int));
+        memmove(&f->more[i + 1], &f->more[i], (f->n - i) * sizeof(int *));
+        memmove(&f->more_n[i + 1], &f->more_n[i], (f->n - i) * sizeof(int));
+        f->keys[i] = key;
+        f->records[i] = record;
+        f->more[i] = NULL;
+        f->more_n[i] = 0;
+        f->n++;
+    }
+}
+
+// Walk of a scan against the reference
+typedef struct
+{
+    Fuzz *f;
+    int i;   // Place in the reference of the next key expected
+    int j;   // Record of that key expected next
+    int bad; // Key that differs, or INT_MIN if none
+} FuzzScan;
+
+/**
+ * @brief Compare a pair of the scan with the next one of the reference
+ *
+ * @param int key
+ * @param int record
+ * @param void* ctx the FuzzScan
+ * @return false on the first difference
+ */
+static bool fuzz_scan_visit(int key, int record, void *ctx)
+{
+    FuzzScan *s = (FuzzScan *)ctx;
+
+    if (s->i >= s->f->n || s->f->keys[s->i] != key || ref_record(s->f, s->i, s->j) != record)
+    {
+        s->bad = key;
+        return false;
+    }
+
+    if (++s->j > s->f->more_n[s->i])
+    {
+        s->i++;
+        s->j = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Check the rules of the tree and that it holds the same pairs of the reference
+ *
+ * @param Fuzz* f
+ */
+static void fuzz_verify(Fuzz *f)
+{
+    if (!btree_check(f->bt, stderr))
+        fuzz_fail(f, "the tree breaks a rule", 0);
+
+    FuzzScan s = {f, 0, 0, INT_MIN};
+    btree_scan(f->bt, INT_MIN, INT_MAX, fuzz_scan_visit, &s);
+    if (s.bad != INT_MIN || s.i != f->n)
+        fuzz_fail(f, "the scan differs", s.bad != INT_MIN ? s.bad : s.i);
+
+    // Every key is found with its record, and all of them with duplicates
+    for (int i = 0; i < f->n; i++)
+    {
+        bool found;
+        int record;
+
+        btree_search_batch(f->bt, &f->keys[i], 1, &found, &record);
+        if (!found || record != f->records[i])
+            fuzz_fail(f, "a key of the reference isn't found", f->keys[i]);
+
+        FuzzScan all = {f, i, 0, INT_MIN};
+        long count = btree_get_all(f->bt, f->keys[i], fuzz_scan_visit, &all);
+        if (count != 1 + f->more_n[i] || all.bad != INT_MIN || all.i != i + 1)
+            fuzz_fail(f, "the records of a key differ", f->keys[i]);
+    }
+}
+
+/**
+ * @brief Bulk load pairs of random keys to the tree and to the reference, then check them
+ *
+ * Repeated keys keep the last pair, or every pair with duplicates; keys
+ * already in the tree keep their records, as with inserts
+ *
+ * @param Fuzz* f
+ * @param uint64_t seed not 0
+ * @param int n pairs
+ * @param int lo smallest key
+ * @param int spread keys are taken from [lo, lo + spread)
+ */
+static void fuzz_bulk(Fuzz *f, uint64_t seed, int n, int lo, int spread)
+{
+    int *keys = (int *)calloc(n, sizeof(int));
+    int *records = (int *)calloc(n, sizeof(int));
+
+    for (int i = 0; i < n; i++)
+    {
+        keys[i] = (int)((long)lo + (long)(next_random(&seed) % spread));
+        records[i] = (int)(next_random(&seed) % 1000000);
+    }
+
+    f->ops++;
+    btree_bulk_load(f->bt, keys, records, n, 0);
+
+    // Without duplicates only the last pair of a key counts, so the pairs go
+    // from the last one: the reference keeps the first record it is given
+    for (int i = 0; i < n; i++)
+    {
+        int j = f->flags & BTREE_DUPLICATES ? i : n - 1 - i;
+        ref_insert(f, keys[j], records[j]);
+    }
+
+    free(keys);
+    free(records);
+
+    fuzz_verify(f);
+}
+
+/**
+ * @brief Apply an operation to the tree and to the reference
+ *
+ * 'I' inserts, 'B' searches and 'R' removes, as in the entry files; 'D'
+ * deletes a range of keys from "key", 'U' changes the record of a key, 'L'
+ * bulk loads pairs of keys from "key" and 'O' rebuilds the tree to another
+ * order, checking the tree after them
+ *
+ * @param Fuzz* f
+ * @param char op
+ * @param int key
+ * @param int record
+ */
+static void fuzz_apply(Fuzz *f, char op, int key, int record)
+{
+    int i;
+    bool has = ref_has(f, key, &i);
+
+    f->ops++;
+
+    if (op == 'I')
+    {
+        btree_insert(f->bt, key, record);
+        ref_insert(f, key, record);
+    }
+    else if (op == 'B')
+    {
+        if (btree_search(f->bt, key) != has)
+            fuzz_fail(f, has ? "a key in the tree isn't found" : "a key out of the tree is found", key);
+    }
+    else if (op == 'R')
+    {
+        btree_delete(f->bt, key);
+
+        if (has)
+            ref_remove(f, i, i + 1);
+    }
+    else if (op == 'D')
+    {
+        int hi = key > INT_MAX - FUZZ_RANGE_WIDTH ? INT_MAX : key + FUZZ_RANGE_WIDTH;
+        btree_delete_range(f->bt, key, hi);
+
+        int end = ref_find(f, hi);
+        if (end < f->n && f->keys[end] == hi)
+            end++;
+
+        if (end > i)
+            ref_remove(f, i, end);
+    }
+    else if (op == 'U')
+    {
+        if (btree_update(f->bt, key, record) != has)
+            fuzz_fail(f, "the update disagrees on the key", key);
+        if (has)
+        {
+            f->records[i] = record;
+            free(f->more[i]);
+            f->more[i] = NULL;
+            f->more_n[i] = 0;
+        }
+    }
+    else if (op == 'L')
+    {
+        fuzz_bulk(f, (uint64_t)(unsigned)key << 32 | (unsigned)record | 1, FUZZ_BULK_PAIRS, key, FUZZ_BULK_SPREAD);
+    }
+    else if (op == 'O')
+    {
+        // The tree moves to another order, or to the largest one that fits a page
+        int order = (unsigned)record % (FUZZ_ORDERS + 1) < FUZZ_ORDERS ? fuzz_orders[(unsigned)record % (FUZZ_ORDERS + 1)] : 0;
+        // A snapshot held over the rebuild keeps the old pages, so it is refused
+        BTreeSnapshot *s = btree_snapshot_acquire(f->bt);
+        if (s && btree_rebuild(f->bt, order, 0))
+            fuzz_fail(f, "the tree is rebuilt under a snapshot", key);
+        btree_snapshot_release(s);
+
+        if (!btree_rebuild(f->bt, order, 0))
+            fuzz_fail(f, "the tree isn't rebuilt", key);
+        f->order = order;
+        fuzz_verify(f);
+    }
+}
+
+/**
+ * @brief Run an input of the fuzzer
+ *
+ * The first byte picks the order, the second the mode and the memory limit,
+ * and every group of FUZZ_OP_BYTES after them is an operation, with 16-bit
+ * keys and records so the same keys come back
+ *
+ * @param const uint8_t* data
+ * @param size_t size
+ */
+static void fuzz_run_bytes(const uint8_t *data, size_t size)
+{
+    static const char ops[] = {'I', 'I', 'B', 'R', 'R', 'D', 'U', 'L', 'O'};
+
+    if (size < 2)
+        return;
+
+    Fuzz f;
+    size_t limit = data[1] / FUZZ_MODES % 2 ? FUZZ_MEMORY_LIMIT : 0;
+    fuzz_open(&f, 3 + data[0] % 62, fuzz_flags[data[1] % FUZZ_MODES], 1 + data[0] / 62, limit);
+
+    for (size_t p = 2; p + FUZZ_OP_BYTES <= size; p += FUZZ_OP_BYTES)
+    {
+        char op = ops[data[p] % sizeof(ops)];
+        int key = (int16_t)(data[p + 1] | data[p + 2] << 8);
+        int record = (int16_t)(data[p + 3] | data[p + 4] << 8);
+
+        // Trees with duplicates only keep records that aren't negative
+        if (f.flags & BTREE_DUPLICATES)
+            record &= INT16_MAX;
+
+        fuzz_apply(&f, op, key, record);
+    }
+
+    fuzz_verify(&f);
+    fuzz_close(&f);
+}
+
+#ifdef BTREE_LIBFUZZER
+
+/**
+ * @brief Entry point of libFuzzer
+ *
+ * @param const uint8_t* data
+ * @param size_t size
+ * @return int
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    fuzz_run_bytes(data, size);
+
+    return 0;
+}
+
+#else
+
+// Pair of the reference of a string-key tree
+typedef struct
+{
+    char *key;
+    int len;
+    int record;
+} FuzzStrPair;
+
+typedef struct
+{
+    StrTree *st;        // String-key tree under test
+    int page_size;
+    int max_len;        // Longest key the tree takes
+    FuzzStrPair *pairs; // Reference: the pairs of the tree, sorted by key
+    int n;
+    int cap;
+    long ops;           // Operations applied since the tree was created
+} FuzzStr;
+
+/**
+ * @brief Compare two byte strings as the string-key tree does: bytes first, then length
+ *
+ * @param const char* a
+ * @param int alen
+ * @param const char* b
+ * @param int blen
+ * @return int
+ */
+static int str_compare(const char *a, int alen, const char *b, int blen)
+{
+    int res = memcmp(a, b, alen < blen ? alen : blen);
+
+    return res ? res : alen - blen;
+}
+
+/**
+ * @brief Get the place of the first key of the reference not smaller than "key"
+ *
+ * @param FuzzStr* f
+ * @param const char* key
+ * @param int len
+ * @return int
+ */
+static int str_ref_find(FuzzStr *f, const char *key, int len)
+{
+    int lo = 0, hi = f->n;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (str_compare(f->pairs[mid].key, f->pairs[mid].len, key, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * @brief Report a difference between the string-key tree and the reference, and stop
+ *
+ * @param FuzzStr* f
+ * @param const char* what
+ * @param const char* key
+ * @param int len
+ */
+static void fuzz_str_fail(FuzzStr *f, const char *what, const char *key, int len)
+{
+    fprintf(stderr, "fuzz: %s (key \"%.*s\", %d bytes) after %ld operations of a string-key tree, pages of %d bytes, %d keys\n",
+            what, len, key, len, f->ops, f->page_size, f->n);
+    abort();
+}
+
+/**
+ * @brief Make a key of a string-key tree: a shared prefix, a number and a padding
+ *
+ * Some keys are longer than the tree takes, to check that they are refused
+ *
+ * @param uint64_t* state
+ * @param int keys numbers are taken from [0, keys)
+ * @param int max_len
+ * @param char* buf room for max_len + 8 bytes
+ * @return int length of the key
+ */
+static int fuzz_str_key(uint64_t *state, int keys, int max_len, char *buf)
+{
+    const char *prefix = fuzz_str_prefixes[next_random(state) % FUZZ_STR_PREFIXES];
+    int len = (int)strlen(prefix);
+    memcpy(buf, prefix, len);
+
+    len += snprintf(buf + len, 16, "%d", (int)(next_random(state) % keys));
+
+    // Padding of a few bytes, or up to past the longest key
+    int pad = next_random(state) % 8 ? (int)(next_random(state) % 4) : (int)(next_random(state) % (max_len + 8));
+    char fill = "x\0~"[next_random(state) % 3];
+    for (int i = 0; i < pad && len < max_len + 8; i++)
+        buf[len++] = fill;
+
+    return len;
+}
+
+// Walk of a scan of a string-key tree against the reference
+typedef struct
+{
+    FuzzStr *f;
+    int i;   // Place in the reference of the next pair expected
+    int end; // Place after the last pair expected
+    bool bad;
+} FuzzStrScan;
+
+/**
+ * @brief Compare a pair of the scan with the next one of the reference
+ *
+ * @param const char* key
+ * @param size_t len
+ * @param int record
+ * @param void* ctx the FuzzStrScan
+ * @return false on the first difference
+ */
+static bool fuzz_str_scan_visit(const char *key, size_t len, int record, void *ctx)
+{
+    FuzzStrScan *s = (FuzzStrScan *)ctx;
+    FuzzStrPair *p = &s->f->pairs[s->i];
+
+    if (s->i >= s->end || str_compare(p->key, p->len, key, (int)len) != 0 || p->record != record)
+    {
+        s->bad = true;
+        return false;
+    }
+
+    s->i++;
+    return true;
+}
+
+/**
+ * @brief Scan a range of the string-key tree and compare it with the reference
+ *
+ * @param FuzzStr* f
+ * @param const char* lo
+ * @param int lo_len
+ * @param const char* hi
+ * @param int hi_len
+ */
+static void fuzz_str_scan(FuzzStr *f, const char *lo, int lo_len, const char *hi, int hi_len)
+{
+    FuzzStrScan s = {f, str_ref_find(f, lo, lo_len), str_ref_find(f, hi, hi_len), false};
+    if (s.end < f->n && str_compare(f->pairs[s.end].key, f->pairs[s.end].len, hi, hi_len) == 0)
+        s.end++;
+    if (s.end < s.i)
+        s.end = s.i;
+
+    strtree_scan(f->st, lo, lo_len, hi, hi_len, fuzz_str_scan_visit, &s);
+    if (s.bad || s.i != s.end)
+        fuzz_str_fail(f, "the scan differs", lo, lo_len);
+}
+
+/**
+ * @brief Check that the string-key tree holds the same pairs of the reference
+ *
+ * @param FuzzStr* f
+ * @param char* top a key above every key of the tree, of max_len + 1 bytes
+ */
+static void fuzz_str_verify(FuzzStr *f, const char *top)
+{
+    fuzz_str_scan(f, "", 0, top, f->max_len + 1);
+
+    for (int i = 0; i < f->n; i++)
+    {
+        int record;
+        if (!strtree_search(f->st, f->pairs[i].key, f->pairs[i].len, &record) || record != f->pairs[i].record)
+            fuzz_str_fail(f, "a key of the reference isn't found", f->pairs[i].key, f->pairs[i].len);
+    }
+}
+
+/**
+ * @brief Apply an operation to the string-key tree and to the reference
+ *
+ * 'I' inserts, 'B' searches, 'R' removes and 'S' scans from the key to
+ * another one made from "record"
+ *
+ * @param FuzzStr* f
+ * @param char op
+ * @param const char* key
+ * @param int len
+ * @param int record
+ * @param const char* other
+ * @param int other_len
+ */
+static void fuzz_str_apply(FuzzStr *f, char op, const char *key, int len, int record, const char *other, int other_len)
+{
+    int i = str_ref_find(f, key, len);
+    bool has = i < f->n && str_compare(f->pairs[i].key, f->pairs[i].len, key, len) == 0;
+
+    f->ops++;
+
+    if (op == 'I')
+    {
+        // Keys already in the tree and keys too long are refused
+        bool fits = len <= f->max_len;
+        if (strtree_insert(f->st, key, len, record) != (!has && fits))
+            fuzz_str_fail(f, "the insert disagrees on the key", key, len);
+
+        if (!has && fits)
+        {
+            if (f->n == f->cap)
+            {
+                f->cap = f->cap ? f->cap * 2 : 1024;
+                f->pairs = (FuzzStrPair *)realloc(f->pairs, f->cap * sizeof(FuzzStrPair));
+            }
+
+            memmove(&f->pairs[i + 1], &f->pairs[i], (f->n - i) * sizeof(FuzzStrPair));
+            f->pairs[i].key = (char *)malloc(len ? len : 1);
+            memcpy(f->pairs[i].key, key, len);
+            f->pairs[i].len = len;
+            f->pairs[i].record = record;
+            f->n++;
+        }
+    }
+    else if (op == 'B')
+    {
+        int found;
+        if (strtree_search(f->st, key, len, &found) != has || (has && found != f->pairs[i].record))
+            fuzz_str_fail(f, has ? "a key in the tree isn't found" : "a key out of the tree is found", key, len);
+    }
+    else if (op == 'R')
+    {
+        if (strtree_delete(f->st, key, len) != has)
+            fuzz_str_fail(f, "the delete disagrees on the key", key, len);
+
+        if (has)
+        {
+            free(f->pairs[i].key);
+            memmove(&f->pairs[i], &f->pairs[i + 1], (f->n - i - 1) * sizeof(FuzzStrPair));
+            f->n--;
+        }
+    }
+    else if (op == 'S')
+    {
+        if (str_compare(key, len, other, other_len) <= 0)
+            fuzz_str_scan(f, key, len, other, other_len);
+        else
+            fuzz_str_scan(f, other, other_len, key, len);
+    }
+}
+
+/**
+ * @brief Run operations on a new string-key tree, checking it against a sorted reference
+ *
+ * Keys have many lengths and share long prefixes, so the separators of the
+ * splits are truncated and the leaves underflow as the keys are removed
+ *
+ * @param uint64_t* state
+ * @param long ops
+ * @param int keys numbers of the keys are taken from [0, keys)
+ * @param int batch operations between two full checks
+ * @param int page_size
+ */
+static void fuzz_str_run(uint64_t *state, long ops, int keys, int batch, int page_size)
+{
+    static char path[] = FUZZ_STR_PATH;
+    FuzzStr f;
+
+    memset(&f, 0, sizeof(FuzzStr));
+    f.page_size = page_size;
+    f.st = strtree_create(path, page_size);
+    f.max_len = (int)strtree_max_key_len(f.st);
+    strtree_set_cache_size(f.st, 1 + (int)(next_random(state) % 16));
+
+    char *key = (char *)malloc(f.max_len + 8);
+    char *other = (char *)malloc(f.max_len + 8);
+    char *top = (char *)malloc(f.max_len + 1);
+    memset(top, 0xff, f.max_len + 1);
+
+    for (long i = 0; i < ops; i++)
+    {
+        // Phases that mostly insert alternate with phases that mostly remove
+        bool grow = (i / FUZZ_PHASE) % 2 == 0;
+        int inserts = grow ? 55 : 15;
+        int pick = (int)(next_random(state) % 100);
+        int record = (int)(next_random(state) % 1000000);
+        int len = fuzz_str_key(state, keys, f.max_len, key);
+        int other_len = 0;
+
+        char op;
+        if (pick < inserts)
+            op = 'I';
+        else if (pick < inserts + 25)
+            op = 'B';
+        else if (pick < 97)
+            op = 'R';
+        else
+            op = 'S';
+
+        // Most removes hit a key of the tree
+        if (op == 'R' && f.n && pick % 4)
+        {
+            FuzzStrPair *p = &f.pairs[next_random(state) % f.n];
+            memcpy(key, p->key, p->len);
+            len = p->len;
+        }
+        if (op == 'S')
+            other_len = fuzz_str_key(state, keys, f.max_len, other);
+
+        fuzz_str_apply(&f, op, key, len, record, other, other_len);
+
+        if (f.ops % batch == 0)
+            fuzz_str_verify(&f, top);
+    }
+
+    fuzz_str_verify(&f, top);
+
+    strtree_destroy(f.st);
+    remove(FUZZ_STR_PATH);
+    for (int i = 0; i < f.n; i++)
+        free(f.pairs[i].key);
+    free(f.pairs);
+    free(key);
+    free(other);
+    free(top);
+}
+
+/**
+ * @brief Run an input saved by libFuzzer, to reproduce it without the fuzzer
+ *
+ * @param const char* path
+ */
+static void fuzz_replay(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp)
+    {
+        perror("Couldn't open the input file.\n");
+        exit(1);
+    }
+
+    uint8_t *data = NULL;
+    size_t size = 0, cap = 0, got;
+
+    do
+    {
+        if (size == cap)
+        {
+            cap = cap ? cap * 2 : 4096;
+            data = (uint8_t *)realloc(data, cap);
+        }
+        got = fread(data + size, 1, cap - size, fp);
+        size += got;
+    } while (got);
+
+    fclose(fp);
+
+    fuzz_run_bytes(data, size);
+    free(data);
+}
+
+int main(int argc, char *argv[])
+{
+    long ops = 1000000;
+    long round = 100000;
+    int keys = 10000;
+    int batch = 1000;
+    uint64_t seed = 1;
+    int order = 0;
+    int flags = -1;
+
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (!strcmp(argv[i], "--replay"))
+        {
+            fuzz_replay(argv[i + 1]);
+            printf("ok\n");
+            return 0;
+        }
+        else if (!strcmp(argv[i], "--ops"))
+            ops = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--round"))
+            round = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--keys"))
+            keys = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--batch"))
+            batch = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed"))
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--order"))
+            order = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--flags"))
+            flags = (int)strtol(argv[++i], NULL, 0);
+    }
+
+    // Only the string-key tree is tested
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--strtree"))
+            flags = FUZZ_STRTREE;
+    }
+
+    if (ops < 1 || round < 1 || keys < 1 || batch < 1 || seed == 0 || (order && order < 3))
+    {
+        fprintf(stderr, "usage: %s [--ops n] [--round n] [--keys n] [--batch n] [--seed n] [--order n] [--flags n | --strtree] | --replay <file>\n", argv[0]);
+        return 1;
+    }
+
+    uint64_t state = seed;
+    long done = 0;
+
+    // Each round builds a new tree, with the next order, mode, cache size and
+    // memory limit; every other round starts with a bulk load of half the keys.
+    // A string-key tree takes a round after each turn of the modes
+    for (int r = 0; done < ops; r++)
+    {
+        Fuzz f;
+        int o = order ? order : fuzz_orders[r % FUZZ_ORDERS];
+        int turn = r % (FUZZ_MODES + 1);
+        int m = flags != -1 ? flags : turn < FUZZ_MODES ? fuzz_flags[turn] : FUZZ_STRTREE;
+
+        if (m == FUZZ_STRTREE)
+        {
+            long amount = ops - done < round ? ops - done : round;
+            fuzz_str_run(&state, amount, keys, batch, fuzz_str_pages[r % FUZZ_STR_PAGES]);
+            done += amount;
+            continue;
+        }
+        fuzz_open(&f, o, m, r % 3 == 0 ? 1 + r % 7 : 0, r % 4 == 1 ? FUZZ_MEMORY_LIMIT : 0);
+
+        if (r % 2 == 0)
+            fuzz_bulk(&f, next_random(&state), keys / 2 + 1, 0, keys);
+
+        for (long i = 0; i < round && done < ops; i++, done++)
+        {
+            // Phases that mostly insert alternate with phases that mostly remove
+            bool grow = (i / FUZZ_PHASE) % 2 == 0;
+            int inserts = grow ? 55 : 15;
+            int pick = (int)(next_random(&state) % 100);
+            int key = (int)(next_random(&state) % keys);
+            int record = (int)(next_random(&state) % 1000000);
+
+            char op;
+            if (pick < inserts)
+                op = 'I';
+            else if (pick < inserts + 25)
+                op = 'B';
+            else if (pick < 97)
+                op = 'R';
+            else if (pick < 98)
+                op = 'D';
+            else if (pick < 99 || record % 50 > 1)
+                op = 'U';
+            else
+                op = record % 50 ? 'L' : 'O';
+
+            // Most removes hit a key of the tree
+            if (op == 'R' && f.n && pick % 4)
+                key = f.keys[next_random(&state) % f.n];
+
+            fuzz_apply(&f, op, key, record);
+
+            if (f.ops % batch == 0)
+                fuzz_verify(&f);
+        }
+
+        fuzz_verify(&f);
+        fuzz_close(&f);
+    }
+
+    printf("ok: %ld operations\n", done);
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../include/server.h"
+
+// Keys of the range of a scan
+#define LOADGEN_SCAN_WIDTH 100
+
+typedef struct
+{
+    const char *path; // Socket of the server
+    int id;           // Index of the client, seeds its keys
+    long requests;    // Requests sent by the client
+    int depth;        // Requests sent before the responses are read
+    int keys;         // Keys are taken from [0, keys)
+    int mix[4];       // Percent of inserts, gets, deletes and scans
+    long done[4];     // Requests answered, per operation
+    long found;       // Gets of a key in the tree
+    double max_window; // Slowest window of requests, in seconds
+} LoadClient;
+
+/**
+ * @brief Get the time in seconds
+ *
+ * @return double
+ */
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Next value of a xorshift generator
+ *
+ * @param uint64_t* state
+ * @return uint64_t
+ */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+
+    return *state;
+}
+
+/**
+ * @brief Read exactly "len" bytes of the socket
+ *
+ * @param int fd
+ * @param void* buf
+ * @param size_t len
+ */
+static void read_full(int fd, void *buf, size_t len)
+{
+    size_t off = 0;
+
+    while (off < len)
+    {
+        ssize_t n = recv(fd, (char *)buf + off, len - off, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            perror("The server closed the connection.\n");
+            exit(1);
+        }
+        off += n;
+    }
+}
+
+/**
+ * @brief Send exactly "len" bytes to the socket
+ *
+ * @param int fd
+ * @param const void* buf
+ * @param size_t len
+ */
+static void write_full(int fd, const void *buf, size_t len)
+{
+    size_t off = 0;
+
+    while (off < len)
+    {
+        ssize_t n = send(fd, (const char *)buf + off, len - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            perror("The system couldn't send to the server.\n");
+            exit(1);
+        }
+        off += n;
+    }
+}
+
+/**
+ * @brief Connect to the server
+ *
+ * @param const char* path
+ * @return int
+ */
+static int connect_server(const char *path)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        perror("The system couldn't connect to the server.\n");
+        exit(1);
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Send the requests of a client, "depth" at a time, and read their responses
+ *
+ * @param void* arg the LoadClient
+ * @return void*
+ */
+static void *client_run(void *arg)
+{
+    LoadClient *lc = (LoadClient *)arg;
+    int fd = connect_server(lc->path);
+    uint64_t state = 0x9E3779B97F4A7C15ull * (lc->id + 1);
+
+    ServerRequest *reqs = (ServerRequest *)malloc(lc->depth * sizeof(ServerRequest));
+    ServerPair *pairs = (ServerPair *)malloc(SERVER_SCAN_LIMIT * sizeof(ServerPair));
+    uint32_t ops[] = {SERVER_OP_INSERT, SERVER_OP_GET, SERVER_OP_DELETE, SERVER_OP_SCAN};
+
+    for (long sent = 0; sent < lc->requests;)
+    {
+        int window = lc->requests - sent < lc->depth ? (int)(lc->requests - sent) : lc->depth;
+
+        for (int i = 0; i < window; i++)
+        {
+            int pick = (int)(next_random(&state) % 100);
+            int op = 0;
+            while (op < 3 && pick >= lc->mix[op])
+                pick -= lc->mix[op++];
+
+            reqs[i].op = ops[op];
+            reqs[i].key = (int32_t)(next_random(&state) % lc->keys);
+            reqs[i].value = ops[op] == SERVER_OP_SCAN ? reqs[i].key + LOADGEN_SCAN_WIDTH : (int32_t)sent + i;
+        }
+
+        double start = now_seconds();
+        write_full(fd, reqs, window * sizeof(ServerRequest));
+
+        for (int i = 0; i < window; i++)
+        {
+            ServerResponse res;
+            read_full(fd, &res, sizeof(res));
+            if (res.count)
+                read_full(fd, pairs, res.count * sizeof(ServerPair));
+
+            for (int op = 0; op < 4; op++)
+            {
+                if (reqs[i].op == ops[op])
+                    lc->done[op]++;
+            }
+            if (reqs[i].op == SERVER_OP_GET && res.status == SERVER_OK)
+                lc->found++;
+        }
+
+        double elapsed = now_seconds() - start;
+        if (elapsed > lc->max_window)
+            lc->max_window = elapsed;
+
+        sent += window;
+    }
+
+    free(reqs);
+    free(pairs);
+    close(fd);
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <socket> [--clients n] [--requests n] [--depth n] [--keys n] [--mix insert,get,delete,scan]\n", argv[0]);
+        return 1;
+    }
+
+    int clients = 4;
+    long requests = 100000;
+    int depth = 32;
+    int keys = 1000000;
+    int mix[4] = {40, 50, 5, 5};
+
+    for (int i = 2; i + 1 < argc; i++)
+    {
+        if (!strcmp(argv[i], "--clients"))
+            clients = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--requests"))
+            requests = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--depth"))
+            depth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--keys"))
+            keys = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--mix"))
+            sscanf(argv[++i], "%d,%d,%d,%d", &mix[0], &mix[1], &mix[2], &mix[3]);
+    }
+
+    if (clients < 1 || depth < 1 || keys < 1 || mix[0] + mix[1] + mix[2] + mix[3] != 100)
+    {
+        fprintf(stderr, "Invalid options, the mix must add up to 100.\n");
+        return 1;
+    }
+
+    LoadClient *lcs = (LoadClient *)calloc(clients, sizeof(LoadClient));
+    pthread_t *threads = (pthread_t *)malloc(clients * sizeof(pthread_t));
+
+    double start = now_seconds();
+
+    for (int i = 0; i < clients; i++)
+    {
+        lcs[i].path = argv[1];
+        lcs[i].id = i;
+        lcs[i].requests = requests;
+        lcs[i].depth = depth;
+        lcs[i].keys = keys;
+        memcpy(lcs[i].mix, mix, sizeof(mix));
+        pthread_create(&threads[i], NULL, client_run, &lcs[i]);
+    }
+
+    long done[4] = {0, 0, 0, 0};
+    long found = 0;
+    double max_window = 0;
+
+    for (int i = 0; i < clients; i++)
+    {
+        pthread_join(threads[i], NULL);
+        for (int op = 0; op < 4; op++)
+            done[op] += lcs[i].done[op];
+        found += lcs[i].found;
+        if (lcs[i].max_window > max_window)
+            max_window = lcs[i].max_window;
+    }
+
+    double elapsed = now_seconds() - start;
+    long total = done[0] + done[1] + done[2] + done[3];
+
+    printf("requests: %ld (insert %ld, get %ld, delete %ld, scan %ld)\n", total, done[0], done[1], done[2], done[3]);
+    printf("gets found: %ld\n", found);
+    printf("seconds: %.3f\n", elapsed);
+    printf("requests/s: %.0f\n", total / elapsed);
+    printf("slowest window of %d requests: %.3f ms\n", depth, max_window * 1000);
+
+    free(lcs);
+    free(threads);
+
+    return 0;
+}
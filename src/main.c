@@ -1,11 +1,92 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
 #include "../include/btree.h"
+#include "../include/server.h"
 
 int main(int argc, char *argv[])
 {
-    int order;
+    int order = 0;
     int n_op;
+    int flags = BTREE_CLASSIC;
+    char *export_path = NULL;
+    char *bulk_path = NULL;
+    size_t page_size = 0;
+    bool calibrate = false;
+    int rebuild_order = -1;
+    size_t memory_limit = 0;
+    bool latency = false;
+    char *trace_path = NULL;
+
+    // Optional modes of the tree, given after the entry and exit files
+    for (int i = 3; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--plus"))
+            flags |= BTREE_PLUS;
+        if (!strcmp(argv[i], "--compress"))
+            flags |= BTREE_COMPRESS;
+        if (!strcmp(argv[i], "--eytzinger"))
+            flags |= BTREE_EYTZINGER;
+        if (!strcmp(argv[i], "--pin-internal"))
+            flags |= BTREE_PIN_INTERNAL;
+        if (!strcmp(argv[i], "--cow"))
+            flags |= BTREE_COW;
+        if (!strcmp(argv[i], "--bloom"))
+            flags |= BTREE_BLOOM;
+        if (!strcmp(argv[i], "--direct"))
+            flags |= BTREE_DIRECT;
+        if (!strcmp(argv[i], "--record-index"))
+            flags |= BTREE_RECORD_INDEX;
+        if (!strcmp(argv[i], "--duplicates"))
+            flags |= BTREE_DUPLICATES;
+        if (!strcmp(argv[i], "--huge-pages"))
+            flags |= BTREE_HUGE_PAGES;
+        if (!strcmp(argv[i], "--export") && i + 1 < argc)
+            export_path = argv[++i];
+        if (!strcmp(argv[i], "--bulk") && i + 1 < argc)
+            bulk_path = argv[++i];
+        if (!strcmp(argv[i], "--page-size") && i + 1 < argc)
+            page_size = strtoul(argv[++i], NULL, 10);
+        if (!strcmp(argv[i], "--calibrate"))
+            calibrate = true;
+        if (!strcmp(argv[i], "--rebuild") && i + 1 < argc)
+            rebuild_order = atoi(argv[++i]);
+        if (!strcmp(argv[i], "--memory-limit") && i + 1 < argc)
+            memory_limit = strtoull(argv[++i], NULL, 10);
+        if (!strcmp(argv[i], "--order") && i + 1 < argc)
+            order = atoi(argv[++i]);
+        if (!strcmp(argv[i], "--latency"))
+            latency = true;
+        if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+            trace_path = argv[++i];
+    }
+
+    // Keep the tree open and serve it on a socket, instead of running an entry file
+    if (argc > 2 && !strcmp(argv[1], "--serve"))
+    {
+        if (calibrate)
+            page_size = btree_calibrate_page_size("btree.bin", flags);
+
+        BTree *bt = page_size ? btree_create_paged("btree.bin", page_size, flags) : btree_create("btree.bin", order, flags);
+        if (memory_limit)
+            btree_set_memory_limit(bt, memory_limit);
+        btree_set_latency_stats(bt, latency);
+        if (trace_path)
+            btree_trace_open(bt, trace_path, 0);
+
+        server_run(bt, argv[2]);
+
+        if (latency)
+            btree_latency_print(bt, stdout);
+        btree_destroy(bt);
+
+        remove("btree.bin");
+        remove("btree.bin" BTREE_INDEX_SUFFIX);
+        remove("btree.bin" BTREE_POSTINGS_SUFFIX);
+
+        return 0;
+    }
 
     // Open entry's file
     FILE *fp = fopen(argv[1], "r");
@@ -28,8 +109,34 @@ int main(int argc, char *argv[])
     fscanf(fp, "%d\n", &order);
     fscanf(fp, "%d\n", &n_op);
 
+    // The order of the entry file is only used when the nodes aren't sized by the page
+    if (calibrate)
+        page_size = btree_calibrate_page_size("btree.bin", flags);
+
     // Create the tree
-    BTree *bt = btree_create("btree.bin", order);
+    BTree *bt = page_size ? btree_create_paged("btree.bin", page_size, flags) : btree_create("btree.bin", order, flags);
+    if (memory_limit)
+        btree_set_memory_limit(bt, memory_limit);
+
+    // Time the operations and write their events to a trace, if asked
+    btree_set_latency_stats(bt, latency);
+    if (trace_path)
+        btree_trace_open(bt, trace_path, 0);
+
+    // Load the pairs of the bulk file before the operations
+    if (bulk_path)
+    {
+        FILE *fp3 = fopen(bulk_path, "r");
+
+        if (!fp3)
+        {
+            perror("Couldn't open the bulk file.\n");
+            exit(1);
+        }
+
+        btree_bulk_load_file(bt, fp3, 0);
+        fclose(fp3);
+    }
 
     for (int i = 0; i < n_op; i++)
     {
@@ -45,7 +152,8 @@ int main(int argc, char *argv[])
         {
             fscanf(fp, ", %d", &record);
 
-            btree_insert(bt, key, record);
+            if (!btree_insert(bt, key, record))
+                fprintf(stderr, "The record %d of the key %d can't be kept by the tree, it was skipped.\n", record, key);
         }
 
         // Search operation
@@ -71,18 +179,51 @@ int main(int argc, char *argv[])
         fscanf(fp, "\n");
     }
 
+    // Move the tree to another order after the operations, if asked
+    if (rebuild_order >= 0 && !btree_rebuild(bt, rebuild_order, page_size))
+        fprintf(stderr, "The tree couldn't be rebuilt while a snapshot of it is held.\n");
+
+    // Export the tree in the binary format, if asked
+    if (export_path)
+    {
+        FILE *fp3 = fopen(export_path, "wb");
+
+        if (!fp3)
+        {
+            perror("Couldn't create the export file.\n");
+            exit(1);
+        }
+
+        btree_export(bt, fp3, BTREE_EXPORT_BINARY, 0);
+        fclose(fp3);
+    }
+
     // Print the tree in level-order
     fprintf(fp2, "\n-- ARVORE B\n");
     btree_level_order_print(bt, fp2);
 
+    // Print the time of the operations, if asked
+    if (latency)
+        btree_latency_print(bt, stdout);
+
+    // Print how much of the memory of the tree got reserved huge pages
+    if (flags & BTREE_HUGE_PAGES)
+    {
+        size_t mapped;
+        size_t huge = btree_huge_page_bytes(bt, &mapped);
+        printf("huge pages: %zu of %zu bytes reserved\n", huge, mapped);
+    }
+
     // Destroy memory allocated and close the file
     btree_destroy(bt);
 
     fclose(fp);
     fclose(fp2);
 
-    // Destroy the binary file used in B-Tree
+    // Destroy the binary file used in B-Tree, its index and its lists
     remove("btree.bin");
+    remove("btree.bin" BTREE_INDEX_SUFFIX);
+    remove("btree.bin" BTREE_POSTINGS_SUFFIX);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,1592 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "../include/arena.h"
+#include "../include/pager.h"
+
+// Mapped pages are stored in extents of 2^class bytes, from 32 bytes up, or in
+// an extent of the size of a whole (encoded) page
+#define EXTENT_MIN_CLASS 5
+#define EXTENT_CLASSES 32
+#define EXTENT_PAGE_CLASS (EXTENT_CLASSES - 1)
+
+// Amount of pages described by each chunk of the map
+#define MAP_CHUNK 512
+
+// Epoch of the views when there are no views
+#define NO_EPOCH UINT_MAX
+
+// Max amount of buffers given to a single write of a flush
+#define FLUSH_IOVECS 512
+
+typedef struct
+{
+    long off;          // Offset of the extent in the file, -1 if the page was never written
+    int len;           // Amount of bytes used in the extent
+    unsigned char cls; // Size class of the extent
+    unsigned birth;    // Epoch in which the extent was written
+} PageExtent;
+
+typedef struct
+{
+    int refs;                // Amount of maps (the pager's and the views') sharing the chunk
+    PageExtent e[MAP_CHUNK]; // Extents of the pages of the chunk
+} MapChunk;
+
+typedef struct
+{
+    long off;          // Offset of the extent in the file
+    unsigned char cls; // Size class of the extent
+    unsigned epoch;    // Epoch in which the extent stopped being the current one
+} RetiredExtent;
+
+struct PagerView
+{
+    Pager *p;              // Pager of the view
+    MapChunk **chunks;     // Map of the pages frozen when the view was taken
+    int n_chunks;          // Amount of chunks of the map
+    unsigned epoch;        // Epoch of the view
+    unsigned char *io_buf; // Buffer with the encoded image of a page
+};
+
+// Page written back by a flush
+typedef struct
+{
+    int pos;          // Position of the page
+    int slot;         // Slot of the cache with its image
+    long off;         // Offset of its extent in the file
+    size_t len;       // Amount of bytes of the image
+    size_t pad;       // Bytes of the extent after the image
+    const void *data; // Image written to the file
+} FlushWrite;
+
+struct PagerReader
+{
+    Pager *p;              // Pager of the reader
+    MapChunk **chunks;     // Map of the pages of a view, NULL reads the current pages
+    int n_chunks;
+    void *codec_ctx;       // Context given to the decoder, owned by the reader
+    unsigned char *io_buf; // Buffer with the encoded image of a page
+};
+
+struct Pager
+{
+    int fd;           // The file where the pages will be write/read
+    size_t page_size; // Size in bytes of every page of the file
+    bool direct;      // Flag to the file opened with O_DIRECT, bypassing the kernel page cache
+    int min_class;    // Class of the smallest extent
+    int page_amount;  // Amount of pages allocated in the file
+    int *free_pages;  // Positions given back, reused by the next allocations
+    int free_pages_amount;
+    int free_pages_cap;
+
+    // Cache with the images of the last used pages, in LRU order
+    int cache_cap;    // Max amount of pages in the cache
+    int cache_used;   // Amount of slots in use
+    char *cache_data; // Images of the pages, one per slot
+    bool huge;        // Flag to a cache asked in a region of huge pages
+    int node;         // NUMA node of the region of the cache, ARENA_ANY_NODE if not bound
+    bool cache_huge;  // Flag to the images living in a region, not in the heap
+    bool reserved;    // Flag to the region of the cache backed by reserved huge pages
+    int *slot_pos;    // Position of the page held by each slot
+    int *slot_prev;   // Previous slot in the LRU list (more recently used)
+    int *slot_next;   // Next slot in the LRU list (less recently used)
+    int *slot_chain;  // Next slot in the same bucket of the hash
+    int *bucket;      // First slot of every bucket of the hash
+    int n_buckets;    // Amount of buckets of the hash, a power of 2
+    int lru_head;     // Most recently used slot
+    int lru_tail;     // Least recently used slot
+    unsigned char *slot_dirty; // Flag to the slots changed since they were written back
+    int dirty_amount;          // Amount of dirty slots
+
+    // Write-back of the dirty pages
+    long flush_interval; // Milliseconds between flushes, 0 writes through and -1 only flushes when asked
+    long last_flush;     // Time of the last flush, in milliseconds
+    unsigned char *flush_buf; // Encoded images of the pages of a flush
+
+    // Codec applied to the pages between the cache and the file
+    PageEncoder encode;
+    PageDecoder decode;
+    void *codec_ctx;
+    unsigned char *io_buf; // Buffer with the encoded image of a page
+
+    // Map from the position of a page to its extent, used by encoded and copy-on-write pages
+    bool mapped;                    // Flag to the pages that live in extents
+    MapChunk **map;                 // Chunks of the map
+    int map_chunks;                 // Amount of chunks of the map
+    long file_end;                  // End of the last extent of the file
+    long *free_ext[EXTENT_CLASSES]; // Extents that can be reused, per class
+    int free_amount[EXTENT_CLASSES];
+    int free_cap[EXTENT_CLASSES];
+
+    // Copy-on-write of the pages seen by views
+    bool cow;                // Flag to copy-on-write
+    unsigned epoch;          // Current epoch, every view starts a new one
+    pthread_mutex_t lock;    // Lock of the list of views
+    unsigned *live;          // Epochs of the views not released yet, sorted
+    int live_amount;
+    int live_cap;
+    unsigned oldest_live;    // Epoch of the oldest view, NO_EPOCH if none
+    unsigned newest_live;    // Epoch of the newest view, NO_EPOCH if none
+    RetiredExtent *retired;  // Extents replaced while some view could still read them
+    int retired_head;        // First extent of the retired list not reclaimed yet
+    int retired_amount;
+    int retired_cap;
+};
+
+static void page_store(Pager *p, int pos, const void *buf);
+static int cache_lookup(Pager *p, int pos);
+
+/**
+ * @brief Create a pager over a new binary file
+ *
+ * @param char* path
+ * @param size_t page_size
+ * @return Pager*
+ */
+Pager *pager_open(char *path, size_t page_size)
+{
+    Pager *p = (Pager *)calloc(1, sizeof(Pager));
+
+    // Set initial params
+    p->page_size = page_size;
+    p->page_amount = 0;
+    p->lru_head = -1;
+    p->lru_tail = -1;
+    p->oldest_live = NO_EPOCH;
+    p->newest_live = NO_EPOCH;
+    p->min_class = EXTENT_MIN_CLASS;
+    pthread_mutex_init(&p->lock, NULL);
+
+    // Create binary file to the pages
+    p->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (p->fd < 0)
+    {
+        perror("The system couldn't create the binary file.\n");
+        exit(1);
+    }
+
+    return p;
+}
+
+/**
+ * @brief Round a size up to a multiple of PAGER_DIRECT_ALIGN
+ *
+ * @param size_t size
+ * @return size_t
+ */
+static size_t direct_round(size_t size)
+{
+    return (size + PAGER_DIRECT_ALIGN - 1) / PAGER_DIRECT_ALIGN * PAGER_DIRECT_ALIGN;
+}
+
+/**
+ * @brief Free the memory of the cache
+ *
+ * @param Pager* p
+ */
+static void cache_free(Pager *p)
+{
+    if (p->cache_huge)
+        region_unmap(p->cache_data, direct_round((size_t)p->cache_cap * p->page_size));
+    else
+        free(p->cache_data);
+    free(p->slot_pos);
+    free(p->slot_prev);
+    free(p->slot_next);
+    free(p->slot_chain);
+    free(p->bucket);
+    free(p->slot_dirty);
+    free(p->flush_buf);
+    p->cache_data = NULL;
+    p->flush_buf = NULL;
+    p->slot_dirty = NULL;
+    p->dirty_amount = 0;
+    p->cache_cap = 0;
+    p->cache_used = 0;
+    p->lru_head = -1;
+    p->lru_tail = -1;
+}
+
+/**
+ * @brief Drop a reference to a chunk of the map, freeing it with the last one
+ *
+ * @param MapChunk* c
+ */
+static void chunk_unref(MapChunk *c)
+{
+    if (c && __atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        free(c);
+}
+
+/**
+ * @brief Close the file of the pager and free memory allocated to it
+ *
+ * Every view must be released before
+ *
+ * @param Pager* p
+ */
+void pager_close(Pager *p)
+{
+    if (p)
+    {
+        // Dirty pages go to the file before it is closed
+        pager_flush(p);
+        close(p->fd);
+        cache_free(p);
+        free(p->io_buf);
+        for (int i = 0; i < p->map_chunks; i++)
+            chunk_unref(p->map[i]);
+        free(p->map);
+        for (int c = 0; c < EXTENT_CLASSES; c++)
+            free(p->free_ext[c]);
+        free(p->live);
+        free(p->retired);
+        free(p->free_pages);
+        pthread_mutex_destroy(&p->lock);
+        free(p);
+    }
+}
+
+/**
+ * @brief Get the size of the pages
+ *
+ * @param Pager* p
+ * @return size_t
+ */
+size_t pager_page_size(Pager *p)
+{
+    return p->page_size;
+}
+
+/**
+ * @brief Get the amount of pages allocated in the file
+ *
+ * @param Pager* p
+ * @return int
+ */
+int pager_page_count(Pager *p)
+{
+    return p->page_amount;
+}
+
+/**
+ * @brief Get the amount of pages kept in memory
+ *
+ * @param Pager* p
+ * @return int
+ */
+int pager_cache_size(Pager *p)
+{
+    return p->cache_cap;
+}
+
+/**
+ * @brief Get the bytes of the cache backed by reserved huge pages
+ *
+ * @param Pager* p
+ * @param size_t* mapped if not NULL, receives the bytes of the cache living in a region
+ * @return size_t
+ */
+size_t pager_huge_bytes(Pager *p, size_t *mapped)
+{
+    size_t bytes = p->cache_huge ? direct_round((size_t)p->cache_cap * p->page_size) : 0;
+
+    if (mapped)
+        *mapped = bytes;
+
+    return p->reserved ? bytes : 0;
+}
+
+/**
+ * @brief Get the time between two write-backs of the dirty pages
+ *
+ * @param Pager* p
+ * @return long milliseconds, 0 writes through and -1 only flushes when asked
+ */
+long pager_flush_interval(Pager *p)
+{
+    return p->flush_interval;
+}
+
+/**
+ * @brief Reserve the position of a new page, reusing the last one given back if any
+ *
+ * @param Pager* p
+ * @return int
+ */
+int pager_alloc(Pager *p)
+{
+    if (p->free_pages_amount)
+        return p->free_pages[--p->free_pages_amount];
+
+    return p->page_amount++;
+}
+
+/**
+ * @brief Reserve the positions of "count" consecutive new pages at the end of the file
+ *
+ * @param Pager* p
+ * @param int count
+ * @return int the first position
+ */
+int pager_alloc_run(Pager *p, int count)
+{
+    int first = p->page_amount;
+    p->page_amount += count;
+
+    return first;
+}
+
+/**
+ * @brief Give back the position of a page that won't be read again
+ *
+ * Its cached image is never written back. The views keep reading their own
+ * version of the page, which is only replaced when the position is reused
+ *
+ * @param Pager* p
+ * @param int pos
+ */
+void pager_free(Pager *p, int pos)
+{
+    int s = cache_lookup(p, pos);
+    if (s != -1 && p->slot_dirty[s])
+    {
+        p->slot_dirty[s] = 0;
+        p->dirty_amount--;
+    }
+
+    if (p->free_pages_amount == p->free_pages_cap)
+    {
+        p->free_pages_cap = p->free_pages_cap ? p->free_pages_cap * 2 : 64;
+        p->free_pages = (int *)realloc(p->free_pages, p->free_pages_cap * sizeof(int));
+    }
+    p->free_pages[p->free_pages_amount++] = pos;
+}
+
+/**
+ * @brief Get the positions given back and not reused yet
+ *
+ * @param Pager* p
+ * @param const int** pages receives the positions, valid until the next allocation or free
+ * @return int amount of positions
+ */
+int pager_free_list(Pager *p, const int **pages)
+{
+    *pages = p->free_pages;
+
+    return p->free_pages_amount;
+}
+
+/**
+ * @brief Get the amount of bytes the pages take in the file
+ *
+ * @param Pager* p
+ * @return long
+ */
+long pager_file_size(Pager *p)
+{
+    // Dirty pages may still need their extents
+    pager_flush(p);
+
+    if (p->mapped)
+        return p->file_end;
+
+    return (long)p->page_amount * p->page_size;
+}
+
+/**
+ * @brief Set the amount of pages kept in memory, 0 disables the cache
+ *
+ * @param Pager* p
+ * @param int pages
+ */
+void pager_set_cache(Pager *p, int pages)
+{
+    // Once written back, the pages of the cache can just be dropped
+    pager_flush(p);
+    cache_free(p);
+
+    if (pages <= 0)
+        return;
+
+    p->cache_cap = pages;
+    p->cache_huge = p->huge;
+    p->reserved = false;
+    if (p->huge)
+        p->cache_data = (char *)region_map(direct_round((size_t)pages * p->page_size), p->node, &p->reserved);
+    else
+        p->cache_data = (char *)aligned_alloc(PAGER_DIRECT_ALIGN, direct_round((size_t)pages * p->page_size));
+    p->slot_pos = (int *)malloc(pages * sizeof(int));
+    p->slot_prev = (int *)malloc(pages * sizeof(int));
+    p->slot_next = (int *)malloc(pages * sizeof(int));
+    p->slot_chain = (int *)malloc(pages * sizeof(int));
+    p->slot_dirty = (unsigned char *)calloc(pages, 1);
+
+    p->n_buckets = 1;
+    while (p->n_buckets < pages * 2)
+        p->n_buckets *= 2;
+
+    p->bucket = (int *)malloc(p->n_buckets * sizeof(int));
+    for (int i = 0; i < p->n_buckets; i++)
+        p->bucket[i] = -1;
+}
+
+/**
+ * @brief Set the codec the pages go through between the cache and the file
+ *
+ * Must be set before the first write. Encoded pages have variable sizes, so
+ * each one is kept in an extent of the file that is moved when it grows
+ *
+ * @param Pager* p
+ * @param PageEncoder encode
+ * @param PageDecoder decode
+ * @param void* ctx
+ */
+void pager_set_codec(Pager *p, PageEncoder encode, PageDecoder decode, void *ctx)
+{
+    p->encode = encode;
+    p->decode = decode;
+    p->codec_ctx = ctx;
+    p->mapped = true;
+
+    free(p->io_buf);
+    p->io_buf = (unsigned char *)aligned_alloc(PAGER_DIRECT_ALIGN, direct_round(PAGER_MAX_ENCODED(p->page_size)));
+}
+
+/**
+ * @brief Open the file with O_DIRECT, so the pages only live in the cache of the pager
+ *
+ * Must be set before the first write. Pages must have a size multiple of
+ * PAGER_DIRECT_ALIGN, and the extents of encoded pages are aligned to it. If
+ * the file system doesn't support O_DIRECT, the file stays buffered by the kernel
+ *
+ * @param Pager* p
+ * @return true if the file is in direct mode
+ */
+bool pager_enable_direct(Pager *p)
+{
+    if (p->page_size % PAGER_DIRECT_ALIGN)
+        return false;
+
+    int flags = fcntl(p->fd, F_GETFL);
+    if (flags < 0 || fcntl(p->fd, F_SETFL, flags | O_DIRECT) < 0)
+        return false;
+
+    p->direct = true;
+    while (((size_t)1 << p->min_class) < PAGER_DIRECT_ALIGN)
+        p->min_class++;
+
+    return true;
+}
+
+/**
+ * @brief Keep the images of the cache in a region of huge pages bound to a NUMA node
+ *
+ * The cache is allocated again, after its dirty pages are written back. With
+ * no huge pages reserved the region asks for transparent ones, and the
+ * binding does nothing on machines with a single node
+ *
+ * @param Pager* p
+ * @param int node ARENA_ANY_NODE leaves the placement to the kernel
+ */
+void pager_enable_huge_pages(Pager *p, int node)
+{
+    p->huge = true;
+    p->node = node;
+    pager_set_cache(p, p->cache_cap);
+}
+
+/**
+ * @brief Turn on copy-on-write: pages that a view can read are never overwritten
+ *
+ * Must be set before the first write
+ *
+ * @param Pager* p
+ */
+void pager_enable_cow(Pager *p)
+{
+    p->cow = true;
+    p->mapped = true;
+}
+
+/**
+ * @brief Get the bucket of the hash of a position
+ *
+ * @param Pager* p
+ * @param int pos
+ * @return int
+ */
+static int cache_bucket(Pager *p, int pos)
+{
+    return (int)(((unsigned)pos * 2654435761u) & (unsigned)(p->n_buckets - 1));
+}
+
+/**
+ * @brief Find the slot of the cache holding a page
+ *
+ * @param Pager* p
+ * @param int pos
+ * @return int the slot, -1 if the page isn't cached
+ */
+static int cache_lookup(Pager *p, int pos)
+{
+    if (!p->cache_cap)
+        return -1;
+
+    for (int s = p->bucket[cache_bucket(p, pos)]; s != -1; s = p->slot_chain[s])
+    {
+        if (p->slot_pos[s] == pos)
+            return s;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Remove a slot from the LRU list
+ *
+ * @param Pager* p
+ * @param int s
+ */
+static void lru_unlink(Pager *p, int s)
+{
+    if (p->slot_prev[s] != -1)
+        p->slot_next[p->slot_prev[s]] = p->slot_next[s];
+    else
+        p->lru_head = p->slot_next[s];
+
+    if (p->slot_next[s] != -1)
+        p->slot_prev[p->slot_next[s]] = p->slot_prev[s];
+    else
+        p->lru_tail = p->slot_prev[s];
+}
+
+/**
+ * @brief Put a slot in the front of the LRU list
+ *
+ * @param Pager* p
+ * @param int s
+ */
+static void lru_push_front(Pager *p, int s)
+{
+    p->slot_prev[s] = -1;
+    p->slot_next[s] = p->lru_head;
+
+    if (p->lru_head != -1)
+        p->slot_prev[p->lru_head] = s;
+    p->lru_head = s;
+
+    if (p->lru_tail == -1)
+        p->lru_tail = s;
+}
+
+/**
+ * @brief Remove a slot from the hash
+ *
+ * @param Pager* p
+ * @param int s
+ */
+static void cache_unhash(Pager *p, int s)
+{
+    int *link = &p->bucket[cache_bucket(p, p->slot_pos[s])];
+
+    while (*link != s)
+        link = &p->slot_chain[*link];
+
+    *link = p->slot_chain[s];
+}
+
+/**
+ * @brief Put the image of a page in the cache, evicting the least recently used one if needed
+ *
+ * A dirty page is written back when it is evicted
+ *
+ * @param Pager* p
+ * @param int pos
+ * @param const void* buf
+ * @param bool dirty
+ */
+static void cache_put(Pager *p, int pos, const void *buf, bool dirty)
+{
+    if (!p->cache_cap)
+        return;
+
+    int s = cache_lookup(p, pos);
+
+    if (s != -1)
+    {
+        lru_unlink(p, s);
+    }
+    else
+    {
+        if (p->cache_used < p->cache_cap)
+        {
+            s = p->cache_used++;
+        }
+        else
+        {
+            s = p->lru_tail;
+            lru_unlink(p, s);
+            cache_unhash(p, s);
+
+            if (p->slot_dirty[s])
+            {
+                page_store(p, p->slot_pos[s], p->cache_data + (size_t)s * p->page_size);
+                p->slot_dirty[s] = 0;
+                p->dirty_amount--;
+            }
+        }
+
+        // Hash the slot by the position of its page
+        int b = cache_bucket(p, pos);
+        p->slot_pos[s] = pos;
+        p->slot_chain[s] = p->bucket[b];
+        p->bucket[b] = s;
+    }
+
+    memcpy(p->cache_data + (size_t)s * p->page_size, buf, p->page_size);
+    lru_push_front(p, s);
+
+    if (dirty && !p->slot_dirty[s])
+    {
+        p->slot_dirty[s] = 1;
+        p->dirty_amount++;
+    }
+}
+
+/**
+ * @brief Get the size of the extents of a class
+ *
+ * @param Pager* p
+ * @param int cls
+ * @return size_t
+ */
+static size_t extent_size(Pager *p, int cls)
+{
+    if (cls == EXTENT_PAGE_CLASS)
+    {
+        size_t size = p->encode ? PAGER_MAX_ENCODED(p->page_size) : p->page_size;
+        return p->direct ? direct_round(size) : size;
+    }
+
+    return (size_t)1 << cls;
+}
+
+/**
+ * @brief Get the class of the smallest extent that fits "len" bytes
+ *
+ * @param Pager* p
+ * @param size_t len
+ * @return int
+ */
+static int extent_class(Pager *p, size_t len)
+{
+    int c = p->min_class;
+
+    while (((size_t)1 << c) < len)
+        c++;
+
+    // Powers of 2 past a whole page would only waste space
+    if (((size_t)1 << c) >= extent_size(p, EXTENT_PAGE_CLASS))
+        return EXTENT_PAGE_CLASS;
+
+    return c;
+}
+
+/**
+ * @brief Get the extent of a page in the map
+ *
+ * @param MapChunk** chunks
+ * @param int n_chunks
+ * @param int pos
+ * @return PageExtent* NULL if the page was never written
+ */
+static PageExtent *map_find(MapChunk **chunks, int n_chunks, int pos)
+{
+    if (pos < 0 || pos / MAP_CHUNK >= n_chunks || !chunks[pos / MAP_CHUNK])
+        return NULL;
+
+    PageExtent *e = &chunks[pos / MAP_CHUNK]->e[pos % MAP_CHUNK];
+    return e->off == -1 ? NULL : e;
+}
+
+/**
+ * @brief Get the extent of a page in the map to change it
+ *
+ * A chunk shared with some view is copied first, so the view keeps its version
+ *
+ * @param Pager* p
+ * @param int pos
+ * @return PageExtent*
+ */
+static PageExtent *map_edit(Pager *p, int pos)
+{
+    int c = pos / MAP_CHUNK;
+
+    if (c >= p->map_chunks)
+    {
+        int cap = p->map_chunks ? p->map_chunks : 16;
+        while (cap <= c)
+            cap *= 2;
+
+        p->map = (MapChunk **)realloc(p->map, cap * sizeof(MapChunk *));
+        for (int i = p->map_chunks; i < cap; i++)
+            p->map[i] = NULL;
+        p->map_chunks = cap;
+    }
+
+    if (!p->map[c])
+    {
+        p->map[c] = (MapChunk *)malloc(sizeof(MapChunk));
+        p->map[c]->refs = 1;
+        for (int i = 0; i < MAP_CHUNK; i++)
+            p->map[c]->e[i].off = -1;
+    }
+    else if (__atomic_load_n(&p->map[c]->refs, __ATOMIC_ACQUIRE) > 1)
+    {
+        MapChunk *copy = (MapChunk *)malloc(sizeof(MapChunk));
+        // The count is changed by the views meanwhile, only the extents are copied
+        memcpy(copy->e, p->map[c]->e, sizeof(copy->e));
+        copy->refs = 1;
+        chunk_unref(p->map[c]);
+        p->map[c] = copy;
+    }
+
+    return &p->map[c]->e[pos % MAP_CHUNK];
+}
+
+/**
+ * @brief Put an extent in the free list of its class
+ *
+ * @param Pager* p
+ * @param long off
+ * @param int cls
+ */
+static void extent_free(Pager *p, long off, int cls)
+{
+    if (p->free_amount[cls] == p->free_cap[cls])
+    {
+        p->free_cap[cls] = p->free_cap[cls] ? p->free_cap[cls] * 2 : 16;
+        p->free_ext[cls] = (long *)realloc(p->free_ext[cls], p->free_cap[cls] * sizeof(long));
+    }
+    p->free_ext[cls][p->free_amount[cls]++] = off;
+}
+
+/**
+ * @brief Take an extent of a class, reusing a free one or growing the file
+ *
+ * @param Pager* p
+ * @param int cls
+ * @return long
+ */
+static long extent_take(Pager *p, int cls)
+{
+    if (p->free_amount[cls] > 0)
+        return p->free_ext[cls][--p->free_amount[cls]];
+
+    long off = p->file_end;
+    p->file_end += extent_size(p, cls);
+
+    return off;
+}
+
+/**
+ * @brief Reuse the retired extents no view can read anymore
+ *
+ * An extent retired in epoch E is only seen by views older than E
+ *
+ * @param Pager* p
+ */
+static void extent_reclaim(Pager *p)
+{
+    unsigned oldest = __atomic_load_n(&p->oldest_live, __ATOMIC_ACQUIRE);
+
+    while (p->retired_head < p->retired_amount &&
+           (oldest == NO_EPOCH || oldest >= p->retired[p->retired_head].epoch))
+    {
+        RetiredExtent *r = &p->retired[p->retired_head++];
+        extent_free(p, r->off, r->cls);
+    }
+
+    // Compact the list once it is empty
+    if (p->retired_head == p->retired_amount)
+    {
+        p->retired_head = 0;
+        p->retired_amount = 0;
+    }
+}
+
+/**
+ * @brief Give a page an extent that fits "len" bytes, keeping the current one if possible
+ *
+ * With copy-on-write, an extent that a view may read is retired instead of
+ * overwritten, and the page moves to a new one
+ *
+ * @param Pager* p
+ * @param int pos
+ * @param size_t len
+ * @return PageExtent*
+ */
+static PageExtent *extent_fit(Pager *p, int pos, size_t len)
+{
+    PageExtent *e = map_edit(p, pos);
+    int cls = extent_class(p, len);
+
+    if (p->cow)
+        extent_reclaim(p);
+
+    if (e->off != -1)
+    {
+        unsigned newest = __atomic_load_n(&p->newest_live, __ATOMIC_ACQUIRE);
+        bool seen = p->cow && newest != NO_EPOCH && newest >= e->birth;
+
+        // Keep the extent if no view reads it and the page still has the same size class
+        if (!seen && e->cls == cls)
+        {
+            e->birth = p->epoch;
+            return e;
+        }
+
+        if (seen)
+        {
+            if (p->retired_amount == p->retired_cap)
+            {
+                p->retired_cap = p->retired_cap ? p->retired_cap * 2 : 64;
+                p->retired = (RetiredExtent *)realloc(p->retired, p->retired_cap * sizeof(RetiredExtent));
+            }
+            p->retired[p->retired_amount].off = e->off;
+            p->retired[p->retired_amount].cls = e->cls;
+            p->retired[p->retired_amount].epoch = p->epoch;
+            p->retired_amount++;
+        }
+        else
+        {
+            extent_free(p, e->off, e->cls);
+        }
+    }
+
+    e->off = extent_take(p, cls);
+    e->cls = (unsigned char)cls;
+    e->birth = p->epoch;
+
+    return e;
+}
+
+/**
+ * @brief Check if a transfer can go straight to the file: with O_DIRECT, its
+ * buffer and size must be multiples of PAGER_DIRECT_ALIGN
+ *
+ * @param Pager* p
+ * @param const void* buf
+ * @param size_t len
+ * @return true
+ * @return false
+ */
+static bool direct_ready(Pager *p, const void *buf, size_t len)
+{
+    return !p->direct || ((uintptr_t)buf % PAGER_DIRECT_ALIGN == 0 && len % PAGER_DIRECT_ALIGN == 0);
+}
+
+/**
+ * @brief Read exactly "len" bytes of the file, zeroing what is past its end
+ *
+ * Transfers that don't fit O_DIRECT go through an aligned buffer
+ *
+ * @param Pager* p
+ * @param void* buf
+ * @param size_t len
+ * @param long off
+ */
+static void file_read(Pager *p, void *buf, size_t len, long off)
+{
+    void *dst = buf;
+    size_t size = len;
+
+    if (!direct_ready(p, buf, len))
+    {
+        size = direct_round(len);
+        dst = aligned_alloc(PAGER_DIRECT_ALIGN, size);
+    }
+
+    ssize_t n = pread(p->fd, dst, size, off);
+    if (n < 0)
+        n = 0;
+    if ((size_t)n > len)
+        n = len;
+
+    if (dst != buf)
+    {
+        memcpy(buf, dst, n);
+        free(dst);
+    }
+
+    if ((size_t)n < len)
+        memset((char *)buf + n, 0, len - n);
+}
+
+/**
+ * @brief Write exactly "len" bytes to the file
+ *
+ * Transfers that don't fit O_DIRECT go through an aligned buffer, padded with
+ * zeros; the extents of a direct pager always have room for the padding
+ *
+ * @param Pager* p
+ * @param const void* buf
+ * @param size_t len
+ * @param long off
+ */
+static void file_write(Pager *p, const void *buf, size_t len, long off)
+{
+    const void *src = buf;
+    size_t size = len;
+
+    if (!direct_ready(p, buf, len))
+    {
+        size = direct_round(len);
+        void *bounce = aligned_alloc(PAGER_DIRECT_ALIGN, size);
+        memcpy(bounce, buf, len);
+        memset((char *)bounce + len, 0, size - len);
+        src = bounce;
+    }
+
+    ssize_t n = pwrite(p->fd, src, size, off);
+
+    if (src != buf)
+        free((void *)src);
+
+    if (n != (ssize_t)size)
+    {
+        perror("The system couldn't write to the binary file.\n");
+        exit(1);
+    }
+}
+
+/**
+ * @brief Tell the kernel that "len" bytes of the file will be read soon
+ *
+ * The read ahead runs in the background; a direct pager has no page cache to fill
+ *
+ * @param Pager* p
+ * @param size_t len
+ * @param long off
+ */
+static void file_advise(Pager *p, size_t len, long off)
+{
+    if (!p->direct && len > 0)
+        posix_fadvise(p->fd, off, (off_t)len, POSIX_FADV_WILLNEED);
+}
+
+/**
+ * @brief Read ahead the extent of a page, if it was ever written
+ *
+ * @param Pager* p
+ * @param PageExtent* e
+ */
+static void extent_advise(Pager *p, PageExtent *e)
+{
+    if (e)
+        file_advise(p, e->len, e->off);
+}
+
+/**
+ * @brief Read a page through a map, decoding it if the pager has a codec
+ *
+ * @param Pager* p
+ * @param PageExtent* e
+ * @param void* buf
+ * @param unsigned char* io_buf
+ * @param void* codec_ctx
+ */
+static void extent_read(Pager *p, PageExtent *e, void *buf, unsigned char *io_buf, void *codec_ctx)
+{
+    if (!e)
+    {
+        memset(buf, 0, p->page_size);
+    }
+    else if (p->encode)
+    {
+        // Buffers of encoded images have room for whole aligned blocks
+        file_read(p, io_buf, p->direct ? direct_round(e->len) : (size_t)e->len, e->off);
+        p->decode(io_buf, e->len, buf, codec_ctx);
+    }
+    else
+    {
+        file_read(p, buf, p->page_size, e->off);
+    }
+}
+
+/**
+ * @brief Read a whole page from the binary file
+ *
+ * @param Pager* p
+ * @param int pos
+ * @param void* buf
+ */
+void pager_read(Pager *p, int pos, void *buf)
+{
+    // Look for the page in the cache first
+    int s = cache_lookup(p, pos);
+    if (s != -1)
+    {
+        memcpy(buf, p->cache_data + (size_t)s * p->page_size, p->page_size);
+        lru_unlink(p, s);
+        lru_push_front(p, s);
+        return;
+    }
+
+    if (p->mapped)
+    {
+        // Read the image from the extent of the page
+        extent_read(p, map_find(p->map, p->map_chunks, pos), buf, p->io_buf, p->codec_ctx);
+    }
+    else
+    {
+        // Get the position of the page by calculating its position and its size
+        file_read(p, buf, p->page_size, (long)pos * p->page_size);
+    }
+
+    cache_put(p, pos, buf, false);
+}
+
+/**
+ * @brief Start bringing a page close before it is read
+ *
+ * A cached image is pulled to the CPU caches; otherwise the kernel is asked to
+ * read the page ahead, so the I/O overlaps with the work done meanwhile
+ *
+ * @param Pager* p
+ * @param int pos
+ */
+void pager_prefetch(Pager *p, int pos)
+{
+    int s = cache_lookup(p, pos);
+    if (s != -1)
+    {
+        const char *img = p->cache_data + (size_t)s * p->page_size;
+        size_t len = p->page_size < PAGER_PREFETCH_BYTES ? p->page_size : PAGER_PREFETCH_BYTES;
+
+        for (size_t off = 0; off < len; off += 64)
+            __builtin_prefetch(img + off);
+        return;
+    }
+
+    if (p->mapped)
+        extent_advise(p, map_find(p->map, p->map_chunks, pos));
+    else
+        file_advise(p, p->page_size, (long)pos * p->page_size);
+}
+
+/**
+ * @brief Write the image of a page to the file, encoding it if the pager has a codec
+ *
+ * @param Pager* p
+ * @param int pos
+ * @param const void* buf
+ */
+static void page_store(Pager *p, int pos, const void *buf)
+{
+    if (p->mapped)
+    {
+        // Encode the page and write it to its extent
+        const void *data = buf;
+        size_t len = p->page_size;
+
+        if (p->encode)
+        {
+            len = p->encode(buf, p->io_buf, p->codec_ctx);
+            data = p->io_buf;
+        }
+
+        PageExtent *e = extent_fit(p, pos, len);
+        e->len = (int)len;
+
+        // Encoded images are padded with zeros to whole aligned blocks
+        if (p->direct && p->encode)
+        {
+            memset(p->io_buf + len, 0, direct_round(len) - len);
+            len = direct_round(len);
+        }
+
+        file_write(p, data, len, e->off);
+    }
+    else
+    {
+        // Get the position of the page by calculating its position and its size
+        file_write(p, buf, p->page_size, (long)pos * p->page_size);
+    }
+}
+
+/**
+ * @brief Get the time of a monotonic clock, in milliseconds
+ *
+ * @return long
+ */
+static long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+/**
+ * @brief Write a whole page to the binary file
+ *
+ * With write-back, the page only changes in the cache and goes to the file
+ * in the next flush, so a page written many times is written back once
+ *
+ * @param Pager* p
+ * @param int pos
+ * @param void* buf
+ */
+void pager_write(Pager *p, int pos, const void *buf)
+{
+    if (!p->cache_cap || p->flush_interval == 0)
+    {
+        cache_put(p, pos, buf, false);
+        page_store(p, pos, buf);
+        return;
+    }
+
+    cache_put(p, pos, buf, true);
+
+    if (p->flush_interval > 0 && now_ms() - p->last_flush >= p->flush_interval)
+        pager_flush(p);
+}
+
+/**
+ * @brief Set how the written pages go to the file
+ *
+ * Dirty pages are written back at most "ms" milliseconds after the last flush,
+ * when they are evicted from the cache, by pager_flush and by pager_close
+ *
+ * @param Pager* p
+ * @param long ms 0 writes through, -1 only flushes when asked
+ */
+void pager_set_flush_interval(Pager *p, long ms)
+{
+    pager_flush(p);
+
+    p->flush_interval = ms;
+    p->last_flush = now_ms();
+}
+
+/**
+ * @brief Compare two writes of a flush by the position of their pages
+ *
+ * @param const void* a
+ * @param const void* b
+ * @return int
+ */
+static int flush_pos_cmp(const void *a, const void *b)
+{
+    int x = ((const FlushWrite *)a)->pos;
+    int y = ((const FlushWrite *)b)->pos;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Compare two writes of a flush by their offset
+ *
+ * @param const void* a
+ * @param const void* b
+ * @return int
+ */
+static int flush_write_cmp(const void *a, const void *b)
+{
+    long x = ((const FlushWrite *)a)->off;
+    long y = ((const FlushWrite *)b)->off;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Write back every dirty page of the cache
+ *
+ * The pages are given their extents in order of position, then written in
+ * order of offset, and pages next to each other in the file are written by a
+ * single call. Encoded pages are padded to the end of their extents, so
+ * consecutive extents join in one write too
+ *
+ * @param Pager* p
+ */
+void pager_flush(Pager *p)
+{
+    p->last_flush = now_ms();
+
+    if (!p->dirty_amount)
+        return;
+
+    FlushWrite *w = (FlushWrite *)malloc(p->dirty_amount * sizeof(FlushWrite));
+    int n = 0;
+
+    // Dirty slots by position, so new extents follow the order of the pages
+    for (int s = 0; s < p->cache_used; s++)
+    {
+        if (p->slot_dirty[s])
+        {
+            w[n].pos = p->slot_pos[s];
+            w[n].slot = s;
+            n++;
+        }
+    }
+    qsort(w, n, sizeof(FlushWrite), flush_pos_cmp);
+
+    size_t max_encoded = direct_round(PAGER_MAX_ENCODED(p->page_size));
+    if (p->encode && !p->flush_buf)
+        p->flush_buf = (unsigned char *)aligned_alloc(PAGER_DIRECT_ALIGN, max_encoded * p->cache_cap);
+
+    for (int i = 0; i < n; i++)
+    {
+        int s = w[i].slot;
+        const char *image = p->cache_data + (size_t)s * p->page_size;
+
+        w[i].data = image;
+        w[i].len = p->page_size;
+        w[i].pad = 0;
+
+        if (p->mapped)
+        {
+            if (p->encode)
+            {
+                w[i].data = p->flush_buf + max_encoded * i;
+                w[i].len = p->encode(image, p->flush_buf + max_encoded * i, p->codec_ctx);
+            }
+
+            PageExtent *e = extent_fit(p, w[i].pos, w[i].len);
+            e->len = (int)w[i].len;
+            w[i].off = e->off;
+            w[i].pad = extent_size(p, e->cls) - w[i].len;
+
+            // O_DIRECT only takes aligned buffers, so the padding goes in the encoded image
+            if (p->direct && p->encode)
+            {
+                memset(p->flush_buf + max_encoded * i + w[i].len, 0, w[i].pad);
+                w[i].len += w[i].pad;
+                w[i].pad = 0;
+            }
+        }
+        else
+        {
+            w[i].off = (long)w[i].pos * p->page_size;
+        }
+
+        p->slot_dirty[s] = 0;
+    }
+    p->dirty_amount = 0;
+
+    qsort(w, n, sizeof(FlushWrite), flush_write_cmp);
+
+    // Join the writes of consecutive extents
+    static const unsigned char zeros[PAGER_MAX_ENCODED(1 << 16)];
+    struct iovec iov[FLUSH_IOVECS];
+
+    for (int i = 0; i < n;)
+    {
+        int used = 0;
+        size_t total = 0;
+        long off = w[i].off;
+
+        iov[used].iov_base = (void *)w[i].data;
+        iov[used++].iov_len = w[i].len;
+        total += w[i].len;
+
+        int j = i + 1;
+        while (j < n && used + 2 <= FLUSH_IOVECS && w[j].off == w[j - 1].off + (long)(w[j - 1].len + w[j - 1].pad) &&
+               w[j - 1].pad <= sizeof(zeros))
+        {
+            if (w[j - 1].pad)
+            {
+                iov[used].iov_base = (void *)zeros;
+                iov[used++].iov_len = w[j - 1].pad;
+                total += w[j - 1].pad;
+            }
+            iov[used].iov_base = (void *)w[j].data;
+            iov[used++].iov_len = w[j].len;
+            total += w[j].len;
+            j++;
+        }
+
+        if (pwritev(p->fd, iov, used, off) != (ssize_t)total)
+        {
+            perror("The system couldn't write to the binary file.\n");
+            exit(1);
+        }
+
+        i = j;
+    }
+
+    free(w);
+}
+
+/**
+ * @brief Write back the dirty pages and wait for the file to reach the disk
+ *
+ * @param Pager* p
+ */
+void pager_sync(Pager *p)
+{
+    pager_flush(p);
+    fdatasync(p->fd);
+}
+
+/**
+ * @brief Create a reader of the pages that doesn't touch the cache nor the buffers of the pager
+ *
+ * Many readers can run in parallel, as long as nothing is written meanwhile.
+ * Dirty pages are written back first
+ *
+ * @param Pager* p
+ * @param void* codec_ctx context given to the decoder, owned by the reader
+ * @return PagerReader*
+ */
+PagerReader *pager_reader_create(Pager *p, void *codec_ctx)
+{
+    // The readers go straight to the file
+    pager_flush(p);
+
+    PagerReader *r = (PagerReader *)malloc(sizeof(PagerReader));
+
+    r->p = p;
+    r->chunks = NULL;
+    r->n_chunks = 0;
+    r->codec_ctx = codec_ctx;
+    r->io_buf = (unsigned char *)aligned_alloc(PAGER_DIRECT_ALIGN, direct_round(PAGER_MAX_ENCODED(p->page_size)));
+
+    return r;
+}
+
+/**
+ * @brief Free memory allocated to a reader
+ *
+ * @param PagerReader* r
+ */
+void pager_reader_destroy(PagerReader *r)
+{
+    if (r)
+    {
+        free(r->io_buf);
+        free(r);
+    }
+}
+
+/**
+ * @brief Read "count" consecutive pages, from "first" on, to "buf"
+ *
+ * Pages at fixed offsets are read with a single call to the file
+ *
+ * @param PagerReader* r
+ * @param int first
+ * @param int count
+ * @param void* buf
+ */
+void pager_reader_read(PagerReader *r, int first, int count, void *buf)
+{
+    Pager *p = r->p;
+
+    if (!p->mapped)
+    {
+        file_read(p, buf, (size_t)count * p->page_size, (long)first * p->page_size);
+        return;
+    }
+
+    MapChunk **chunks = r->chunks ? r->chunks : p->map;
+    int n_chunks = r->chunks ? r->n_chunks : p->map_chunks;
+
+    for (int i = 0; i < count; i++)
+        extent_read(p, map_find(chunks, n_chunks, first + i), (char *)buf + (size_t)i * p->page_size, r->io_buf, r->codec_ctx);
+}
+
+/**
+ * @brief Ask the kernel to read ahead "count" consecutive pages, from "first" on
+ *
+ * @param PagerReader* r
+ * @param int first
+ * @param int count
+ */
+void pager_reader_prefetch(PagerReader *r, int first, int count)
+{
+    Pager *p = r->p;
+
+    if (!p->mapped)
+    {
+        file_advise(p, (size_t)count * p->page_size, (long)first * p->page_size);
+        return;
+    }
+
+    MapChunk **chunks = r->chunks ? r->chunks : p->map;
+    int n_chunks = r->chunks ? r->n_chunks : p->map_chunks;
+
+    for (int i = 0; i < count; i++)
+        extent_advise(p, map_find(chunks, n_chunks, first + i));
+}
+
+/**
+ * @brief Create a reader of the pages of a view
+ *
+ * Many readers of the same view can run in parallel, and in parallel with the
+ * writer. The reader must be destroyed before the view is released
+ *
+ * @param PagerView* v
+ * @param void* codec_ctx context given to the decoder, owned by the reader
+ * @return PagerReader*
+ */
+PagerReader *pager_view_reader_create(PagerView *v, void *codec_ctx)
+{
+    PagerReader *r = (PagerReader *)malloc(sizeof(PagerReader));
+
+    r->p = v->p;
+    r->chunks = v->chunks;
+    r->n_chunks = v->n_chunks;
+    r->codec_ctx = codec_ctx;
+    r->io_buf = (unsigned char *)aligned_alloc(PAGER_DIRECT_ALIGN, direct_round(PAGER_MAX_ENCODED(v->p->page_size)));
+
+    return r;
+}
+
+/**
+ * @brief Take a view of the pages as they are now
+ *
+ * The writer must not be in the middle of a write. The view shares the chunks
+ * of the map, that are copied by the writer before it changes them
+ *
+ * @param Pager* p
+ * @return PagerView*
+ */
+PagerView *pager_view_acquire(Pager *p)
+{
+    // The views go straight to the file
+    pager_flush(p);
+
+    PagerView *v = (PagerView *)malloc(sizeof(PagerView));
+
+    v->p = p;
+    v->n_chunks = p->map_chunks;
+    v->chunks = (MapChunk **)malloc((p->map_chunks ? p->map_chunks : 1) * sizeof(MapChunk *));
+    v->io_buf = (unsigned char *)aligned_alloc(PAGER_DIRECT_ALIGN, direct_round(PAGER_MAX_ENCODED(p->page_size)));
+
+    for (int i = 0; i < p->map_chunks; i++)
+    {
+        v->chunks[i] = p->map[i];
+        if (v->chunks[i])
+            __atomic_add_fetch(&v->chunks[i]->refs, 1, __ATOMIC_ACQ_REL);
+    }
+
+    // The view sees the current epoch, every write from now on is in the next one
+    pthread_mutex_lock(&p->lock);
+
+    v->epoch = p->epoch++;
+    if (p->live_amount == p->live_cap)
+    {
+        p->live_cap = p->live_cap ? p->live_cap * 2 : 8;
+        p->live = (unsigned *)realloc(p->live, p->live_cap * sizeof(unsigned));
+    }
+    p->live[p->live_amount++] = v->epoch;
+
+    __atomic_store_n(&p->oldest_live, p->live[0], __ATOMIC_RELEASE);
+    __atomic_store_n(&p->newest_live, v->epoch, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&p->lock);
+
+    return v;
+}
+
+/**
+ * @brief Release a view, so the extents only it could read can be reused
+ *
+ * May be called from any thread
+ *
+ * @param PagerView* v
+ */
+void pager_view_release(PagerView *v)
+{
+    if (!v)
+        return;
+
+    Pager *p = v->p;
+
+    pthread_mutex_lock(&p->lock);
+
+    // Remove the epoch of the view, keeping the list sorted
+    int i = 0;
+    while (i < p->live_amount && p->live[i] != v->epoch)
+        i++;
+    for (; i + 1 < p->live_amount; i++)
+        p->live[i] = p->live[i + 1];
+    p->live_amount--;
+
+    __atomic_store_n(&p->oldest_live, p->live_amount ? p->live[0] : NO_EPOCH, __ATOMIC_RELEASE);
+    __atomic_store_n(&p->newest_live, p->live_amount ? p->live[p->live_amount - 1] : NO_EPOCH, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&p->lock);
+
+    for (int c = 0; c < v->n_chunks; c++)
+        chunk_unref(v->chunks[c]);
+    free(v->chunks);
+    free(v->io_buf);
+    free(v);
+}
+
+/**
+ * @brief Get the amount of views not released yet
+ *
+ * @param Pager* p
+ * @return int
+ */
+int pager_view_count(Pager *p)
+{
+    pthread_mutex_lock(&p->lock);
+    int n = p->live_amount;
+    pthread_mutex_unlock(&p->lock);
+
+    return n;
+}
+
+/**
+ * @brief Get the epoch of a view
+ *
+ * @param PagerView* v
+ * @return unsigned
+ */
+unsigned pager_view_epoch(PagerView *v)
+{
+    return v->epoch;
+}
+
+/**
+ * @brief Read a page as it was when the view was taken
+ *
+ * Doesn't use the cache, so readers of different views can run in parallel
+ * with the writer
+ *
+ * @param PagerView* v
+ * @param int pos
+ * @param void* buf
+ * @param void* codec_ctx context given to the decoder, owned by the reader
+ */
+void pager_view_read(PagerView *v, int pos, void *buf, void *codec_ctx)
+{
+    extent_read(v->p, map_find(v->chunks, v->n_chunks, pos), buf, v->io_buf, codec_ctx);
+}
+
+/**
+ * @brief Ask the kernel to read ahead a page as it was when the view was taken
+ *
+ * @param PagerView* v
+ * @param int pos
+ */
+void pager_view_prefetch(PagerView *v, int pos)
+{
+    extent_advise(v->p, map_find(v->chunks, v->n_chunks, pos));
+}
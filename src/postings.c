@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../include/pager.h"
+#include "../include/postings.h"
+
+// Ints of a page, and ints of the header at the start of the first page of a list
+#define POSTINGS_PAGE_INTS ((int)(POSTINGS_PAGE_SIZE / sizeof(int)))
+#define POSTINGS_HEADER_INTS 2
+
+struct Postings
+{
+    Pager *pager; // Pages of the lists in their file
+    int *head;    // Buffer of the first page of the list being changed
+    int *page;    // Buffer of another page of the same list
+};
+
+/**
+ * @brief Create an empty store of lists of records over a new file
+ *
+ * @param char* path
+ * @return Postings*
+ */
+Postings *postings_open(char *path)
+{
+    Postings *p = (Postings *)malloc(sizeof(Postings));
+
+    p->pager = pager_open(path, POSTINGS_PAGE_SIZE);
+    p->head = (int *)malloc(POSTINGS_PAGE_SIZE);
+    p->page = (int *)malloc(POSTINGS_PAGE_SIZE);
+
+    return p;
+}
+
+/**
+ * @brief Close the file of the lists and free the memory of the store
+ *
+ * @param Postings* p
+ */
+void postings_close(Postings *p)
+{
+    pager_close(p->pager);
+    free(p->head);
+    free(p->page);
+    free(p);
+}
+
+/**
+ * @brief Set the amount of pages of the lists kept in memory
+ *
+ * @param Postings* p
+ * @param int pages 0 disables the cache
+ */
+void postings_set_cache_size(Postings *p, int pages)
+{
+    pager_set_cache(p->pager, pages);
+}
+
+/**
+ * @brief Write back the dirty pages of the lists and wait for them to reach the disk
+ *
+ * @param Postings* p
+ */
+void postings_sync(Postings *p)
+{
+    pager_sync(p->pager);
+}
+
+/**
+ * @brief Get the amount of bytes the lists take in their file
+ *
+ * @param Postings* p
+ * @return long
+ */
+long postings_file_size(Postings *p)
+{
+    return pager_file_size(p->pager);
+}
+
+/**
+ * @brief Get the amount of records a run of pages holds
+ *
+ * @param int pages
+ * @return int
+ */
+static int list_capacity(int pages)
+{
+    return pages * POSTINGS_PAGE_INTS - POSTINGS_HEADER_INTS;
+}
+
+/**
+ * @brief Get the amount of pages of a run a list really uses
+ *
+ * @param int count records of the list
+ * @return int
+ */
+static int list_used_pages(int count)
+{
+    return (POSTINGS_HEADER_INTS + count + POSTINGS_PAGE_INTS - 1) / POSTINGS_PAGE_INTS;
+}
+
+/**
+ * @brief Move a full list to a run of pages twice as large
+ *
+ * The pages of a list stay consecutive, so it is read in the order of the
+ * file; the old run is given back to the pager
+ *
+ * @param Postings* p
+ * @param int pos first page of the list, its header is in p->head
+ * @return int first page of the new run
+ */
+static int list_grow(Postings *p, int pos)
+{
+    int pages = p->head[1];
+    int moved = pager_alloc_run(p->pager, 2 * pages);
+
+    p->head[1] = 2 * pages;
+    pager_write(p->pager, moved, p->head);
+    pager_free(p->pager, pos);
+
+    for (int i = 1; i < pages; i++)
+    {
+        pager_read(p->pager, pos + i, p->page);
+        pager_write(p->pager, moved + i, p->page);
+        pager_free(p->pager, pos + i);
+    }
+
+    return moved;
+}
+
+/**
+ * @brief Add a record to the records of a slot
+ *
+ * A single record turns into a list of one page; a full list moves to a run
+ * twice as large, so adding is constant time on average
+ *
+ * @param Postings* p
+ * @param int slot a record, not negative, or a list
+ * @param int record not negative
+ * @return int the slot that holds the records from now on
+ */
+int postings_add(Postings *p, int slot, int record)
+{
+    if (!POSTINGS_IS_LIST(slot))
+    {
+        int pos = pager_alloc(p->pager);
+
+        memset(p->head, 0, POSTINGS_PAGE_SIZE);
+        p->head[0] = 2;
+        p->head[1] = 1;
+        p->head[POSTINGS_HEADER_INTS] = slot;
+        p->head[POSTINGS_HEADER_INTS + 1] = record;
+        pager_write(p->pager, pos, p->head);
+
+        return -(pos + 1);
+    }
+
+    int pos = -slot - 1;
+    pager_read(p->pager, pos, p->head);
+
+    if (p->head[0] == list_capacity(p->head[1]))
+        pos = list_grow(p, pos);
+
+    // Place of the record among the ints of the run
+    int at = POSTINGS_HEADER_INTS + p->head[0];
+    int page = at / POSTINGS_PAGE_INTS;
+
+    p->head[0]++;
+    if (page == 0)
+    {
+        p->head[at] = record;
+    }
+    else
+    {
+        // Pages are filled in order, the first record of a page finds it never written
+        if (at % POSTINGS_PAGE_INTS == 0)
+            memset(p->page, 0, POSTINGS_PAGE_SIZE);
+        else
+            pager_read(p->pager, pos + page, p->page);
+
+        p->page[at % POSTINGS_PAGE_INTS] = record;
+        pager_write(p->pager, pos + page, p->page);
+    }
+    pager_write(p->pager, pos, p->head);
+
+    return -(pos + 1);
+}
+
+/**
+ * @brief Get the record added first to a slot
+ *
+ * @param Postings* p
+ * @param int slot
+ * @return int
+ */
+int postings_first(Postings *p, int slot)
+{
+    if (!POSTINGS_IS_LIST(slot))
+        return slot;
+
+    int head[POSTINGS_PAGE_INTS];
+    pager_read(p->pager, -slot - 1, head);
+
+    return head[POSTINGS_HEADER_INTS];
+}
+
+/**
+ * @brief Get the amount of records of a slot
+ *
+ * @param Postings* p
+ * @param int slot
+ * @return long
+ */
+long postings_count(Postings *p, int slot)
+{
+    if (!POSTINGS_IS_LIST(slot))
+        return 1;
+
+    int head[POSTINGS_PAGE_INTS];
+    pager_read(p->pager, -slot - 1, head);
+
+    return head[0];
+}
+
+/**
+ * @brief Visit the records of a slot in the order they were added
+ *
+ * The pages of a list are read from the first to the last, asking for the
+ * next ones while the records of the current one are visited. Lists aren't
+ * changed meanwhile, so visits may nest
+ *
+ * @param Postings* p
+ * @param int slot
+ * @param PostingsVisitor visit returns false to stop
+ * @param void* ctx
+ * @return false if the visitor asked to stop
+ */
+bool postings_visit(Postings *p, int slot, PostingsVisitor visit, void *ctx)
+{
+    if (!POSTINGS_IS_LIST(slot))
+        return visit(slot, ctx);
+
+    int pos = -slot - 1;
+    int buf[POSTINGS_PAGE_INTS];
+    pager_read(p->pager, pos, buf);
+
+    int count = buf[0];
+    int used = list_used_pages(count);
+
+    for (int i = 1; i < used && i <= POSTINGS_PREFETCH_PAGES; i++)
+        pager_prefetch(p->pager, pos + i);
+
+    int seen = 0;
+    for (int i = 0; i < used; i++)
+    {
+        if (i > 0)
+            pager_read(p->pager, pos + i, buf);
+        if (i + POSTINGS_PREFETCH_PAGES < used)
+            pager_prefetch(p->pager, pos + i + POSTINGS_PREFETCH_PAGES);
+
+        for (int j = i == 0 ? POSTINGS_HEADER_INTS : 0; j < POSTINGS_PAGE_INTS && seen < count; j++, seen++)
+        {
+            if (!visit(buf[j], ctx))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Give back the pages of the list of a slot
+ *
+ * @param Postings* p
+ * @param int slot a single record has nothing to give back
+ */
+void postings_free(Postings *p, int slot)
+{
+    if (!POSTINGS_IS_LIST(slot))
+        return;
+
+    int pos = -slot - 1;
+    pager_read(p->pager, pos, p->head);
+
+    for (int i = 0; i < p->head[1]; i++)
+        pager_free(p->pager, pos + i);
+}
@@ -1,18 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../include/queue.h"
 
-struct QueueNode
-{
-    Node *n;         // Queue's item is a node
-    QueueNode *next; // Pointer to next node in the Queue
-};
-
 struct Queue
 {
-    QueueNode *head; // Reference to head of the queue
-    QueueNode *tail; // Reference to tail of the queue
-    int size;        // Get the size of the queue
+    int *items; // Ring buffer with the positions of the pages in the queue
+    int cap;    // Amount of items the buffer can hold, a power of 2
+    int head;   // Index of the first item
+    int size;   // Get the size of the queue
 };
 
 /**
@@ -24,8 +20,9 @@ Queue *queue_create()
 {
     Queue *q = (Queue *)malloc(sizeof(Queue));
 
-    q->head = NULL;
-    q->tail = NULL;
+    q->cap = QUEUE_INITIAL_CAPACITY;
+    q->items = (int *)malloc(q->cap * sizeof(int));
+    q->head = 0;
     q->size = 0;
 
     return q;
@@ -43,56 +40,72 @@ int queue_get_size(Queue *q)
 }
 
 /**
- * @brief Enqueue a node
+ * @brief Double the capacity of the buffer, unwrapping its items
  *
  * @param q
- * @param n
  */
-void queue_enqueue(Queue *q, Node *n)
+static void queue_grow(Queue *q)
 {
-    QueueNode *qn = (QueueNode *)malloc(sizeof(QueueNode));
-
-    qn->n = n;
-    qn->next = NULL;
-
-    if (!q->tail)
-    {
-        q->head = qn;
-        q->tail = qn;
-    }
-    else
-    {
-        q->tail->next = qn;
-        q->tail = qn;
-    }
+    int *items = (int *)malloc(2 * q->cap * sizeof(int));
 
-    q->size++;
+    // Items from the head to the end of the buffer, then the ones wrapped to its start
+    int first = q->cap - q->head;
+    memcpy(items, q->items + q->head, first * sizeof(int));
+    memcpy(items + first, q->items, q->head * sizeof(int));
+
+    free(q->items);
+    q->items = items;
+    q->head = 0;
+    q->cap *= 2;
 }
 
 /**
- * @brief Dequeue a node
+ * @brief Enqueue the position of a page
  *
  * @param q
- * @return Node*
+ * @param pos
  */
-Node *queue_dequeue(Queue *q)
+void queue_enqueue(Queue *q, int pos)
 {
-    if (!q->head)
-        return NULL;
-
-    QueueNode *temp = q->head;
-    Node *n = temp->n;
+    if (q->size == q->cap)
+        queue_grow(q);
 
-    q->head = q->head->next;
+    q->items[(q->head + q->size) & (q->cap - 1)] = pos;
+    q->size++;
+}
 
-    if (q->head == NULL)
-        q->tail = NULL;
+/**
+ * @brief Dequeue the position of a page
+ *
+ * @param q
+ * @return int -1 if the queue is empty
+ */
+int queue_dequeue(Queue *q)
+{
+    if (!q->size)
+        return -1;
 
-    free(temp);
+    int pos = q->items[q->head];
 
+    q->head = (q->head + 1) & (q->cap - 1);
     q->size--;
 
-    return n;
+    return pos;
+}
+
+/**
+ * @brief Get a position of the queue without dequeuing it
+ *
+ * @param q
+ * @param i amount of positions before it, 0 is the next one dequeued
+ * @return int -1 if the queue has no such position
+ */
+int queue_peek(Queue *q, int i)
+{
+    if (i < 0 || i >= q->size)
+        return -1;
+
+    return q->items[(q->head + i) & (q->cap - 1)];
 }
 
 /**
@@ -103,7 +116,7 @@ Node *queue_dequeue(Queue *q)
  */
 int queue_is_empty(Queue *q)
 {
-    if (!q->head)
+    if (!q->size)
         return 1;
     return 0;
 }
@@ -115,5 +128,6 @@ int queue_is_empty(Queue *q)
  */
 void queue_destroy(Queue *q)
 {
+    free(q->items);
     free(q);
 }
\ No newline at end of file
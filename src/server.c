@@ -0,0 +1,668 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "../include/server.h"
+
+// Bytes of responses a client may leave unread before its requests stop being read
+#define SERVER_MAX_OUTPUT (4 << 20)
+
+typedef struct Client Client;
+
+struct Client
+{
+    int fd;             // Socket of the client
+    unsigned char *in;  // Bytes received and not parsed yet
+    size_t in_len;
+    size_t in_cap;
+    unsigned char *out; // Responses not sent yet, from out_off on
+    size_t out_len;
+    size_t out_off;
+    size_t out_cap;
+    unsigned events;    // Events the client is registered for
+    bool eof;           // Flag to a client that won't send more requests
+    bool broken;        // Flag to a client whose socket failed
+    Client *prev;       // Clients of the server, in a list
+    Client *next;
+};
+
+// Request of a batch, with the client that sent it
+typedef struct
+{
+    Client *c;
+    ServerRequest req;
+} Pending;
+
+typedef struct
+{
+    BTree *bt;       // Tree served
+    int epfd;        // Epoll instance of the event loop
+    int lfd;         // Listening socket
+    Client *clients; // Connected clients
+    bool dirty;      // Flag to writes since the last sync
+
+    // Requests that arrived together, run in one pass over the tree
+    Pending *batch;
+    int batch_amount;
+    int batch_cap;
+
+    // Keys of a run of gets of the batch, searched together
+    int *keys;
+    bool *found;
+    int *records;
+    int keys_cap;
+} Server;
+
+// Pairs found by a scan
+typedef struct
+{
+    ServerPair pairs[SERVER_SCAN_LIMIT];
+    uint32_t count;
+} ScanResult;
+
+static volatile sig_atomic_t server_stop = 0;
+
+/**
+ * @brief Ask the event loop to stop
+ *
+ * @param int sig
+ */
+static void server_signal(int sig)
+{
+    (void)sig;
+    server_stop = 1;
+}
+
+/**
+ * @brief Remove what is left at the path of the socket by a server that is gone.
+ * Anything else at the path, a file or the socket of a server that still
+ * answers, stops the server
+ *
+ * @param const struct sockaddr_un* addr
+ */
+static void server_remove_stale(const struct sockaddr_un *addr)
+{
+    struct stat st;
+
+    if (lstat(addr->sun_path, &st) != 0)
+    {
+        if (errno == ENOENT)
+            return;
+        perror("The system couldn't check the path of the socket.\n");
+        exit(1);
+    }
+
+    if (!S_ISSOCK(st.st_mode))
+    {
+        fprintf(stderr, "The path of the socket is taken by a file that isn't a socket.\n");
+        exit(1);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("The system couldn't create the socket.\n");
+        exit(1);
+    }
+
+    // Only a socket nobody listens on refuses the connection
+    int live = connect(fd, (const struct sockaddr *)addr, sizeof(*addr));
+    int err = errno;
+    close(fd);
+
+    if (live == 0)
+    {
+        fprintf(stderr, "Another server is listening on the socket.\n");
+        exit(1);
+    }
+    if (err != ECONNREFUSED)
+    {
+        errno = err;
+        perror("The system couldn't check the socket.\n");
+        exit(1);
+    }
+
+    if (unlink(addr->sun_path) != 0 && errno != ENOENT)
+    {
+        perror("The system couldn't remove the stale socket.\n");
+        exit(1);
+    }
+}
+
+/**
+ * @brief Create the listening socket of the server, replacing a stale one
+ *
+ * @param const char* path
+ * @return int
+ */
+static int server_listen(const char *path)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "The path of the socket is too long.\n");
+        exit(1);
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("The system couldn't create the socket.\n");
+        exit(1);
+    }
+
+    server_remove_stale(&addr);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, SERVER_BACKLOG) != 0)
+    {
+        perror("The system couldn't listen on the socket.\n");
+        exit(1);
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Accept every pending connection
+ *
+ * @param Server* s
+ */
+static void server_accept(Server *s)
+{
+    while (true)
+    {
+        int fd = accept4(s->lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        Client *c = (Client *)calloc(1, sizeof(Client));
+        c->fd = fd;
+        c->events = EPOLLIN;
+
+        struct epoll_event ev;
+        ev.events = c->events;
+        ev.data.ptr = c;
+        epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev);
+
+        c->next = s->clients;
+        if (s->clients)
+            s->clients->prev = c;
+        s->clients = c;
+    }
+}
+
+/**
+ * @brief Disconnect a client and free memory allocated to it
+ *
+ * @param Server* s
+ * @param Client* c
+ */
+static void client_close(Server *s, Client *c)
+{
+    epoll_ctl(s->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        s->clients = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+
+    free(c->in);
+    free(c->out);
+    free(c);
+}
+
+/**
+ * @brief Read what the client sent, until the socket is empty
+ *
+ * @param Client* c
+ */
+static void client_read(Client *c)
+{
+    while (c->in_len < SERVER_MAX_INPUT)
+    {
+        if (c->in_cap - c->in_len < SERVER_READ_SIZE)
+        {
+            c->in_cap = c->in_len + SERVER_READ_SIZE;
+            c->in = (unsigned char *)realloc(c->in, c->in_cap);
+        }
+
+        ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+        if (n > 0)
+        {
+            c->in_len += n;
+            continue;
+        }
+
+        if (n == 0)
+            c->eof = true;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            c->broken = true;
+        if (n == 0 || errno != EINTR)
+            return;
+    }
+}
+
+/**
+ * @brief Move the whole requests received from a client to the batch
+ *
+ * @param Server* s
+ * @param Client* c
+ */
+static void client_parse(Server *s, Client *c)
+{
+    size_t off = 0;
+
+    for (; c->in_len - off >= sizeof(ServerRequest); off += sizeof(ServerRequest))
+    {
+        if (s->batch_amount == s->batch_cap)
+        {
+            s->batch_cap = s->batch_cap ? s->batch_cap * 2 : 1024;
+            s->batch = (Pending *)realloc(s->batch, s->batch_cap * sizeof(Pending));
+        }
+
+        s->batch[s->batch_amount].c = c;
+        memcpy(&s->batch[s->batch_amount].req, c->in + off, sizeof(ServerRequest));
+        s->batch_amount++;
+    }
+
+    // Keep the start of a request not received whole yet
+    memmove(c->in, c->in + off, c->in_len - off);
+    c->in_len -= off;
+}
+
+/**
+ * @brief Add bytes to the responses of a client
+ *
+ * @param Client* c
+ * @param const void* src
+ * @param size_t size
+ */
+static void client_put(Client *c, const void *src, size_t size)
+{
+    if (c->out_len + size > c->out_cap)
+    {
+        c->out_cap = c->out_cap ? c->out_cap : 4096;
+        while (c->out_len + size > c->out_cap)
+            c->out_cap *= 2;
+        c->out = (unsigned char *)realloc(c->out, c->out_cap);
+    }
+
+    memcpy(c->out + c->out_len, src, size);
+    c->out_len += size;
+}
+
+/**
+ * @brief Add a response to the responses of a client
+ *
+ * @param Client* c
+ * @param uint32_t status
+ * @param int32_t record
+ * @param const ServerPair* pairs
+ * @param uint32_t count
+ */
+static void client_respond(Client *c, uint32_t status, int32_t record, const ServerPair *pairs, uint32_t count)
+{
+    ServerResponse res;
+
+    res.status = status;
+    res.record = record;
+    res.count = count;
+
+    client_put(c, &res, sizeof(res));
+    if (count)
+        client_put(c, pairs, count * sizeof(ServerPair));
+}
+
+/**
+ * @brief Send the responses of a client, as long as its socket takes them
+ *
+ * @param Client* c
+ */
+static void client_flush(Client *c)
+{
+    while (c->out_off < c->out_len)
+    {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            c->out_off += n;
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            c->broken = true;
+        return;
+    }
+
+    c->out_off = 0;
+    c->out_len = 0;
+}
+
+/**
+ * @brief Register the events the client waits for now
+ *
+ * Requests stop being read while the client leaves too many responses unread
+ *
+ * @param Server* s
+ * @param Client* c
+ */
+static void client_update(Server *s, Client *c)
+{
+    size_t pending = c->out_len - c->out_off;
+    unsigned events = 0;
+
+    if (!c->eof && pending < SERVER_MAX_OUTPUT)
+        events |= EPOLLIN;
+    if (pending)
+        events |= EPOLLOUT;
+
+    if (events != c->events)
+    {
+        struct epoll_event ev;
+        ev.events = events;
+        ev.data.ptr = c;
+        epoll_ctl(s->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = events;
+    }
+}
+
+/**
+ * @brief Keep a pair found by a scan
+ *
+ * @param int key
+ * @param int record
+ * @param void* ctx the ScanResult
+ * @return false when the scan gave SERVER_SCAN_LIMIT pairs
+ */
+static bool scan_visit(int key, int record, void *ctx)
+{
+    ScanResult *r = (ScanResult *)ctx;
+
+    r->pairs[r->count].key = key;
+    r->pairs[r->count].record = record;
+    r->count++;
+
+    return r->count < SERVER_SCAN_LIMIT;
+}
+
+/**
+ * @brief Check that the tree can keep the record of an update
+ *
+ * Inserts are checked by the tree, updates are checked here so a rejected
+ * record isn't answered as a missing key
+ *
+ * @param Server* s
+ * @param int record
+ * @return false with BTREE_DUPLICATES and a negative record
+ */
+static bool server_record_valid(Server *s, int record)
+{
+    return record >= 0 || !(btree_flags(s->bt) & BTREE_DUPLICATES);
+}
+
+/**
+ * @brief Answer a run of gets of the batch, searching their keys together
+ *
+ * @param Server* s
+ * @param int first
+ * @param int end
+ */
+static void server_get(Server *s, int first, int end)
+{
+    int n = end - first;
+
+    if (n > s->keys_cap)
+    {
+        s->keys_cap = n;
+        s->keys = (int *)realloc(s->keys, n * sizeof(int));
+        s->found = (bool *)realloc(s->found, n * sizeof(bool));
+        s->records = (int *)realloc(s->records, n * sizeof(int));
+    }
+
+    for (int i = 0; i < n; i++)
+        s->keys[i] = s->batch[first + i].req.key;
+
+    btree_search_batch(s->bt, s->keys, n, s->found, s->records);
+
+    for (int i = 0; i < n; i++)
+    {
+        if (s->found[i])
+            client_respond(s->batch[first + i].c, SERVER_OK, s->records[i], NULL, 0);
+        else
+            client_respond(s->batch[first + i].c, SERVER_NOT_FOUND, 0, NULL, 0);
+    }
+}
+
+/**
+ * @brief Run the requests of the batch in order of arrival
+ *
+ * Consecutive gets descend the tree together, so the reads of their pages overlap
+ *
+ * @param Server* s
+ */
+static void server_execute(Server *s)
+{
+    ScanResult *scan = NULL;
+
+    for (int i = 0; i < s->batch_amount;)
+    {
+        Client *c = s->batch[i].c;
+        ServerRequest *req = &s->batch[i].req;
+
+        if (req->op == SERVER_OP_GET)
+        {
+            int end = i + 1;
+            while (end < s->batch_amount && s->batch[end].req.op == SERVER_OP_GET)
+                end++;
+
+            server_get(s, i, end);
+            i = end;
+            continue;
+        }
+
+        switch (req->op)
+        {
+        case SERVER_OP_INSERT:
+            if (!btree_insert(s->bt, req->key, req->value))
+            {
+                client_respond(c, SERVER_BAD_REQUEST, 0, NULL, 0);
+                break;
+            }
+            s->dirty = true;
+            client_respond(c, SERVER_OK, 0, NULL, 0);
+            break;
+
+        case SERVER_OP_DELETE:
+            btree_delete(s->bt, req->key);
+            s->dirty = true;
+            client_respond(c, SERVER_OK, 0, NULL, 0);
+            break;
+
+        case SERVER_OP_DELETE_RANGE:
+            btree_delete_range(s->bt, req->key, req->value);
+            s->dirty = true;
+            client_respond(c, SERVER_OK, 0, NULL, 0);
+            break;
+
+        case SERVER_OP_SCAN:
+            if (!scan)
+                scan = (ScanResult *)malloc(sizeof(ScanResult));
+            scan->count = 0;
+            btree_scan(s->bt, req->key, req->value, scan_visit, scan);
+            client_respond(c, SERVER_OK, 0, scan->pairs, scan->count);
+            break;
+
+        case SERVER_OP_UPDATE:
+            if (!server_record_valid(s, req->value))
+            {
+                client_respond(c, SERVER_BAD_REQUEST, 0, NULL, 0);
+            }
+            else if (btree_update(s->bt, req->key, req->value))
+            {
+                s->dirty = true;
+                client_respond(c, SERVER_OK, 0, NULL, 0);
+            }
+            else
+            {
+                client_respond(c, SERVER_NOT_FOUND, 0, NULL, 0);
+            }
+            break;
+
+        case SERVER_OP_FIND_BY_RECORD:
+        {
+            int keys[SERVER_SCAN_LIMIT];
+            int found = btree_find_by_record(s->bt, req->value, keys, SERVER_SCAN_LIMIT);
+
+            if (!scan)
+                scan = (ScanResult *)malloc(sizeof(ScanResult));
+            scan->count = found < SERVER_SCAN_LIMIT ? found : SERVER_SCAN_LIMIT;
+            for (uint32_t j = 0; j < scan->count; j++)
+            {
+                scan->pairs[j].key = keys[j];
+                scan->pairs[j].record = req->value;
+            }
+            client_respond(c, found ? SERVER_OK : SERVER_NOT_FOUND, 0, scan->pairs, scan->count);
+            break;
+        }
+
+        case SERVER_OP_GET_ALL:
+        {
+            if (!scan)
+                scan = (ScanResult *)malloc(sizeof(ScanResult));
+            scan->count = 0;
+            long found = btree_get_all(s->bt, req->key, scan_visit, scan);
+            client_respond(c, found ? SERVER_OK : SERVER_NOT_FOUND, (int)found, scan->pairs, scan->count);
+            break;
+        }
+
+        case SERVER_OP_SYNC:
+            btree_sync(s->bt);
+            s->dirty = false;
+            client_respond(c, SERVER_OK, 0, NULL, 0);
+            break;
+
+        default:
+            client_respond(c, SERVER_BAD_REQUEST, 0, NULL, 0);
+            break;
+        }
+
+        i++;
+    }
+
+    s->batch_amount = 0;
+    free(scan);
+}
+
+/**
+ * @brief Serve the tree on a Unix domain socket until SIGINT or SIGTERM
+ *
+ * A single thread waits for the clients with epoll. The requests that arrive
+ * in the same wakeup, from every client, form a batch that is run at once,
+ * and the responses are sent back when the whole batch is done. When no
+ * request arrives for SERVER_IDLE_SYNC_MS, the tree is written to the disk
+ *
+ * @param BTree* bt
+ * @param const char* path
+ */
+void server_run(BTree *bt, const char *path)
+{
+    Server s;
+    memset(&s, 0, sizeof(s));
+    s.bt = bt;
+    s.lfd = server_listen(path);
+    s.epfd = epoll_create1(EPOLL_CLOEXEC);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(s.epfd, EPOLL_CTL_ADD, s.lfd, &ev);
+
+    // The signals only interrupt the wait, the loop stops between batches
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+
+    while (!server_stop)
+    {
+        int n = epoll_wait(s.epfd, events, SERVER_MAX_EVENTS, s.dirty ? SERVER_IDLE_SYNC_MS : -1);
+
+        if (n < 0)
+            continue;
+
+        if (n == 0)
+        {
+            btree_sync(bt);
+            s.dirty = false;
+            continue;
+        }
+
+        // Gather the requests of every client that sent something
+        for (int i = 0; i < n; i++)
+        {
+            Client *c = (Client *)events[i].data.ptr;
+
+            if (!c)
+            {
+                server_accept(&s);
+                continue;
+            }
+
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                client_read(c);
+                client_parse(&s, c);
+            }
+        }
+
+        server_execute(&s);
+
+        // Send the responses, dropping the clients that are done
+        for (int i = 0; i < n; i++)
+        {
+            Client *c = (Client *)events[i].data.ptr;
+
+            if (!c)
+                continue;
+
+            client_flush(c);
+            if (c->broken || (c->eof && c->out_len == c->out_off))
+                client_close(&s, c);
+            else
+                client_update(&s, c);
+        }
+    }
+
+    while (s.clients)
+        client_close(&s, s.clients);
+
+    close(s.lfd);
+    close(s.epfd);
+    unlink(path);
+
+    free(s.batch);
+    free(s.keys);
+    free(s.found);
+    free(s.records);
+}
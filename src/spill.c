@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "../include/spill.h"
+
+struct Spill
+{
+    size_t item_size; // Size of every item
+    size_t budget;    // Bytes of items kept in memory, past them the items go to a file
+    char *path;       // Prefix of the temporary file
+    char *items;      // Items kept in memory, NULL once they are in the file
+    long cap;         // Amount of items the memory can hold
+    FILE *fp;         // Temporary file of the items, NULL while they fit in memory
+    long count;       // Amount of items pushed
+    long read;        // Amount of items read since the last rewind
+};
+
+/**
+ * @brief Create an empty sequence of items
+ *
+ * Items are pushed to the end and read back in the same order. They are kept
+ * in memory up to "budget" bytes; past it, every item goes to a temporary
+ * file created next to "path" and removed as soon as it is opened
+ *
+ * @param size_t item_size
+ * @param size_t budget SPILL_UNBOUNDED never uses a file
+ * @param const char* path
+ * @return Spill*
+ */
+Spill *spill_create(size_t item_size, size_t budget, const char *path)
+{
+    Spill *s = (Spill *)calloc(1, sizeof(Spill));
+
+    s->item_size = item_size;
+    s->budget = budget;
+    s->path = (char *)malloc(strlen(path) + 1);
+    strcpy(s->path, path);
+
+    return s;
+}
+
+/**
+ * @brief Free the memory of a sequence and close its file
+ *
+ * @param Spill* s
+ */
+void spill_destroy(Spill *s)
+{
+    if (s->fp)
+        fclose(s->fp);
+
+    free(s->items);
+    free(s->path);
+    free(s);
+}
+
+/**
+ * @brief Get the amount of items of a sequence
+ *
+ * @param Spill* s
+ * @return long
+ */
+long spill_count(Spill *s)
+{
+    return s->count;
+}
+
+/**
+ * @brief Move the items of a sequence from the memory to a temporary file
+ *
+ * @param Spill* s
+ */
+static void spill_to_file(Spill *s)
+{
+    char *name = (char *)malloc(strlen(s->path) + strlen(SPILL_SUFFIX) + 1);
+    strcpy(name, s->path);
+    strcat(name, SPILL_SUFFIX);
+
+    int fd = mkstemp(name);
+    if (fd < 0 || !(s->fp = fdopen(fd, "w+b")))
+    {
+        perror("The system couldn't create a temporary file.\n");
+        exit(1);
+    }
+    unlink(name);
+    free(name);
+
+    if (s->count && fwrite(s->items, s->item_size, s->count, s->fp) != (size_t)s->count)
+    {
+        perror("The system couldn't write to a temporary file.\n");
+        exit(1);
+    }
+
+    free(s->items);
+    s->items = NULL;
+    s->cap = 0;
+}
+
+/**
+ * @brief Push items to the end of a sequence
+ *
+ * @param Spill* s
+ * @param const void* items
+ * @param long n
+ */
+void spill_push(Spill *s, const void *items, long n)
+{
+    if (n <= 0)
+        return;
+
+    if (!s->fp && (size_t)(s->count + n) > s->budget / s->item_size)
+        spill_to_file(s);
+
+    if (s->fp)
+    {
+        if (fwrite(items, s->item_size, n, s->fp) != (size_t)n)
+        {
+            perror("The system couldn't write to a temporary file.\n");
+            exit(1);
+        }
+    }
+    else
+    {
+        if (s->count + n > s->cap)
+        {
+            long cap = s->cap ? s->cap * 2 : 1024;
+            while (cap < s->count + n)
+                cap *= 2;
+
+            // The memory never grows past the budget
+            if ((size_t)cap > s->budget / s->item_size)
+                cap = (long)(s->budget / s->item_size);
+
+            s->items = (char *)realloc(s->items, cap * s->item_size);
+            s->cap = cap;
+        }
+
+        memcpy(s->items + s->count * s->item_size, items, n * s->item_size);
+    }
+
+    s->count += n;
+}
+
+/**
+ * @brief Go back to the first item, the next reads start from it
+ *
+ * @param Spill* s
+ */
+void spill_rewind(Spill *s)
+{
+    if (s->fp && (fflush(s->fp) != 0 || fseek(s->fp, 0, SEEK_SET) != 0))
+    {
+        perror("The system couldn't read a temporary file.\n");
+        exit(1);
+    }
+
+    s->read = 0;
+}
+
+/**
+ * @brief Read the next items of a sequence, in the order they were pushed
+ *
+ * @param Spill* s
+ * @param void* items receives at most "n" items
+ * @param long n
+ * @return long amount of items read, 0 at the end
+ */
+long spill_read(Spill *s, void *items, long n)
+{
+    if (n > s->count - s->read)
+        n = s->count - s->read;
+    if (n <= 0)
+        return 0;
+
+    if (s->fp)
+    {
+        if (fread(items, s->item_size, n, s->fp) != (size_t)n)
+        {
+            perror("The system couldn't read a temporary file.\n");
+            exit(1);
+        }
+    }
+    else
+    {
+        memcpy(items, s->items + s->read * s->item_size, n * s->item_size);
+    }
+
+    s->read += n;
+
+    return n;
+}
+
+/**
+ * @brief Remove every item of a sequence, so it can be filled again
+ *
+ * @param Spill* s
+ */
+void spill_clear(Spill *s)
+{
+    if (s->fp)
+    {
+        fclose(s->fp);
+        s->fp = NULL;
+    }
+
+    s->count = 0;
+    s->read = 0;
+}
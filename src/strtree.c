@@ -0,0 +1,912 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../include/pager.h"
+#include "../include/strtree.h"
+
+// Layout of a page: a 16 bytes header, the prefix shared by every key of the
+// node and then the entries. Internal pages store their first child right after
+// the prefix, so each entry is (suffix_len, suffix, record/child)
+#define STR_HEADER_SIZE 16
+#define STR_ENTRY_OVERHEAD (sizeof(uint16_t) + sizeof(int32_t))
+#define STR_MIN_PAGE_SIZE 256
+#define STR_MAX_PAGE_SIZE 32768
+
+struct StrNode
+{
+    int n_keys;            // Number of keys
+    bool is_leaf;          // Flag to leaves
+    int b_position;        // Node's position in the binary file
+    int next;              // Right sibling of a leaf, -1 if there isn't one
+    int capacity;          // Amount of slots allocated to the vectors
+    unsigned char **keys;  // Set of full keys (leaves) or separators (internal nodes)
+    int *lens;             // Length of every key
+    int *records;          // Set of values associated to the keys (only leaves)
+    int *children;         // Index of node's children (only internal nodes)
+};
+
+struct StrTree
+{
+    Pager *pager;     // Pages of the tree in the binary file
+    size_t page_size; // Size of a node in the binary file
+    StrNode *root;    // Tree's root
+};
+
+/**
+ * @brief Compare two byte strings in lexicographic order
+ *
+ * @param const unsigned char* a
+ * @param int alen
+ * @param const unsigned char* b
+ * @param int blen
+ * @return int
+ */
+static int key_compare(const unsigned char *a, int alen, const unsigned char *b, int blen)
+{
+    int len = alen < blen ? alen : blen;
+    int res = memcmp(a, b, len);
+
+    if (res != 0)
+        return res;
+
+    return alen - blen;
+}
+
+/**
+ * @brief Get the length of the longest common prefix of two byte strings
+ *
+ * @param const unsigned char* a
+ * @param int alen
+ * @param const unsigned char* b
+ * @param int blen
+ * @return int
+ */
+static int common_prefix(const unsigned char *a, int alen, const unsigned char *b, int blen)
+{
+    int i = 0;
+
+    while (i < alen && i < blen && a[i] == b[i])
+        i++;
+
+    return i;
+}
+
+/**
+ * @brief Duplicate a byte string
+ *
+ * @param const unsigned char* key
+ * @param int len
+ * @return unsigned char*
+ */
+static unsigned char *key_dup(const unsigned char *key, int len)
+{
+    unsigned char *k = (unsigned char *)malloc(len > 0 ? len : 1);
+    memcpy(k, key, len);
+    return k;
+}
+
+/**
+ * @brief Grow the vectors of a node so it can hold at least "slots" keys
+ *
+ * @param StrNode* n
+ * @param int slots
+ */
+static void strnode_reserve(StrNode *n, int slots)
+{
+    if (slots <= n->capacity)
+        return;
+
+    int capacity = n->capacity * 2;
+    if (capacity < slots)
+        capacity = slots;
+
+    n->keys = (unsigned char **)realloc(n->keys, capacity * sizeof(unsigned char *));
+    n->lens = (int *)realloc(n->lens, capacity * sizeof(int));
+    n->records = (int *)realloc(n->records, capacity * sizeof(int));
+    n->children = (int *)realloc(n->children, (capacity + 1) * sizeof(int));
+    n->capacity = capacity;
+}
+
+/**
+ * @brief Create a node and allocate memory for it
+ *
+ * @param StrTree* st
+ * @param bool is_leaf
+ * @param int pos
+ * @return StrNode*
+ */
+StrNode *strnode_create(StrTree *st, bool is_leaf, int pos)
+{
+    StrNode *n = (StrNode *)malloc(sizeof(StrNode));
+
+    // Set initial params
+    n->n_keys = 0;
+    n->is_leaf = is_leaf;
+    n->b_position = pos;
+    n->next = -1;
+    n->capacity = 0;
+    n->keys = NULL;
+    n->lens = NULL;
+    n->records = NULL;
+    n->children = NULL;
+
+    // A page never holds more entries than this, the extra slot is for overflows
+    strnode_reserve(n, (int)(st->page_size / STR_ENTRY_OVERHEAD) + 1);
+    n->children[0] = -1;
+
+    return n;
+}
+
+/**
+ * @brief Length of the prefix shared by all keys of the node
+ *
+ * @param StrNode* n
+ * @return int
+ */
+static int strnode_prefix_len(StrNode *n)
+{
+    // Keys are sorted, so the prefix of the first and last keys is shared by all of them
+    if (n->n_keys == 0)
+        return 0;
+
+    return common_prefix(n->keys[0], n->lens[0], n->keys[n->n_keys - 1], n->lens[n->n_keys - 1]);
+}
+
+/**
+ * @brief Get the amount of bytes the node takes once prefix compressed
+ *
+ * @param StrNode* n
+ * @return size_t
+ */
+size_t strnode_encoded_size(StrNode *n)
+{
+    int prefix = strnode_prefix_len(n);
+    size_t size = STR_HEADER_SIZE + prefix;
+
+    if (!n->is_leaf)
+        size += sizeof(int32_t);
+
+    for (int i = 0; i < n->n_keys; i++)
+        size += STR_ENTRY_OVERHEAD + n->lens[i] - prefix;
+
+    return size;
+}
+
+/**
+ * @brief Destroy a node, freeing the memory allocated for it
+ *
+ * @param StrNode* n
+ */
+void strnode_destroy(StrNode *n)
+{
+    if (n)
+    {
+        for (int i = 0; i < n->n_keys; i++)
+            free(n->keys[i]);
+        free(n->keys);
+        free(n->lens);
+        free(n->records);
+        free(n->children);
+        free(n);
+    }
+}
+
+/**
+ * @brief Function to write a node, prefix compressed, to the binary file
+ *
+ * @param StrTree* st
+ * @param StrNode* n
+ */
+void strtree_disk_write(StrTree *st, StrNode *n)
+{
+    unsigned char *page = (unsigned char *)calloc(1, st->page_size);
+    int prefix = strnode_prefix_len(n);
+
+    uint16_t n_keys = (uint16_t)n->n_keys;
+    uint16_t prefix_len = (uint16_t)prefix;
+    int32_t pos = n->b_position;
+    int32_t next = n->next;
+
+    // Write the header
+    memcpy(page, &n_keys, sizeof(uint16_t));
+    page[2] = n->is_leaf;
+    memcpy(page + 4, &pos, sizeof(int32_t));
+    memcpy(page + 8, &next, sizeof(int32_t));
+    memcpy(page + 12, &prefix_len, sizeof(uint16_t));
+
+    // Write the shared prefix only once
+    size_t off = STR_HEADER_SIZE;
+    if (n->n_keys > 0)
+        memcpy(page + off, n->keys[0], prefix);
+    off += prefix;
+
+    if (!n->is_leaf)
+    {
+        int32_t child = n->children[0];
+        memcpy(page + off, &child, sizeof(int32_t));
+        off += sizeof(int32_t);
+    }
+
+    // Write every entry with the suffix of its key
+    for (int i = 0; i < n->n_keys; i++)
+    {
+        uint16_t suffix_len = (uint16_t)(n->lens[i] - prefix);
+        int32_t value = n->is_leaf ? n->records[i] : n->children[i + 1];
+
+        memcpy(page + off, &suffix_len, sizeof(uint16_t));
+        off += sizeof(uint16_t);
+        memcpy(page + off, n->keys[i] + prefix, suffix_len);
+        off += suffix_len;
+        memcpy(page + off, &value, sizeof(int32_t));
+        off += sizeof(int32_t);
+    }
+
+    pager_write(st->pager, n->b_position, page);
+    free(page);
+}
+
+/**
+ * @brief Read a node from binary file, rebuilding its full keys
+ *
+ * @param StrTree* st
+ * @param int pos
+ * @return StrNode*
+ */
+StrNode *strtree_disk_read(StrTree *st, int pos)
+{
+    unsigned char *page = (unsigned char *)malloc(st->page_size);
+    pager_read(st->pager, pos, page);
+
+    uint16_t n_keys;
+    uint16_t prefix_len;
+    int32_t next;
+
+    // Read the header
+    memcpy(&n_keys, page, sizeof(uint16_t));
+    memcpy(&next, page + 8, sizeof(int32_t));
+    memcpy(&prefix_len, page + 12, sizeof(uint16_t));
+
+    StrNode *n = strnode_create(st, page[2], pos);
+    n->next = next;
+
+    size_t off = STR_HEADER_SIZE;
+    const unsigned char *prefix = page + off;
+    off += prefix_len;
+
+    if (!n->is_leaf)
+    {
+        int32_t child;
+        memcpy(&child, page + off, sizeof(int32_t));
+        n->children[0] = child;
+        off += sizeof(int32_t);
+    }
+
+    // Read every entry, putting the prefix back in front of its suffix
+    for (int i = 0; i < n_keys; i++)
+    {
+        uint16_t suffix_len;
+        int32_t value;
+
+        memcpy(&suffix_len, page + off, sizeof(uint16_t));
+        off += sizeof(uint16_t);
+
+        n->lens[i] = prefix_len + suffix_len;
+        n->keys[i] = (unsigned char *)malloc(n->lens[i] > 0 ? n->lens[i] : 1);
+        memcpy(n->keys[i], prefix, prefix_len);
+        memcpy(n->keys[i] + prefix_len, page + off, suffix_len);
+        off += suffix_len;
+
+        memcpy(&value, page + off, sizeof(int32_t));
+        off += sizeof(int32_t);
+
+        if (n->is_leaf)
+            n->records[i] = value;
+        else
+            n->children[i + 1] = value;
+    }
+    n->n_keys = n_keys;
+
+    free(page);
+    return n;
+}
+
+/**
+ * @brief Create a string-key tree and allocate memory to it
+ *
+ * @param char* path
+ * @param size_t page_size
+ * @return StrTree*
+ */
+StrTree *strtree_create(char *path, size_t page_size)
+{
+    StrTree *st = (StrTree *)malloc(sizeof(StrTree));
+
+    // Keep the page size in a range the 16 bits offsets of the page can address
+    if (page_size < STR_MIN_PAGE_SIZE)
+        page_size = STR_MIN_PAGE_SIZE;
+    if (page_size > STR_MAX_PAGE_SIZE)
+        page_size = STR_MAX_PAGE_SIZE;
+
+    // Set initial params
+    st->page_size = page_size;
+    st->pager = pager_open(path, page_size);
+    st->root = NULL;
+
+    return st;
+}
+
+/**
+ * @brief Destroy a string-key tree and free memory allocated to it
+ *
+ * @param StrTree* st
+ */
+void strtree_destroy(StrTree *st)
+{
+    strnode_destroy(st->root);
+    pager_close(st->pager);
+    free(st);
+}
+
+/**
+ * @brief Get the longest key accepted by the tree
+ *
+ * Any page must hold at least three entries, so a split always leaves two
+ * non-empty halves
+ *
+ * @param StrTree* st
+ * @return size_t
+ */
+size_t strtree_max_key_len(StrTree *st)
+{
+    return (st->page_size - STR_HEADER_SIZE - sizeof(int32_t)) / 3 - STR_ENTRY_OVERHEAD;
+}
+
+/**
+ * @brief Set the amount of pages the cache of the tree keeps in memory
+ *
+ * @param StrTree* st
+ * @param int pages 0 disables the cache
+ */
+void strtree_set_cache_size(StrTree *st, int pages)
+{
+    pager_set_cache(st->pager, pages);
+}
+
+/**
+ * @brief Write back the dirty pages of the tree and wait for them to reach the disk
+ *
+ * @param StrTree* st
+ */
+void strtree_sync(StrTree *st)
+{
+    pager_sync(st->pager);
+}
+
+/**
+ * @brief Find the first key of the node that is not smaller than the key
+ *
+ * @param StrNode* n
+ * @param const unsigned char* key
+ * @param int len
+ * @return int
+ */
+static int strnode_lower_bound(StrNode *n, const unsigned char *key, int len)
+{
+    int lo = 0, hi = n->n_keys;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (key_compare(n->keys[mid], n->lens[mid], key, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * @brief Find the child of an internal node that may hold the key
+ *
+ * A separator s sends to its right every key k with k >= s
+ *
+ * @param StrNode* n
+ * @param const unsigned char* key
+ * @param int len
+ * @return int
+ */
+static int strnode_child_index(StrNode *n, const unsigned char *key, int len)
+{
+    int lo = 0, hi = n->n_keys;
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (key_compare(n->keys[mid], n->lens[mid], key, len) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * @brief Open a slot at index i of the node, shifting keys and values to the right
+ *
+ * @param StrNode* n
+ * @param int i
+ */
+static void strnode_open_slot(StrNode *n, int i)
+{
+    strnode_reserve(n, n->n_keys + 1);
+
+    for (int j = n->n_keys; j > i; j--)
+    {
+        n->keys[j] = n->keys[j - 1];
+        n->lens[j] = n->lens[j - 1];
+        n->records[j] = n->records[j - 1];
+        n->children[j + 1] = n->children[j];
+    }
+
+    n->n_keys++;
+}
+
+/**
+ * @brief Move the entries [from, n_keys) of a node to the end of another node
+ *
+ * @param StrNode* src
+ * @param int from
+ * @param StrNode* dst
+ */
+static void strnode_move_tail(StrNode *src, int from, StrNode *dst)
+{
+    strnode_reserve(dst, dst->n_keys + src->n_keys - from);
+
+    for (int j = from; j < src->n_keys; j++)
+    {
+        dst->keys[dst->n_keys] = src->keys[j];
+        dst->lens[dst->n_keys] = src->lens[j];
+        dst->records[dst->n_keys] = src->records[j];
+        dst->children[dst->n_keys + 1] = src->children[j + 1];
+        dst->n_keys++;
+    }
+
+    src->n_keys = from;
+}
+
+/**
+ * @brief Find the index where an overflowing node must be split
+ *
+ * Entries are weighted by their size under the prefix of the whole node, so
+ * each half ends up with roughly the same amount of bytes. Around that point,
+ * leaves prefer the index that gives the shortest separator, among the ones
+ * whose halves still fit in a page
+ *
+ * @param StrNode* n
+ * @param size_t page_size
+ * @return int
+ */
+static int strnode_split_index(StrNode *n, size_t page_size)
+{
+    int prefix = strnode_prefix_len(n);
+    size_t fixed = STR_HEADER_SIZE + prefix + (n->is_leaf ? 0 : sizeof(int32_t));
+    int mid = 1;
+
+    // Bytes of the entries before each index; the prefix of a half is never
+    // shorter than the one of the whole node, so these bound its size
+    size_t *acc = (size_t *)malloc((n->n_keys + 1) * sizeof(size_t));
+    acc[0] = 0;
+    for (int i = 0; i < n->n_keys; i++)
+        acc[i + 1] = acc[i] + STR_ENTRY_OVERHEAD + n->lens[i] - prefix;
+
+    size_t total = acc[n->n_keys];
+    for (int i = 0; i < n->n_keys; i++)
+    {
+        if (acc[i + 1] * 2 >= total)
+        {
+            mid = i;
+            break;
+        }
+    }
+
+    // Keep at least one key on each side (internal nodes also give one key to the parent)
+    int lo = 1;
+    int hi = n->is_leaf ? n->n_keys - 1 : n->n_keys - 2;
+    if (mid < lo)
+        mid = lo;
+    if (mid > hi)
+        mid = hi;
+
+    if (!n->is_leaf)
+    {
+        free(acc);
+        return mid;
+    }
+
+    // Suffix truncation: look a little around the middle for the shortest separator.
+    // The middle always fits, moving away from it may overflow a half with large keys
+    int window = n->n_keys / 8;
+    int best = mid;
+    int best_len = common_prefix(n->keys[mid - 1], n->lens[mid - 1], n->keys[mid], n->lens[mid]);
+
+    for (int i = mid - window; i <= mid + window; i++)
+    {
+        if (i < lo || i > hi || fixed + acc[i] > page_size || fixed + total - acc[i] > page_size)
+            continue;
+
+        int len = common_prefix(n->keys[i - 1], n->lens[i - 1], n->keys[i], n->lens[i]);
+        if (len < best_len)
+        {
+            best = i;
+            best_len = len;
+        }
+    }
+    free(acc);
+
+    return best;
+}
+
+/**
+ * @brief Split an overflowing node, returning the separator that goes to the parent
+ *
+ * @param StrTree* st
+ * @param StrNode* y
+ * @param unsigned char** sep
+ * @param int* sep_len
+ * @return int position of the new right node
+ */
+static int strtree_split(StrTree *st, StrNode *y, unsigned char **sep, int *sep_len)
+{
+    StrNode *z = strnode_create(st, y->is_leaf, pager_alloc(st->pager));
+    int m = strnode_split_index(y, st->page_size);
+
+    if (y->is_leaf)
+    {
+        // The separator is the shortest prefix of z's first key greater than y's last key
+        unsigned char *left = y->keys[m - 1];
+        unsigned char *right = y->keys[m];
+        int len = common_prefix(left, y->lens[m - 1], right, y->lens[m]) + 1;
+
+        *sep_len = len;
+        *sep = key_dup(right, len);
+
+        strnode_move_tail(y, m, z);
+
+        // Link the leaves
+        z->next = y->next;
+        y->next = z->b_position;
+    }
+    else
+    {
+        // The median separator moves up, its right child becomes z's first child
+        *sep = y->keys[m];
+        *sep_len = y->lens[m];
+        z->children[0] = y->children[m + 1];
+
+        strnode_move_tail(y, m + 1, z);
+        y->n_keys = m;
+    }
+
+    strtree_disk_write(st, y);
+    strtree_disk_write(st, z);
+
+    int pos = z->b_position;
+    strnode_destroy(z);
+
+    return pos;
+}
+
+/**
+ * @brief Recursive insertion, splitting nodes bottom-up when they overflow the page
+ *
+ * @param StrTree* st
+ * @param StrNode* n
+ * @param const unsigned char* key
+ * @param int len
+ * @param int record
+ * @param unsigned char** sep
+ * @param int* sep_len
+ * @param int* right
+ * @return int -1 if the key exists, 0 if inserted, 1 if inserted and n was split
+ */
+static int strtree_insert_node(StrTree *st, StrNode *n, const unsigned char *key, int len, int record,
+                               unsigned char **sep, int *sep_len, int *right)
+{
+    if (n->is_leaf)
+    {
+        int i = strnode_lower_bound(n, key, len);
+
+        // Check if the key already exists in the tree
+        if (i < n->n_keys && key_compare(n->keys[i], n->lens[i], key, len) == 0)
+            return -1;
+
+        strnode_open_slot(n, i);
+        n->keys[i] = key_dup(key, len);
+        n->lens[i] = len;
+        n->records[i] = record;
+    }
+    else
+    {
+        int i = strnode_child_index(n, key, len);
+        StrNode *child = strtree_disk_read(st, n->children[i]);
+
+        unsigned char *child_sep;
+        int child_sep_len;
+        int child_right;
+
+        int res = strtree_insert_node(st, child, key, len, record, &child_sep, &child_sep_len, &child_right);
+        strnode_destroy(child);
+
+        if (res <= 0)
+            return res;
+
+        // The child was split, so its separator goes to this node
+        strnode_open_slot(n, i);
+        n->keys[i] = child_sep;
+        n->lens[i] = child_sep_len;
+        n->children[i + 1] = child_right;
+    }
+
+    if (strnode_encoded_size(n) > st->page_size)
+    {
+        *right = strtree_split(st, n, sep, sep_len);
+        return 1;
+    }
+
+    strtree_disk_write(st, n);
+    return 0;
+}
+
+/**
+ * @brief Insert a key to the tree
+ *
+ * @param StrTree* st
+ * @param const char* key
+ * @param size_t len
+ * @param int record
+ * @return true if the key was inserted
+ * @return false if the key exists or is too long
+ */
+bool strtree_insert(StrTree *st, const char *key, size_t len, int record)
+{
+    if (len > strtree_max_key_len(st))
+        return false;
+
+    // If the tree is empty, create a new root node
+    if (!st->root)
+        st->root = strnode_create(st, true, pager_alloc(st->pager));
+
+    unsigned char *sep;
+    int sep_len;
+    int right;
+
+    int res = strtree_insert_node(st, st->root, (const unsigned char *)key, (int)len, record, &sep, &sep_len, &right);
+    if (res < 0)
+        return false;
+
+    // If the root was split, grow the tree height
+    if (res > 0)
+    {
+        StrNode *new_root = strnode_create(st, false, pager_alloc(st->pager));
+        new_root->children[0] = st->root->b_position;
+        new_root->keys[0] = sep;
+        new_root->lens[0] = sep_len;
+        new_root->children[1] = right;
+        new_root->n_keys = 1;
+
+        strtree_disk_write(st, new_root);
+        strnode_destroy(st->root);
+        st->root = new_root;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Search a key in the tree
+ *
+ * @param StrTree* st
+ * @param const char* key
+ * @param size_t len
+ * @param int* record if not NULL, receives the record of the key
+ * @return true
+ * @return false
+ */
+bool strtree_search(StrTree *st, const char *key, size_t len, int *record)
+{
+    if (!st->root)
+        return false;
+
+    const unsigned char *k = (const unsigned char *)key;
+    StrNode *n = st->root;
+
+    // Go down to the leaf that may hold the key
+    while (!n->is_leaf)
+    {
+        StrNode *child = strtree_disk_read(st, n->children[strnode_child_index(n, k, (int)len)]);
+        if (n != st->root)
+            strnode_destroy(n);
+        n = child;
+    }
+
+    int i = strnode_lower_bound(n, k, (int)len);
+    bool found = i < n->n_keys && key_compare(n->keys[i], n->lens[i], k, (int)len) == 0;
+
+    if (found && record)
+        *record = n->records[i];
+
+    if (n != st->root)
+        strnode_destroy(n);
+
+    return found;
+}
+
+/**
+ * @brief Visit in order the keys of the range [lo, hi]
+ *
+ * The tree is descended once, to the leaf of "lo"; the next leaves are
+ * reached by their links, skipping the ones left empty by deletes
+ *
+ * @param StrTree* st
+ * @param const char* lo
+ * @param size_t lo_len
+ * @param const char* hi
+ * @param size_t hi_len
+ * @param StrTreeVisitor visit
+ * @param void* ctx
+ */
+void strtree_scan(StrTree *st, const char *lo, size_t lo_len, const char *hi, size_t hi_len, StrTreeVisitor visit, void *ctx)
+{
+    if (!st->root)
+        return;
+
+    const unsigned char *l = (const unsigned char *)lo;
+    const unsigned char *h = (const unsigned char *)hi;
+    StrNode *n = st->root;
+
+    while (!n->is_leaf)
+    {
+        StrNode *child = strtree_disk_read(st, n->children[strnode_child_index(n, l, (int)lo_len)]);
+        if (n != st->root)
+            strnode_destroy(n);
+        n = child;
+    }
+
+    int i = strnode_lower_bound(n, l, (int)lo_len);
+
+    while (n)
+    {
+        for (; i < n->n_keys; i++)
+        {
+            if (key_compare(n->keys[i], n->lens[i], h, (int)hi_len) > 0 ||
+                !visit((const char *)n->keys[i], n->lens[i], n->records[i], ctx))
+            {
+                if (n != st->root)
+                    strnode_destroy(n);
+                return;
+            }
+        }
+
+        int next = n->next;
+        if (n != st->root)
+            strnode_destroy(n);
+        n = next == -1 ? NULL : strtree_disk_read(st, next);
+        i = 0;
+    }
+}
+
+/**
+ * @brief Delete a key from the tree
+ *
+ * Leaves are allowed to underflow: separators stay valid without their key,
+ * and a page only becomes smaller when keys are removed
+ *
+ * @param StrTree* st
+ * @param const char* key
+ * @param size_t len
+ * @return true if the key was removed
+ * @return false
+ */
+bool strtree_delete(StrTree *st, const char *key, size_t len)
+{
+    if (!st->root)
+        return false;
+
+    const unsigned char *k = (const unsigned char *)key;
+    StrNode *n = st->root;
+
+    while (!n->is_leaf)
+    {
+        StrNode *child = strtree_disk_read(st, n->children[strnode_child_index(n, k, (int)len)]);
+        if (n != st->root)
+            strnode_destroy(n);
+        n = child;
+    }
+
+    int i = strnode_lower_bound(n, k, (int)len);
+    bool found = i < n->n_keys && key_compare(n->keys[i], n->lens[i], k, (int)len) == 0;
+
+    if (found)
+    {
+        // Shift all keys and records to the right of the key to be removed
+        free(n->keys[i]);
+        for (int j = i + 1; j < n->n_keys; j++)
+        {
+            n->keys[j - 1] = n->keys[j];
+            n->lens[j - 1] = n->lens[j];
+            n->records[j - 1] = n->records[j];
+        }
+        n->n_keys--;
+
+        strtree_disk_write(st, n);
+    }
+
+    if (n != st->root)
+        strnode_destroy(n);
+
+    return found;
+}
+
+/**
+ * @brief Print the tree in level-order
+ *
+ * @param StrTree* st
+ * @param FILE* fp
+ */
+void strtree_level_order_print(StrTree *st, FILE *fp)
+{
+    if (!st->root)
+        return;
+
+    // Positions of the nodes of the current and of the next level
+    int level_size = 1;
+    int *level = (int *)malloc(sizeof(int));
+    level[0] = st->root->b_position;
+
+    while (level_size > 0)
+    {
+        int next_cap = 0, next_size = 0;
+        int *next = NULL;
+
+        for (int i = 0; i < level_size; i++)
+        {
+            StrNode *curr = level[i] == st->root->b_position ? st->root : strtree_disk_read(st, level[i]);
+
+            if (curr->n_keys > 0)
+            {
+                fprintf(fp, "[");
+                for (int j = 0; j < curr->n_keys; j++)
+                    fprintf(fp, "key: %.*s, ", curr->lens[j], (char *)curr->keys[j]);
+                fprintf(fp, "]");
+            }
+
+            // If the node is not a leaf, keep its children for the next level
+            if (!curr->is_leaf)
+            {
+                for (int j = 0; j <= curr->n_keys; j++)
+                {
+                    if (next_size == next_cap)
+                    {
+                        next_cap = next_cap ? next_cap * 2 : 16;
+                        next = (int *)realloc(next, next_cap * sizeof(int));
+                    }
+                    next[next_size++] = curr->children[j];
+                }
+            }
+
+            if (curr != st->root)
+                strnode_destroy(curr);
+        }
+        fprintf(fp, "\n");
+
+        free(level);
+        level = next;
+        level_size = next_size;
+    }
+
+    free(level);
+}
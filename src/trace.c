@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../include/trace.h"
+
+struct Histogram
+{
+    uint64_t counts[HISTOGRAM_BUCKETS]; // Values recorded per bucket
+    uint64_t total;                     // Values recorded
+    uint64_t sum;                       // Sum of the values recorded
+    uint64_t max;                       // Largest value recorded
+};
+
+struct Trace
+{
+    int fd;              // Trace file
+    size_t bytes;        // Size of the file, all of it mapped
+    TraceHeader *header; // Start of the mapping
+    TraceEvent *events;  // Ring of events, right after the header
+    uint64_t start;      // Time the trace was opened
+    uint32_t next_op;    // Last operation given an id
+};
+
+// Operation of the calling thread, its events carry its id, type and key
+static _Thread_local uint32_t current_op;
+static _Thread_local uint8_t current_type;
+static _Thread_local int32_t current_key;
+
+/**
+ * @brief Create an empty histogram
+ *
+ * @return Histogram*
+ */
+Histogram *histogram_create()
+{
+    return (Histogram *)calloc(1, sizeof(Histogram));
+}
+
+/**
+ * @brief Free the memory of a histogram
+ *
+ * @param Histogram* h
+ */
+void histogram_destroy(Histogram *h)
+{
+    free(h);
+}
+
+/**
+ * @brief Get the bucket of a value
+ *
+ * Keeps the highest bit set and the HISTOGRAM_SUB_BITS after it
+ *
+ * @param uint64_t value
+ * @return int
+ */
+static int histogram_bucket(uint64_t value)
+{
+    if (value < (1u << HISTOGRAM_SUB_BITS))
+        return (int)value;
+
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+    int sub = (int)(value >> shift) - (1 << HISTOGRAM_SUB_BITS);
+
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+/**
+ * @brief Get the largest value counted in a bucket
+ *
+ * @param int bucket
+ * @return uint64_t
+ */
+static uint64_t histogram_bucket_value(int bucket)
+{
+    if (bucket < (1 << HISTOGRAM_SUB_BITS))
+        return bucket;
+
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = bucket & ((1 << HISTOGRAM_SUB_BITS) - 1);
+
+    return (((1ull << HISTOGRAM_SUB_BITS) + sub) << shift) + (1ull << shift) - 1;
+}
+
+/**
+ * @brief Count a value, it can be called by many threads at once
+ *
+ * @param Histogram* h
+ * @param uint64_t value
+ */
+void histogram_record(Histogram *h, uint64_t value)
+{
+    __atomic_add_fetch(&h->counts[histogram_bucket(value)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->total, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sum, value, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (value > max && !__atomic_compare_exchange_n(&h->max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/**
+ * @brief Forget every value of a histogram
+ *
+ * @param Histogram* h
+ */
+void histogram_reset(Histogram *h)
+{
+    memset(h, 0, sizeof(Histogram));
+}
+
+/**
+ * @brief Get the amount of values of a histogram
+ *
+ * @param Histogram* h
+ * @return uint64_t
+ */
+uint64_t histogram_count(Histogram *h)
+{
+    return __atomic_load_n(&h->total, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the largest value of a histogram
+ *
+ * @param Histogram* h
+ * @return uint64_t
+ */
+uint64_t histogram_max(Histogram *h)
+{
+    return __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the mean of the values of a histogram
+ *
+ * @param Histogram* h
+ * @return double 0 without values
+ */
+double histogram_mean(Histogram *h)
+{
+    uint64_t total = histogram_count(h);
+
+    return total ? (double)__atomic_load_n(&h->sum, __ATOMIC_RELAXED) / total : 0;
+}
+
+/**
+ * @brief Get the value under which a fraction of the values lie
+ *
+ * @param Histogram* h
+ * @param double q fraction, from 0 to 1
+ * @return uint64_t the largest value of the bucket reached, never more than the max
+ */
+uint64_t histogram_percentile(Histogram *h, double q)
+{
+    uint64_t total = histogram_count(h);
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(q * total + 0.5);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+    {
+        seen += __atomic_load_n(&h->counts[b], __ATOMIC_RELAXED);
+        if (seen >= rank)
+        {
+            uint64_t value = histogram_bucket_value(b);
+            uint64_t max = histogram_max(h);
+            return value < max ? value : max;
+        }
+    }
+
+    return histogram_max(h);
+}
+
+/**
+ * @brief Get the time of a monotonic clock, in nanoseconds
+ *
+ * @return uint64_t
+ */
+uint64_t trace_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief Create a trace file holding the last "capacity" events
+ *
+ * The file is mapped to memory, so an event is written with a store and the
+ * events stay in the file even if the process dies
+ *
+ * @param const char* path
+ * @param uint32_t capacity
+ * @return Trace*
+ */
+Trace *trace_open(const char *path, uint32_t capacity)
+{
+    Trace *t = (Trace *)malloc(sizeof(Trace));
+
+    if (capacity < 1)
+        capacity = 1;
+
+    t->bytes = sizeof(TraceHeader) + (size_t)capacity * sizeof(TraceEvent);
+    t->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (t->fd < 0 || ftruncate(t->fd, t->bytes) != 0)
+    {
+        perror("The system couldn't create the trace file.\n");
+        exit(1);
+    }
+
+    t->header = (TraceHeader *)mmap(NULL, t->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, t->fd, 0);
+    if (t->header == MAP_FAILED)
+    {
+        perror("The system couldn't map the trace file.\n");
+        exit(1);
+    }
+
+    t->events = (TraceEvent *)(t->header + 1);
+    t->header->magic = TRACE_MAGIC;
+    t->header->capacity = capacity;
+    t->header->written = 0;
+    t->start = trace_now();
+    t->next_op = 0;
+
+    return t;
+}
+
+/**
+ * @brief Write the events to the file and close it
+ *
+ * @param Trace* t
+ */
+void trace_close(Trace *t)
+{
+    msync(t->header, t->bytes, MS_SYNC);
+    munmap(t->header, t->bytes);
+    close(t->fd);
+    free(t);
+}
+
+/**
+ * @brief Put an event of the operation of the calling thread in the ring
+ *
+ * @param Trace* t
+ * @param int kind
+ * @param int pos
+ * @param int depth
+ */
+static void trace_put(Trace *t, int kind, int pos, int depth)
+{
+    uint64_t slot = __atomic_fetch_add(&t->header->written, 1, __ATOMIC_RELAXED) % t->header->capacity;
+    TraceEvent *e = &t->events[slot];
+
+    e->time = trace_now() - t->start;
+    e->op = current_op;
+    e->kind = (uint8_t)kind;
+    e->type = current_type;
+    e->depth = (int16_t)depth;
+    e->pos = pos;
+    e->key = current_key;
+}
+
+/**
+ * @brief Start an operation in the calling thread, the next events belong to it
+ *
+ * @param Trace* t
+ * @param int type
+ * @param int key
+ */
+void trace_begin(Trace *t, int type, int key)
+{
+    current_op = __atomic_add_fetch(&t->next_op, 1, __ATOMIC_RELAXED);
+    current_type = (uint8_t)type;
+    current_key = key;
+
+    trace_put(t, TRACE_OP_BEGIN, -1, 0);
+}
+
+/**
+ * @brief End the operation of the calling thread
+ *
+ * @param Trace* t
+ */
+void trace_end(Trace *t)
+{
+    trace_put(t, TRACE_OP_END, -1, 0);
+
+    current_op = 0;
+    current_type = 0;
+    current_key = 0;
+}
+
+/**
+ * @brief Mark a step of the operation of the calling thread
+ *
+ * @param Trace* t
+ * @param int kind one of TRACE_SPLIT, TRACE_MERGE, TRACE_BORROW, TRACE_PAGE_READ and TRACE_PAGE_WRITE
+ * @param int pos position of the page
+ * @param int depth
+ */
+void trace_event(Trace *t, int kind, int pos, int depth)
+{
+    trace_put(t, kind, pos, depth);
+}
@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../include/btree.h"
+#include "../include/trace.h"
+
+// Depths told apart by the folded stacks, deeper ones are counted in the last
+#define TOOL_DEPTHS 32
+
+// Operation of the trace, with its events
+typedef struct
+{
+    uint32_t id;
+    int type;
+    int key;
+    long first;        // Place of its first event, in the events sorted by operation
+    long count;        // Amount of its events
+    uint64_t duration; // Time from its start to its end, in nanoseconds
+    long kinds[TRACE_KINDS];
+    int depth;         // Deepest event
+} ToolOp;
+
+/**
+ * @brief Get the name of a kind of event
+ *
+ * @param int kind
+ * @return const char*
+ */
+static const char *kind_name(int kind)
+{
+    static const char *names[TRACE_KINDS] = {"begin", "end", "split", "merge", "borrow", "page_read", "page_write"};
+
+    return kind >= 0 && kind < TRACE_KINDS ? names[kind] : "unknown";
+}
+
+/**
+ * @brief Order events by operation, keeping the order they were written in
+ *
+ * @param const void* a
+ * @param const void* b
+ * @return int
+ */
+static int event_cmp(const void *a, const void *b)
+{
+    const TraceEvent *x = (const TraceEvent *)a;
+    const TraceEvent *y = (const TraceEvent *)b;
+
+    if (x->op != y->op)
+        return x->op < y->op ? -1 : 1;
+    if (x->time != y->time)
+        return x->time < y->time ? -1 : 1;
+
+    // Events of the same time keep the begin first and the end last
+    int kx = x->kind == TRACE_OP_BEGIN ? -1 : x->kind == TRACE_OP_END ? TRACE_KINDS : x->kind;
+    int ky = y->kind == TRACE_OP_BEGIN ? -1 : y->kind == TRACE_OP_END ? TRACE_KINDS : y->kind;
+
+    return kx - ky;
+}
+
+/**
+ * @brief Order operations from the slowest
+ *
+ * @param const void* a
+ * @param const void* b
+ * @return int
+ */
+static int op_cmp(const void *a, const void *b)
+{
+    const ToolOp *x = (const ToolOp *)a;
+    const ToolOp *y = (const ToolOp *)b;
+
+    if (x->duration != y->duration)
+        return x->duration > y->duration ? -1 : 1;
+
+    return x->id < y->id ? -1 : 1;
+}
+
+/**
+ * @brief Read the events kept by a trace file, from the oldest
+ *
+ * @param const char* path
+ * @param long* n receives the amount of events
+ * @param uint64_t* written receives the amount of events written to the ring
+ * @return TraceEvent*
+ */
+static TraceEvent *read_trace(const char *path, long *n, uint64_t *written)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp)
+    {
+        perror("Couldn't open the trace file.\n");
+        exit(1);
+    }
+
+    TraceHeader h;
+    if (fread(&h, sizeof(h), 1, fp) != 1 || h.magic != TRACE_MAGIC || h.capacity == 0)
+    {
+        fprintf(stderr, "%s isn't a trace file.\n", path);
+        exit(1);
+    }
+
+    TraceEvent *ring = (TraceEvent *)malloc((size_t)h.capacity * sizeof(TraceEvent));
+    if (fread(ring, sizeof(TraceEvent), h.capacity, fp) != h.capacity)
+    {
+        fprintf(stderr, "The trace file is cut short.\n");
+        exit(1);
+    }
+    fclose(fp);
+
+    // Once the ring is full, the oldest event is the next one to be overwritten
+    long kept = h.written < h.capacity ? (long)h.written : (long)h.capacity;
+    long oldest = h.written < h.capacity ? 0 : (long)(h.written % h.capacity);
+
+    TraceEvent *events = (TraceEvent *)malloc((kept ? kept : 1) * sizeof(TraceEvent));
+    for (long i = 0; i < kept; i++)
+        events[i] = ring[(oldest + i) % h.capacity];
+    free(ring);
+
+    *n = kept;
+    *written = h.written;
+
+    return events;
+}
+
+/**
+ * @brief Group the events by operation, keeping the operations seen from start to end
+ *
+ * @param TraceEvent* events sorted by operation
+ * @param long n
+ * @param long* n_ops receives the amount of operations
+ * @return ToolOp*
+ */
+static ToolOp *group_ops(TraceEvent *events, long n, long *n_ops)
+{
+    ToolOp *ops = (ToolOp *)malloc((n ? n : 1) * sizeof(ToolOp));
+    long amount = 0;
+
+    for (long i = 0; i < n;)
+    {
+        long j = i;
+        while (j < n && events[j].op == events[i].op)
+            j++;
+
+        // Events out of the operations, and operations whose start or end was
+        // overwritten or not written yet, are left out
+        if (events[i].op != 0 && events[i].kind == TRACE_OP_BEGIN && events[j - 1].kind == TRACE_OP_END)
+        {
+            ToolOp *o = &ops[amount++];
+            memset(o, 0, sizeof(ToolOp));
+            o->id = events[i].op;
+            o->type = events[i].type;
+            o->key = events[i].key;
+            o->first = i;
+            o->count = j - i;
+            o->duration = events[j - 1].time - events[i].time;
+
+            for (long k = i; k < j; k++)
+            {
+                o->kinds[events[k].kind < TRACE_KINDS ? events[k].kind : TRACE_OP_END]++;
+                if (events[k].depth > o->depth)
+                    o->depth = events[k].depth;
+            }
+        }
+
+        i = j;
+    }
+
+    *n_ops = amount;
+
+    return ops;
+}
+
+/**
+ * @brief Print the events of an operation, with their time since its start
+ *
+ * @param ToolOp* o
+ * @param TraceEvent* events
+ */
+static void print_timeline(ToolOp *o, TraceEvent *events)
+{
+    printf("op %u %s key %d: %.2f us, depth %d, %ld splits, %ld merges, %ld borrows, %ld reads, %ld writes\n",
+           o->id, btree_op_name(o->type), o->key, o->duration / 1e3, o->depth, o->kinds[TRACE_SPLIT],
+           o->kinds[TRACE_MERGE], o->kinds[TRACE_BORROW], o->kinds[TRACE_PAGE_READ], o->kinds[TRACE_PAGE_WRITE]);
+
+    uint64_t start = events[o->first].time;
+    for (long k = o->first + 1; k < o->first + o->count - 1; k++)
+    {
+        TraceEvent *e = &events[k];
+        printf("  %10.2f us  %-10s pos %-8d depth %d\n", (e->time - start) / 1e3, kind_name(e->kind), e->pos, e->depth);
+    }
+}
+
+/**
+ * @brief Print the time of the operations as folded stacks, for flame graphs
+ *
+ * The time before each event goes to the frame "type;depth_N;kind", the time
+ * after the last one to the frame of the type alone. Values are nanoseconds
+ *
+ * @param ToolOp* ops
+ * @param long n_ops
+ * @param TraceEvent* events
+ */
+static void print_folded(ToolOp *ops, long n_ops, TraceEvent *events)
+{
+    static uint64_t frames[256][TOOL_DEPTHS][TRACE_KINDS];
+    memset(frames, 0, sizeof(frames));
+
+    for (long i = 0; i < n_ops; i++)
+    {
+        ToolOp *o = &ops[i];
+        for (long k = o->first + 1; k < o->first + o->count; k++)
+        {
+            TraceEvent *e = &events[k];
+            int depth = e->depth < 0 ? 0 : e->depth >= TOOL_DEPTHS ? TOOL_DEPTHS - 1 : e->depth;
+            int kind = e->kind < TRACE_KINDS ? e->kind : TRACE_OP_END;
+
+            frames[o->type][kind == TRACE_OP_END ? 0 : depth][kind] += e->time - events[k - 1].time;
+        }
+    }
+
+    for (int t = 0; t < 256; t++)
+    {
+        for (int d = 0; d < TOOL_DEPTHS; d++)
+        {
+            for (int k = 0; k < TRACE_KINDS; k++)
+            {
+                if (!frames[t][d][k])
+                    continue;
+
+                if (k == TRACE_OP_END)
+                    printf("%s %llu\n", btree_op_name(t), (unsigned long long)frames[t][d][k]);
+                else
+                    printf("%s;depth_%d;%s %llu\n", btree_op_name(t), d, kind_name(k), (unsigned long long)frames[t][d][k]);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <trace> [--top n] [--op id] [--folded]\n", argv[0]);
+        return 1;
+    }
+
+    int top = 10;
+    long only = -1;
+    int folded = 0;
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--top") && i + 1 < argc)
+            top = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--op") && i + 1 < argc)
+            only = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--folded"))
+            folded = 1;
+    }
+
+    long n, n_ops;
+    uint64_t written;
+    TraceEvent *events = read_trace(argv[1], &n, &written);
+
+    qsort(events, n, sizeof(TraceEvent), event_cmp);
+    ToolOp *ops = group_ops(events, n, &n_ops);
+
+    if (folded)
+    {
+        print_folded(ops, n_ops, events);
+    }
+    else if (only != -1)
+    {
+        for (long i = 0; i < n_ops; i++)
+        {
+            if (ops[i].id == (uint32_t)only)
+                print_timeline(&ops[i], events);
+        }
+    }
+    else
+    {
+        printf("events: %ld kept of %llu written, %ld whole operations\n\n", n, (unsigned long long)written, n_ops);
+
+        // Totals per type of operation
+        printf("%-13s %10s %10s %10s %8s %8s %8s %8s %8s\n", "op", "count", "mean us", "max us", "splits", "merges", "borrows", "reads", "writes");
+        for (int t = 0; t < BTREE_OPS; t++)
+        {
+            long count = 0, kinds[TRACE_KINDS] = {0};
+            uint64_t sum = 0, max = 0;
+
+            for (long i = 0; i < n_ops; i++)
+            {
+                if (ops[i].type != t)
+                    continue;
+
+                count++;
+                sum += ops[i].duration;
+                if (ops[i].duration > max)
+                    max = ops[i].duration;
+                for (int k = 0; k < TRACE_KINDS; k++)
+                    kinds[k] += ops[i].kinds[k];
+            }
+
+            if (count)
+                printf("%-13s %10ld %10.2f %10.2f %8ld %8ld %8ld %8ld %8ld\n", btree_op_name(t), count, sum / 1e3 / count,
+                       max / 1e3, kinds[TRACE_SPLIT], kinds[TRACE_MERGE], kinds[TRACE_BORROW], kinds[TRACE_PAGE_READ], kinds[TRACE_PAGE_WRITE]);
+        }
+
+        // Timelines of the slowest operations
+        qsort(ops, n_ops, sizeof(ToolOp), op_cmp);
+        printf("\nslowest operations:\n");
+        for (long i = 0; i < n_ops && i < top; i++)
+            print_timeline(&ops[i], events);
+    }
+
+    free(ops);
+    free(events);
+
+    return 0;
+}